@@ -46,7 +46,7 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
 {
 	static int first_run = 1;
 	psl_ctx_t *psl;
-	char *domain, *res;
+	char *domain, *res, ubuf[256];
 	int rc;
 
 	if (size > 64 * 1024 - 1)
@@ -68,6 +68,8 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
 	psl_is_public_suffix2(psl, domain, PSL_TYPE_NO_STAR_RULE|PSL_TYPE_ANY);
 	psl_unregistrable_domain(psl, domain);
 	psl_registrable_domain(psl, domain);
+	psl_unregistrable_domain_unicode(psl, domain, ubuf, sizeof(ubuf));
+	psl_registrable_domain_unicode(psl, domain, ubuf, sizeof(ubuf));
 
 	psl_is_cookie_domain_acceptable(psl, "", NULL);
 	psl_is_cookie_domain_acceptable(psl, "a.b.c.e.com", domain);
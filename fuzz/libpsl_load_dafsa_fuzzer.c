@@ -48,17 +48,21 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
 
 	assert(in != NULL);
 
-	/* create a valid DAFSA input file */
-	memcpy(in, ".DAFSA@PSL_0   \n", 16);
+	/* create a valid DAFSA input file, version 5 may contain dense tables and vector nodes */
+	memcpy(in, ".DAFSA@PSL_5   \n", 16);
 	memcpy(in + 16, data, size);
 
 	fp = fmemopen(in, size + 16, "r");
 	assert(fp != NULL);
 
+	/* runs ValidateDafsa(), the lookups below skip the range checks if it passes */
 	psl = psl_load_fp(fp);
 
 	psl_is_public_suffix(NULL, NULL);
 	psl_is_public_suffix(psl, ".ü.com");
+	psl_is_public_suffix(psl, "www.example.co.uk");
+	psl_is_public_suffix2(psl, "com", PSL_TYPE_ANY|PSL_TYPE_NO_STAR_RULE);
+	psl_registrable_domain(psl, "a.b.c.d.e.f");
 	psl_suffix_wildcard_count(psl);
 	psl_suffix_exception_count(psl);
 	psl_suffix_count(psl);
@@ -66,6 +70,73 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
 	psl_free(psl);
 	fclose(fp);
 
+	/* the same data as version 2, each return value followed by a payload */
+	memcpy(in, ".DAFSA@PSL_2   \n", 16);
+
+	fp = fmemopen(in, size + 16, "r");
+	assert(fp != NULL);
+
+	psl = psl_load_fp(fp);
+
+	psl_is_public_suffix(psl, "www.example.co.uk");
+	psl_suffix_rule_id(psl, "www.example.co.uk", NULL);
+	psl_suffix_rule_id(psl, ".ü.com", NULL);
+	psl_rule_by_id(psl, 0, NULL);
+	psl_rule_by_id(psl, psl_rule_count(psl) - 1, NULL);
+
+	psl_free(psl);
+	fclose(fp);
+
+	/* the same data as version 13, the labels of the strings in reverse order */
+	memcpy(in, ".DAFSA@PSL_13  \n", 16);
+
+	fp = fmemopen(in, size + 16, "r");
+	assert(fp != NULL);
+
+	psl = psl_load_fp(fp);
+
+	psl_is_public_suffix(psl, ".ü.com");
+	psl_is_public_suffix(psl, "www.example.co.uk");
+	psl_is_public_suffix2(psl, "WWW.Example.CO.UK", PSL_TYPE_ANY|PSL_TYPE_IGNORE_CASE);
+	psl_registrable_domain(psl, "a.b.c.d.e.f");
+
+	psl_free(psl);
+	fclose(fp);
+
+	/* the same data as minimal perfect hash table (psl-make-dafsa --output-format=mph) */
+	memcpy(in, ".MPH@PSL_0     \n", 16);
+
+	fp = fmemopen(in, size + 16, "r");
+	assert(fp != NULL);
+
+	psl = psl_load_fp(fp);
+
+	psl_is_public_suffix(psl, ".ü.com");
+	psl_is_public_suffix(psl, "www.example.co.uk");
+	psl_is_public_suffix2(psl, "WWW.Example.CO.UK", PSL_TYPE_ANY|PSL_TYPE_IGNORE_CASE);
+	psl_suffix_rule_id(psl, "www.example.co.uk", NULL);
+	psl_rule_by_id(psl, 0, NULL);
+
+	psl_free(psl);
+	fclose(fp);
+
+	/* the same data as LOUDS trie (psl-make-dafsa --output-format=louds) */
+	memcpy(in, ".LOUDS@PSL_0   \n", 16);
+
+	fp = fmemopen(in, size + 16, "r");
+	assert(fp != NULL);
+
+	psl = psl_load_fp(fp);
+
+	psl_is_public_suffix(psl, ".ü.com");
+	psl_is_public_suffix(psl, "www.example.co.uk");
+	psl_is_public_suffix2(psl, "WWW.Example.CO.UK", PSL_TYPE_ANY|PSL_TYPE_IGNORE_CASE);
+	psl_suffix_rule_id(psl, "www.example.co.uk", NULL);
+	psl_rule_by_id(psl, 0, NULL);
+
+	psl_free(psl);
+	fclose(fp);
+
 	psl = psl_latest(NULL);
 	psl_free(psl);
 
@@ -97,6 +97,13 @@ build-info:
 clean:
 	@if exist vs$(VSVER)\$(CFG)\$(PLAT)\psl.dafsa del vs$(VSVER)\$(CFG)\$(PLAT)\psl.dafsa
 	@if exist vs$(VSVER)\$(CFG)\$(PLAT)\psl_ascii.dafsa del vs$(VSVER)\$(CFG)\$(PLAT)\psl_ascii.dafsa
+	@if exist vs$(VSVER)\$(CFG)\$(PLAT)\psl.mph del vs$(VSVER)\$(CFG)\$(PLAT)\psl.mph
+	@if exist vs$(VSVER)\$(CFG)\$(PLAT)\psl_payload_ascii.mph del vs$(VSVER)\$(CFG)\$(PLAT)\psl_payload_ascii.mph
+	@if exist vs$(VSVER)\$(CFG)\$(PLAT)\psl_ascii.louds del vs$(VSVER)\$(CFG)\$(PLAT)\psl_ascii.louds
+	@if exist vs$(VSVER)\$(CFG)\$(PLAT)\psl_payload_ascii.louds del vs$(VSVER)\$(CFG)\$(PLAT)\psl_payload_ascii.louds
+	@if exist vs$(VSVER)\$(CFG)\$(PLAT)\psl_vector.dafsa del vs$(VSVER)\$(CFG)\$(PLAT)\psl_vector.dafsa
+	@if exist vs$(VSVER)\$(CFG)\$(PLAT)\psl_locality.dafsa del vs$(VSVER)\$(CFG)\$(PLAT)\psl_locality.dafsa
+	@if exist vs$(VSVER)\$(CFG)\$(PLAT)\psl_reversed.dafsa del vs$(VSVER)\$(CFG)\$(PLAT)\psl_reversed.dafsa
 	@if exist .\libpsl.pc del /f /q .\libpsl.pc
 	@-del /f /q vs$(VSVER)\$(CFG)\$(PLAT)\*.exe
 	@-del /f /q vs$(VSVER)\$(CFG)\$(PLAT)\*.lib
@@ -11,16 +11,44 @@ vs$(VSVER)\$(CFG)\$(PLAT)\tests:
 
 vs$(VSVER)\$(CFG)\$(PLAT)\libpsl\suffixes_dafsa.h: vs$(VSVER)\$(CFG)\$(PLAT)\libpsl $(PSL_FILE) ..\src\psl-make-dafsa
 	@echo Generating $@
-	$(PYTHON) ..\src\psl-make-dafsa --output-format=cxx+ "$(PSL_FILE_INPUT)" $@
+	$(PYTHON) ..\src\psl-make-dafsa --output-format=cxx+ --dense-threshold=16 "$(PSL_FILE_INPUT)" $@
 
 vs$(VSVER)\$(CFG)\$(PLAT)\psl.dafsa: vs$(VSVER)\$(CFG)\$(PLAT)\tests
 	@echo Generating $@
-	$(PYTHON) ..\src\psl-make-dafsa --output-format=binary "$(PSL_FILE_INPUT)" $@
+	$(PYTHON) ..\src\psl-make-dafsa --output-format=binary --dense-threshold=16 "$(PSL_FILE_INPUT)" $@
 
 vs$(VSVER)\$(CFG)\$(PLAT)\psl_ascii.dafsa: vs$(VSVER)\$(CFG)\$(PLAT)\tests
 	@echo Generating $@
 	$(PYTHON) ..\src\psl-make-dafsa --output-format=binary --encoding=ascii "$(PSL_FILE_INPUT)" $@
 
+vs$(VSVER)\$(CFG)\$(PLAT)\psl.mph: vs$(VSVER)\$(CFG)\$(PLAT)\tests
+	@echo Generating $@
+	$(PYTHON) ..\src\psl-make-dafsa --output-format=mph "$(PSL_FILE_INPUT)" $@
+
+vs$(VSVER)\$(CFG)\$(PLAT)\psl_payload_ascii.mph: vs$(VSVER)\$(CFG)\$(PLAT)\tests
+	@echo Generating $@
+	$(PYTHON) ..\src\psl-make-dafsa --output-format=mph --payload --encoding=ascii "$(PSL_FILE_INPUT)" $@
+
+vs$(VSVER)\$(CFG)\$(PLAT)\psl_ascii.louds: vs$(VSVER)\$(CFG)\$(PLAT)\tests
+	@echo Generating $@
+	$(PYTHON) ..\src\psl-make-dafsa --output-format=louds --encoding=ascii "$(PSL_FILE_INPUT)" $@
+
+vs$(VSVER)\$(CFG)\$(PLAT)\psl_payload_ascii.louds: vs$(VSVER)\$(CFG)\$(PLAT)\tests
+	@echo Generating $@
+	$(PYTHON) ..\src\psl-make-dafsa --output-format=louds --payload --encoding=ascii "$(PSL_FILE_INPUT)" $@
+
+vs$(VSVER)\$(CFG)\$(PLAT)\psl_vector.dafsa: vs$(VSVER)\$(CFG)\$(PLAT)\tests
+	@echo Generating $@
+	$(PYTHON) ..\src\psl-make-dafsa --output-format=binary --vector-threshold=4 "$(PSL_FILE_INPUT)" $@
+
+vs$(VSVER)\$(CFG)\$(PLAT)\psl_locality.dafsa: vs$(VSVER)\$(CFG)\$(PLAT)\tests
+	@echo Generating $@
+	$(PYTHON) ..\src\psl-make-dafsa --output-format=binary --dense-threshold=16 --layout=locality "$(PSL_FILE_INPUT)" $@
+
+vs$(VSVER)\$(CFG)\$(PLAT)\psl_reversed.dafsa: vs$(VSVER)\$(CFG)\$(PLAT)\tests
+	@echo Generating $@
+	$(PYTHON) ..\src\psl-make-dafsa --output-format=binary --payload --dense-threshold=16 --reverse-labels "$(PSL_FILE_INPUT)" $@
+
 libpsl.pc: ..\libpsl.pc.in
 	@echo Generating $@
 	$(PYTHON) libpsl-pc.py --name=$(PACKAGE_NAME)	\
@@ -0,0 +1,410 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of libpsl.
+ *
+ * The double-array trie engine (psl_load_ex() with PSL_ENGINE_DARRAY).
+ *
+ * Each node of the trie of the rule strings is a unit with a 'base' and a 'check' value.
+ * The child of node s for byte c is the unit t = base[s] + c if check[t] == s,
+ * so each transition is an array lookup instead of the offset decoding and the linear
+ * scan of the children in the DAFSA. A rule string ends with the transition for byte 0,
+ * its unit holds -1 - (extended flags | (rule ID + 1) << 6) as 'base'.
+ *
+ * The trie is built at load time from the rule strings of another engine, which takes
+ * about ten milliseconds for the PSL. Base and check of a unit are adjacent, so the check of
+ * a transition and the base of the next one share a cache line.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "engine.h"
+
+#define DARRAY_MAX_KEY 255 /* longer rule strings are ignored */
+#define DARRAY_PAYLOAD_SIZE 4
+
+typedef struct {
+	int
+		base,
+		check; /* the parent unit, -1 if the unit is free */
+} darray_unit_t;
+
+typedef struct {
+	darray_unit_t
+		*units;
+	int
+		nunits;
+	unsigned
+		payload : 1; /* 1: the rule strings have rule IDs */
+} psl_darray_t;
+
+static unsigned char fold_case(unsigned char c, int nocase)
+{
+	return nocase && c >= 'A' && c <= 'Z' ? (unsigned char) (c | 0x20) : c;
+}
+
+/* returns the value of the rule string 'key' or -1 if there is no such rule */
+static int darray_find(const psl_darray_t *d, const char *key, size_t len, int nocase)
+{
+	const darray_unit_t *units = d->units;
+	const unsigned char *k = (const unsigned char *) key;
+	int s = 0, t;
+
+	if (!d->nunits)
+		return -1;
+
+	for (; len; len--, k++) {
+		t = units[s].base + fold_case(*k, nocase);
+
+		if ((unsigned) t >= (unsigned) d->nunits || units[t].check != s)
+			return -1;
+
+		s = t;
+	}
+
+	/* the end of the string */
+	t = units[s].base;
+
+	if ((unsigned) t >= (unsigned) d->nunits || units[t].check != s)
+		return -1;
+
+	return -1 - units[t].base;
+}
+
+static int darray_engine_lookup(const void *data, const char *key, size_t len, int is_ascii, int nocase)
+{
+	int value;
+
+	(void) is_ascii;
+
+	if ((value = darray_find((const psl_darray_t *) data, key, len, nocase)) < 0)
+		return -1;
+
+	return value & 0x0F;
+}
+
+static int darray_engine_rule_id(const void *data, const char *key, size_t len)
+{
+	const psl_darray_t *d = (const psl_darray_t *) data;
+	int value;
+
+	if (!d->payload || (value = darray_find(d, key, len, 0)) < 0)
+		return -1;
+
+	return (value >> 6) - 1;
+}
+
+/*
+ * The rule strings end at the units that are the byte 0 child of their parent.
+ * Each string is collected backwards, from its end up to the root.
+ */
+static int darray_engine_foreach(const void *data, psl_rule_callback_t callback, void *user_data)
+{
+	const psl_darray_t *d = (const psl_darray_t *) data;
+	const darray_unit_t *units = d->units;
+	char buf[DARRAY_MAX_KEY];
+	int t, s, p, rc;
+
+	for (t = 1; t < d->nunits; t++) {
+		unsigned char payload[DARRAY_PAYLOAD_SIZE];
+		char *key = buf + sizeof(buf);
+		int value, id;
+
+		if ((p = units[t].check) < 0 || units[p].base != t)
+			continue;
+
+		for (s = p; s; s = p) {
+			p = units[s].check;
+			if (key == buf)
+				return -1;
+			*--key = (char) (s - units[p].base);
+		}
+
+		value = -1 - units[t].base;
+		id = (value >> 6) - 1;
+		payload[0] = (unsigned char) (value & 0x3F);
+		payload[1] = (unsigned char) (id >> 16);
+		payload[2] = (unsigned char) (id >> 8);
+		payload[3] = (unsigned char) id;
+
+		if ((rc = callback(key, buf + sizeof(buf) - key, value & 0x0F, d->payload ? payload : NULL, user_data)))
+			return rc;
+	}
+
+	return 0;
+}
+
+static size_t darray_engine_memory_usage(const void *data)
+{
+	const psl_darray_t *d = (const psl_darray_t *) data;
+
+	return sizeof(psl_darray_t) + d->nunits * sizeof(darray_unit_t);
+}
+
+static void darray_engine_free(void *data)
+{
+	psl_darray_t *d = (psl_darray_t *) data;
+
+	free(d->units);
+	free(d);
+}
+
+/* a rule string collected by darray_engine_build() */
+typedef struct {
+	const char
+		*s;
+	size_t
+		offset, /* of 's' in the pool, while the pool grows */
+		len;
+	int
+		value;
+} darray_key_t;
+
+typedef struct {
+	darray_key_t
+		*keys;
+	char
+		*pool;
+	size_t
+		nkeys,
+		max_keys,
+		pool_size,
+		max_pool;
+	int
+		payload; /* 1: each rule string has a payload */
+	darray_unit_t
+		*units;
+	int
+		nunits,
+		max_units,
+		first_free; /* the units below are in use */
+	unsigned char
+		*code; /* the bytes of the children for each depth, 256 each */
+	size_t
+		*start; /* the first key of each child for each depth, 257 each */
+} darray_builder_t;
+
+/* callback for the foreach function of an engine */
+static int darray_keys_add(const char *rule, size_t len, int flags, const unsigned char *payload, void *data)
+{
+	darray_builder_t *b = (darray_builder_t *) data;
+	darray_key_t *key;
+	void *p;
+
+	if (len > DARRAY_MAX_KEY || memchr(rule, 0, len))
+		return 0;
+
+	if (b->nkeys >= b->max_keys) {
+		if (!(p = realloc(b->keys, (b->max_keys = b->max_keys ? b->max_keys * 2 : 8192) * sizeof(darray_key_t))))
+			return -1;
+		b->keys = p;
+	}
+
+	if (b->pool_size + len > b->max_pool) {
+		while (b->pool_size + len > b->max_pool)
+			b->max_pool = b->max_pool ? b->max_pool * 2 : 65536;
+		if (!(p = realloc(b->pool, b->max_pool)))
+			return -1;
+		b->pool = p;
+	}
+
+	key = &b->keys[b->nkeys++];
+	key->offset = b->pool_size;
+	key->len = len;
+
+	if (payload) {
+		key->value = (payload[0] & 0x30) | (flags & 0x0F)
+			| ((((payload[1] << 16) | (payload[2] << 8) | payload[3]) + 1) << 6);
+	} else {
+		key->value = flags & 0x0F;
+		b->payload = 0;
+	}
+
+	memcpy(b->pool + b->pool_size, rule, len);
+	b->pool_size += len;
+
+	return 0;
+}
+
+static int darray_compare_key(const void *p1, const void *p2)
+{
+	const darray_key_t *k1 = (const darray_key_t *) p1, *k2 = (const darray_key_t *) p2;
+	int n;
+
+	if ((n = memcmp(k1->s, k2->s, k1->len < k2->len ? k1->len : k2->len)))
+		return n;
+
+	return k1->len < k2->len ? -1 : k1->len > k2->len;
+}
+
+/* makes sure that the units up to 'n' exist */
+static int darray_reserve(darray_builder_t *b, int n)
+{
+	void *p;
+
+	if (n < b->max_units)
+		return 0;
+
+	if (n >= INT_MAX / 2)
+		return -1;
+
+	if (!(p = realloc(b->units, (size_t) (n * 2) * sizeof(darray_unit_t))))
+		return -1;
+
+	b->units = p;
+	for (; b->max_units < n * 2; b->max_units++) {
+		b->units[b->max_units].base = 0;
+		b->units[b->max_units].check = -1;
+	}
+
+	return 0;
+}
+
+/* places the children of unit 's', the keys 'lo' to 'hi' that have the same first 'depth' bytes */
+static int darray_build_node(darray_builder_t *b, int s, size_t lo, size_t hi, size_t depth)
+{
+	unsigned char *code = b->code + depth * 256;
+	size_t *start = b->start + depth * 257, it, nchildren = 0;
+	int base, pos, c;
+
+	/* the keys are sorted, so the keys with the same next byte are adjacent, the ending ones first */
+	for (it = lo; it < hi; it++) {
+		c = depth < b->keys[it].len ? (unsigned char) b->keys[it].s[depth] : 0;
+
+		if (!nchildren || code[nchildren - 1] != c) {
+			code[nchildren] = (unsigned char) c;
+			start[nchildren++] = it;
+		}
+	}
+	start[nchildren] = hi;
+
+	/* the first base that puts all children into free units */
+	for (pos = b->first_free > code[0] ? b->first_free : code[0] + 1;; pos++) {
+		base = pos - code[0];
+
+		if (darray_reserve(b, base + code[nchildren - 1] + 1))
+			return -1;
+
+		for (it = 0; it < nchildren; it++)
+			if (b->units[base + code[it]].check >= 0)
+				break;
+
+		if (it == nchildren)
+			break;
+	}
+
+	b->units[s].base = base;
+	for (it = 0; it < nchildren; it++) {
+		b->units[base + code[it]].check = s;
+		if (base + code[it] >= b->nunits)
+			b->nunits = base + code[it] + 1;
+	}
+
+	while (b->first_free < b->max_units && b->units[b->first_free].check >= 0)
+		b->first_free++;
+
+	for (it = 0; it < nchildren; it++) {
+		if (code[it] == 0) {
+			/* duplicate rule strings merge their flags */
+			int value = b->keys[start[it]].value;
+
+			for (lo = start[it] + 1; lo < start[it + 1]; lo++)
+				value |= b->keys[lo].value & 0x0F;
+
+			b->units[base].base = -1 - value;
+		} else if (darray_build_node(b, base + code[it], start[it], start[it + 1], depth + 1))
+			return -1;
+	}
+
+	return 0;
+}
+
+static void *darray_engine_build(const psl_engine_t *engine, const void *data)
+{
+	darray_builder_t b;
+	psl_darray_t *d = NULL;
+	size_t it;
+	void *p;
+
+	memset(&b, 0, sizeof(b));
+	b.payload = 1;
+
+	if (engine->foreach(data, darray_keys_add, &b))
+		goto out;
+
+	for (it = 0; it < b.nkeys; it++)
+		b.keys[it].s = b.pool + b.keys[it].offset;
+
+	qsort(b.keys, b.nkeys, sizeof(darray_key_t), darray_compare_key);
+
+	if (!(b.code = malloc((DARRAY_MAX_KEY + 1) * 256))
+		|| !(b.start = malloc((DARRAY_MAX_KEY + 1) * 257 * sizeof(size_t)))
+		|| darray_reserve(&b, 4096))
+	{
+		goto out;
+	}
+
+	/* the root */
+	b.units[0].check = 0;
+	b.nunits = b.first_free = 1;
+
+	if (b.nkeys && darray_build_node(&b, 0, 0, b.nkeys, 0))
+		goto out;
+
+	if (!(d = calloc(1, sizeof(psl_darray_t))))
+		goto out;
+
+	/* release the unused units */
+	if ((p = realloc(b.units, b.nunits * sizeof(darray_unit_t))))
+		b.units = p;
+
+	d->units = b.units;
+	d->nunits = b.nkeys ? b.nunits : 0;
+	d->payload = b.payload && b.nkeys;
+	b.units = NULL;
+
+out:
+	free(b.start);
+	free(b.code);
+	free(b.units);
+	free(b.pool);
+	free(b.keys);
+
+	return d;
+}
+
+const psl_engine_t psl_darray_engine = {
+	"darray",
+	darray_engine_lookup,
+	darray_engine_rule_id,
+	darray_engine_foreach,
+	darray_engine_memory_usage,
+	darray_engine_free,
+	darray_engine_build,
+	NULL, /* built at load time */
+	NULL
+};
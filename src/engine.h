@@ -0,0 +1,128 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of libpsl.
+ *
+ * Internal interface of the lookup engines
+ */
+
+#ifndef PSL_ENGINE_H
+#define PSL_ENGINE_H
+
+#include <stddef.h>
+
+/* flags of a rule string, the same values as the return values of the DAFSA */
+#define PSL_ENGINE_FLAG_EXCEPTION (1<<0)
+#define PSL_ENGINE_FLAG_WILDCARD  (1<<1)
+#define PSL_ENGINE_FLAG_ICANN     (1<<2)
+#define PSL_ENGINE_FLAG_PRIVATE   (1<<3)
+
+/*
+ * Called for each rule string of an engine with the string (not NUL terminated),
+ * its length, its flags, its payload (see psl-make-dafsa --payload) or NULL and 'data'.
+ * A non-zero return value stops the iteration.
+ */
+typedef int (*psl_rule_callback_t)(const char *rule, size_t len, int flags, const unsigned char *payload, void *data);
+
+/* a block of read-only memory, either allocated or mapped from a file */
+typedef struct {
+	const unsigned char
+		*data;
+	size_t
+		size;
+	void
+		*mem; /* allocated or mapped memory that contains 'data', NULL if not owned */
+	size_t
+		mem_size;
+	unsigned
+		mapped : 1; /* 1: 'mem' has been mapped by mmap() */
+} psl_blob_t;
+
+/* the properties of the rule strings of a binary file, set by the open function of an engine */
+typedef struct {
+	int
+		utf8, /* 1: international rules in UTF-8 and punycode, 0: just punycode */
+		payload, /* 1: each rule string has a payload */
+		max_nlabels; /* the maximum number of labels of a rule, 0 if unknown */
+} psl_engine_info_t;
+
+/*
+ * A lookup engine answers exact-match probes for the rule strings of a PSL:
+ * the rules without '!' or '*.' prefix, the international ones in UTF-8 and/or punycode.
+ * The data of an engine is created by its loader or builder and passed to all functions.
+ */
+typedef struct psl_engine_st psl_engine_t;
+
+struct psl_engine_st {
+	const char
+		*name;
+	/*
+	 * Returns the flags of the rule string with the 'len' bytes of 'key' or -1 if there is no such rule.
+	 * 'key' is NUL terminated after 'len' bytes. 'is_ascii' is set if 'key' has no bytes >= 0x80,
+	 * 'nocase' is only set for ASCII keys and asks to match 'A'-'Z' like 'a'-'z'.
+	 */
+	int
+		(*lookup)(const void *data, const char *key, size_t len, int is_ascii, int nocase);
+	/* Returns the rule ID of the rule string 'key' or -1 if there is no such rule or no ID. */
+	int
+		(*rule_id)(const void *data, const char *key, size_t len);
+	/* Calls 'callback' for each rule string, returns 0, the non-zero return value of 'callback' or -1 on error. */
+	int
+		(*foreach)(const void *data, psl_rule_callback_t callback, void *user_data);
+	/* Returns the number of bytes used by the engine data. */
+	size_t
+		(*memory_usage)(const void *data);
+	void
+		(*free)(void *data);
+	/* Creates the engine data from the rule strings of another engine, NULL if not supported. */
+	void *
+		(*build)(const psl_engine_t *engine, const void *data);
+	/*
+	 * Creates the engine data from the content of a binary file behind its header line, NULL if not supported.
+	 * Takes ownership of 'blob' on success.
+	 */
+	void *
+		(*open)(psl_blob_t *blob, psl_engine_info_t *info);
+	/*
+	 * Optional, NULL if the engine needs a lookup per suffix: sets flags[i] to lookup(data, suffix, ..., 1, nocase)
+	 * for the suffix made of the last i + 1 labels of the ASCII 'key', for i < 'nlabels', in a single traversal.
+	 * Returns -1 if the data doesn't support it (nothing is set), 0 otherwise.
+	 */
+	int
+		(*lookup_labels)(const void *data, const char *key, size_t len, int nocase, int *flags, size_t nlabels);
+};
+
+/* releases the memory of 'blob' (psl.c) */
+void psl_blob_free(psl_blob_t *blob);
+
+/* the minimal perfect hash engine (mph.c) */
+extern const psl_engine_t psl_mph_engine;
+
+/* the double-array trie engine (darray.c) */
+extern const psl_engine_t psl_darray_engine;
+
+/* the LOUDS trie engine (louds.c) */
+extern const psl_engine_t psl_louds_engine;
+
+/* the JIT engine (jit.c), its build function returns NULL if not supported */
+extern const psl_engine_t psl_jit_engine;
+
+#endif /* PSL_ENGINE_H */
@@ -0,0 +1,387 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of libpsl.
+ *
+ * Decoder of raw DEFLATE streams (RFC 1951) for the compressed built-in data
+ * (psl-make-dafsa --compress), so libpsl doesn't depend on zlib.
+ *
+ * The output size is known in advance, so the whole output is the window and
+ * nothing is allocated. Each Huffman code is decoded with a table of its first
+ * INFLATE_FAST_BITS bits, longer codes (rare with the data of libpsl) bit by bit.
+ * Corrupt or truncated input is detected, the output buffer is never overrun.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stddef.h>
+#include <string.h>
+
+#define INFLATE_MAX_BITS 15 /* max. length of a Huffman code */
+#define INFLATE_FAST_BITS 9
+#define INFLATE_NLITLEN 288 /* literal/length codes, 286 and 287 are invalid */
+#define INFLATE_NDIST 30
+
+typedef struct {
+	const unsigned char
+		*in,
+		*in_end;
+	unsigned char
+		*out,
+		*out_pos,
+		*out_end;
+	unsigned long
+		bitbuf; /* the next 'nbits' bits of the input, LSB first */
+	unsigned
+		nbits,
+		eof : 1; /* 1: more bits have been consumed than the input has */
+} inflate_state_t;
+
+/* a canonical Huffman code */
+typedef struct {
+	unsigned short
+		count[INFLATE_MAX_BITS + 1], /* the number of codes of each length */
+		symbol[INFLATE_NLITLEN], /* the symbols, ordered by code */
+		fast[1 << INFLATE_FAST_BITS]; /* by the next INFLATE_FAST_BITS bits: (symbol << 4) | length, 0 if longer */
+} inflate_huffman_t;
+
+/* loads the bit buffer with at least 'n' bits if the input has them */
+static void need_bits(inflate_state_t *s, unsigned n)
+{
+	while (s->nbits < n && s->in < s->in_end) {
+		s->bitbuf |= (unsigned long) *s->in++ << s->nbits;
+		s->nbits += 8;
+	}
+}
+
+/* consumes 'n' bits, sets 'eof' if the input doesn't have them */
+static void drop_bits(inflate_state_t *s, unsigned n)
+{
+	if (s->nbits < n) {
+		s->eof = 1;
+		n = s->nbits;
+	}
+	s->bitbuf >>= n;
+	s->nbits -= n;
+}
+
+static unsigned get_bits(inflate_state_t *s, unsigned n)
+{
+	unsigned value;
+
+	if (!n)
+		return 0;
+
+	need_bits(s, n);
+	value = (unsigned) (s->bitbuf & ((1UL << n) - 1));
+	drop_bits(s, n);
+
+	return value;
+}
+
+/* the Huffman codes are stored MSB first, the bit buffer is LSB first */
+static unsigned reverse_bits(unsigned code, unsigned len)
+{
+	unsigned rev = 0;
+
+	while (len--) {
+		rev = (rev << 1) | (code & 1);
+		code >>= 1;
+	}
+
+	return rev;
+}
+
+/*
+ * Sets up 'h' from the code lengths of 'n' symbols.
+ * Returns 0 or -1 if the lengths are over-subscribed. Incomplete codes are allowed,
+ * decode() fails on the missing codes.
+ */
+static int build_huffman(inflate_huffman_t *h, const unsigned char *lengths, unsigned n)
+{
+	unsigned short offs[INFLATE_MAX_BITS + 1];
+	unsigned symbol, len, code, step;
+	int left = 1;
+
+	memset(h->count, 0, sizeof(h->count));
+	memset(h->fast, 0, sizeof(h->fast));
+
+	for (symbol = 0; symbol < n; symbol++)
+		h->count[lengths[symbol]]++;
+	h->count[0] = 0;
+
+	for (len = 1; len <= INFLATE_MAX_BITS; len++) {
+		left = (left << 1) - h->count[len];
+		if (left < 0)
+			return -1;
+	}
+
+	for (offs[1] = 0, len = 1; len < INFLATE_MAX_BITS; len++)
+		offs[len + 1] = offs[len] + h->count[len];
+
+	for (symbol = 0; symbol < n; symbol++)
+		if (lengths[symbol])
+			h->symbol[offs[lengths[symbol]]++] = (unsigned short) symbol;
+
+	/* the table entries of the short codes, each code fills all entries it is a prefix of */
+	for (code = 0, symbol = 0, len = 1; len <= INFLATE_FAST_BITS; len++, code <<= 1) {
+		unsigned it;
+
+		for (it = 0; it < h->count[len]; it++, code++, symbol++) {
+			for (step = reverse_bits(code, len); step < (1U << INFLATE_FAST_BITS); step += 1U << len)
+				h->fast[step] = (unsigned short) ((h->symbol[symbol] << 4) | len);
+		}
+	}
+
+	return 0;
+}
+
+/* returns the next symbol of 'h' or -1 if the input has no valid code */
+static int decode(inflate_state_t *s, const inflate_huffman_t *h)
+{
+	unsigned entry, len;
+	int code = 0, first = 0, index = 0, count;
+
+	need_bits(s, INFLATE_MAX_BITS);
+
+	if ((entry = h->fast[s->bitbuf & ((1U << INFLATE_FAST_BITS) - 1)])) {
+		drop_bits(s, entry & 0x0F);
+		return s->eof ? -1 : (int) (entry >> 4);
+	}
+
+	/* a longer code, see build_huffman() for the order of the symbols */
+	for (len = 1; len <= INFLATE_MAX_BITS; len++) {
+		code |= (int) get_bits(s, 1);
+		count = h->count[len];
+		if (code - count < first)
+			return s->eof ? -1 : h->symbol[index + (code - first)];
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+
+	return -1;
+}
+
+/* copies a stored block */
+static int inflate_stored(inflate_state_t *s)
+{
+	size_t len;
+
+	/* the block starts at a byte boundary, the whole bytes of the bit buffer go back to the input */
+	drop_bits(s, s->nbits & 7);
+	s->in -= s->nbits / 8;
+	s->bitbuf = 0;
+	s->nbits = 0;
+
+	if (s->in_end - s->in < 4)
+		return -1;
+
+	len = s->in[0] | (s->in[1] << 8);
+	if ((size_t) (s->in[2] | (s->in[3] << 8)) != (len ^ 0xFFFF))
+		return -1;
+	s->in += 4;
+
+	if ((size_t) (s->in_end - s->in) < len || (size_t) (s->out_end - s->out_pos) < len)
+		return -1;
+
+	memcpy(s->out_pos, s->in, len);
+	s->out_pos += len;
+	s->in += len;
+
+	return 0;
+}
+
+/* decodes the literals and matches of a block up to the end-of-block code */
+static int inflate_codes(inflate_state_t *s, const inflate_huffman_t *litlen, const inflate_huffman_t *dist)
+{
+	static const unsigned short
+		len_base[29] = {
+			3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 },
+		dist_base[30] = {
+			1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+			257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const unsigned char
+		len_extra[29] = {
+			0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+			3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 },
+		dist_extra[30] = {
+			0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+			7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	size_t len, distance;
+	unsigned char *from;
+	int symbol;
+
+	for (;;) {
+		if ((symbol = decode(s, litlen)) < 0)
+			return -1;
+
+		if (symbol < 256) {
+			if (s->out_pos == s->out_end)
+				return -1;
+			*s->out_pos++ = (unsigned char) symbol;
+			continue;
+		}
+
+		if (symbol == 256)
+			return 0;
+
+		if ((symbol -= 257) >= 29)
+			return -1;
+		len = len_base[symbol] + get_bits(s, len_extra[symbol]);
+
+		if ((symbol = decode(s, dist)) < 0 || symbol >= 30)
+			return -1;
+		distance = dist_base[symbol] + get_bits(s, dist_extra[symbol]);
+
+		if (s->eof || distance > (size_t) (s->out_pos - s->out) || len > (size_t) (s->out_end - s->out_pos))
+			return -1;
+
+		/* the source and the destination may overlap, the copy has to be byte by byte */
+		for (from = s->out_pos - distance; len; len--)
+			*s->out_pos++ = *from++;
+	}
+}
+
+/* decodes a block with the fixed codes of RFC 1951 3.2.6 */
+static int inflate_fixed(inflate_state_t *s)
+{
+	inflate_huffman_t litlen, dist;
+	unsigned char lengths[INFLATE_NLITLEN];
+
+	memset(lengths, 8, 144);
+	memset(lengths + 144, 9, 256 - 144);
+	memset(lengths + 256, 7, 280 - 256);
+	memset(lengths + 280, 8, INFLATE_NLITLEN - 280);
+	build_huffman(&litlen, lengths, INFLATE_NLITLEN);
+
+	memset(lengths, 5, INFLATE_NDIST);
+	build_huffman(&dist, lengths, INFLATE_NDIST);
+
+	return inflate_codes(s, &litlen, &dist);
+}
+
+/* decodes a block with the codes described at its start */
+static int inflate_dynamic(inflate_state_t *s)
+{
+	static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	inflate_huffman_t litlen, dist;
+	unsigned char lengths[INFLATE_NLITLEN + INFLATE_NDIST];
+	unsigned nlen, ndist, ncode, it, repeat;
+	int symbol, len;
+
+	nlen = get_bits(s, 5) + 257;
+	ndist = get_bits(s, 5) + 1;
+	ncode = get_bits(s, 4) + 4;
+
+	if (nlen > 286 || ndist > INFLATE_NDIST)
+		return -1;
+
+	/* the code lengths of the code lengths */
+	memset(lengths, 0, 19);
+	for (it = 0; it < ncode; it++)
+		lengths[order[it]] = (unsigned char) get_bits(s, 3);
+
+	if (s->eof || build_huffman(&litlen, lengths, 19))
+		return -1;
+
+	/* the code lengths of both codes, a repeat may cross from one to the other */
+	for (it = 0; it < nlen + ndist;) {
+		if ((symbol = decode(s, &litlen)) < 0)
+			return -1;
+
+		if (symbol < 16) {
+			lengths[it++] = (unsigned char) symbol;
+			continue;
+		}
+
+		if (symbol == 16) {
+			if (!it)
+				return -1;
+			len = lengths[it - 1];
+			repeat = 3 + get_bits(s, 2);
+		} else {
+			len = 0;
+			repeat = symbol == 17 ? 3 + get_bits(s, 3) : 11 + get_bits(s, 7);
+		}
+
+		if (it + repeat > nlen + ndist)
+			return -1;
+
+		while (repeat--)
+			lengths[it++] = (unsigned char) len;
+	}
+
+	/* a block without end-of-block code can't end */
+	if (s->eof || !lengths[256])
+		return -1;
+
+	if (build_huffman(&litlen, lengths, nlen) || build_huffman(&dist, lengths + nlen, ndist))
+		return -1;
+
+	return inflate_codes(s, &litlen, &dist);
+}
+
+/*
+ * Decodes the raw DEFLATE stream of 'in_size' bytes at 'in' into the 'out_size' bytes at 'out'.
+ * Returns 0 or -1 if the input is not a complete stream of exactly 'out_size' bytes.
+ */
+
+/* prototype to skip warning with -Wmissing-prototypes */
+int psl_inflate(unsigned char *out, size_t out_size, const unsigned char *in, size_t in_size);
+
+int psl_inflate(unsigned char *out, size_t out_size, const unsigned char *in, size_t in_size)
+{
+	inflate_state_t s;
+	unsigned last, type;
+	int rc;
+
+	memset(&s, 0, sizeof(s));
+	s.in = in;
+	s.in_end = in + in_size;
+	s.out = s.out_pos = out;
+	s.out_end = out + out_size;
+
+	do {
+		last = get_bits(&s, 1);
+		type = get_bits(&s, 2);
+
+		if (s.eof)
+			return -1;
+
+		if (type == 0)
+			rc = inflate_stored(&s);
+		else if (type == 1)
+			rc = inflate_fixed(&s);
+		else if (type == 2)
+			rc = inflate_dynamic(&s);
+		else
+			rc = -1;
+
+		if (rc || s.eof)
+			return -1;
+	} while (!last);
+
+	return s.out_pos == s.out_end ? 0 : -1;
+}
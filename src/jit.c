@@ -0,0 +1,573 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of libpsl.
+ *
+ * The JIT engine (psl_load_ex() with PSL_ENGINE_JIT, libpsl configured with -Djit=true).
+ *
+ * The rule strings of another engine are compiled into x86-64 machine code that walks
+ * a radix trie of the reversed strings: each node checks for the end of the key, loads
+ * the next byte (from the end) and jumps to its child by a chain of compares or a jump table.
+ * The bytes of a path without branches are compared up to eight at a time with immediates.
+ *
+ * The code is written into an anonymous mapping that is made executable by mprotect()
+ * after writing, so it is never writable and executable at the same time. If that fails
+ * (e.g. by a W^X policy), on other CPUs or without -Djit=true, building fails and
+ * psl_load_ex() keeps the interpreting engine it loaded the rules with.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined ENABLE_JIT && defined HAVE_MMAP && defined __x86_64__ && !defined _WIN32
+# define JIT_X86_64 1
+# include <sys/mman.h>
+# if !defined MAP_ANONYMOUS && defined MAP_ANON
+#  define MAP_ANONYMOUS MAP_ANON
+# endif
+#endif
+
+#include "engine.h"
+
+#define JIT_MAX_KEY 255 /* longer rule strings are ignored */
+#define JIT_PAYLOAD_SIZE 4
+#define JIT_MAX_CHAIN 6 /* up to this number of children are selected by a chain of compares */
+
+/* the compiled code, called with the start and the end of the key, returns the value of the rule or -1 */
+typedef int (*jit_func_t)(const char *key, const char *end);
+
+/* a rule string, kept for the foreach function */
+typedef struct {
+	const char
+		*s;
+	size_t
+		offset, /* of 's' in the pool, while the pool grows */
+		len;
+	int
+		value; /* the flags | (extended flags | (rule ID + 1) << 6) with payloads */
+} jit_key_t;
+
+typedef struct {
+	void
+		*code; /* the executable mapping */
+	size_t
+		code_size;
+	jit_func_t
+		func;
+	jit_key_t
+		*keys;
+	char
+		*pool;
+	size_t
+		nkeys,
+		pool_size;
+	unsigned
+		payload : 1; /* 1: the rule strings have rule IDs */
+} psl_jit_t;
+
+/* returns the value of the rule string 'key' or -1 if there is no such rule */
+static int jit_find(const psl_jit_t *j, const char *key, size_t len, int nocase)
+{
+	char buf[256], *lower;
+	size_t it;
+	int value;
+
+	if (!nocase || !len)
+		return j->func(key, key + len);
+
+	if (len < sizeof(buf))
+		lower = buf;
+	else if (!(lower = malloc(len + 1)))
+		return -1;
+
+	for (it = 0; it < len; it++)
+		lower[it] = key[it] >= 'A' && key[it] <= 'Z' ? (char) (key[it] | 0x20) : key[it];
+
+	value = j->func(lower, lower + len);
+
+	if (lower != buf)
+		free(lower);
+
+	return value;
+}
+
+static int jit_engine_lookup(const void *data, const char *key, size_t len, int is_ascii, int nocase)
+{
+	int value;
+
+	(void) is_ascii;
+
+	if ((value = jit_find((const psl_jit_t *) data, key, len, nocase)) < 0)
+		return -1;
+
+	return value & 0x0F;
+}
+
+static int jit_engine_rule_id(const void *data, const char *key, size_t len)
+{
+	const psl_jit_t *j = (const psl_jit_t *) data;
+	int value;
+
+	if (!j->payload || (value = jit_find(j, key, len, 0)) < 0)
+		return -1;
+
+	return (value >> 6) - 1;
+}
+
+static int jit_engine_foreach(const void *data, psl_rule_callback_t callback, void *user_data)
+{
+	const psl_jit_t *j = (const psl_jit_t *) data;
+	size_t it;
+	int rc;
+
+	for (it = 0; it < j->nkeys; it++) {
+		const jit_key_t *key = &j->keys[it];
+		unsigned char payload[JIT_PAYLOAD_SIZE];
+		int id = (key->value >> 6) - 1;
+
+		payload[0] = (unsigned char) (key->value & 0x3F);
+		payload[1] = (unsigned char) (id >> 16);
+		payload[2] = (unsigned char) (id >> 8);
+		payload[3] = (unsigned char) id;
+
+		if ((rc = callback(key->s, key->len, key->value & 0x0F, j->payload ? payload : NULL, user_data)))
+			return rc;
+	}
+
+	return 0;
+}
+
+static size_t jit_engine_memory_usage(const void *data)
+{
+	const psl_jit_t *j = (const psl_jit_t *) data;
+
+	return sizeof(psl_jit_t) + j->code_size + j->nkeys * sizeof(jit_key_t) + j->pool_size;
+}
+
+static void jit_engine_free(void *data)
+{
+	psl_jit_t *j = (psl_jit_t *) data;
+
+#ifdef JIT_X86_64
+	if (j->code)
+		munmap(j->code, j->code_size);
+#endif
+	free(j->keys);
+	free(j->pool);
+	free(j);
+}
+
+#ifdef JIT_X86_64
+typedef struct {
+	jit_key_t
+		*keys;
+	char
+		*pool;
+	size_t
+		nkeys,
+		max_keys,
+		pool_size,
+		max_pool;
+	int
+		payload; /* 1: each rule string has a payload */
+	unsigned char
+		*code, /* the machine code, copied into the executable mapping when done */
+		*bytes; /* the bytes of the children for each depth, 256 each */
+	size_t
+		code_size,
+		max_code,
+		*start, /* the first key of each child for each depth, 257 each */
+		*fixup; /* the position of the jump to each child for each depth, 256 each */
+	long
+		*base; /* the position the jump to each child is relative to, 256 each */
+} jit_builder_t;
+
+/* callback for the foreach function of an engine */
+static int jit_keys_add(const char *rule, size_t len, int flags, const unsigned char *payload, void *data)
+{
+	jit_builder_t *b = (jit_builder_t *) data;
+	jit_key_t *key;
+	void *p;
+
+	if (len > JIT_MAX_KEY)
+		return 0;
+
+	if (b->nkeys >= b->max_keys) {
+		if (!(p = realloc(b->keys, (b->max_keys = b->max_keys ? b->max_keys * 2 : 8192) * sizeof(jit_key_t))))
+			return -1;
+		b->keys = p;
+	}
+
+	if (b->pool_size + len > b->max_pool) {
+		while (b->pool_size + len > b->max_pool)
+			b->max_pool = b->max_pool ? b->max_pool * 2 : 65536;
+		if (!(p = realloc(b->pool, b->max_pool)))
+			return -1;
+		b->pool = p;
+	}
+
+	key = &b->keys[b->nkeys++];
+	key->offset = b->pool_size;
+	key->len = len;
+
+	if (payload) {
+		key->value = (payload[0] & 0x30) | (flags & 0x0F)
+			| ((((payload[1] << 16) | (payload[2] << 8) | payload[3]) + 1) << 6);
+	} else {
+		key->value = flags & 0x0F;
+		b->payload = 0;
+	}
+
+	memcpy(b->pool + b->pool_size, rule, len);
+	b->pool_size += len;
+
+	return 0;
+}
+
+/* byte 'depth' of the reversed string of 'key' */
+static unsigned char jit_byte(const jit_key_t *key, size_t depth)
+{
+	return (unsigned char) key->s[key->len - 1 - depth];
+}
+
+/* compares the reversed strings */
+static int jit_compare_key(const void *p1, const void *p2)
+{
+	const jit_key_t *k1 = (const jit_key_t *) p1, *k2 = (const jit_key_t *) p2;
+	size_t it, len = k1->len < k2->len ? k1->len : k2->len;
+
+	for (it = 0; it < len; it++) {
+		unsigned char c1 = jit_byte(k1, it), c2 = jit_byte(k2, it);
+
+		if (c1 != c2)
+			return c1 < c2 ? -1 : 1;
+	}
+
+	return k1->len < k2->len ? -1 : k1->len > k2->len;
+}
+
+/* makes sure that 'n' more bytes of code fit */
+static int jit_reserve(jit_builder_t *b, size_t n)
+{
+	void *p;
+
+	if (b->code_size + n <= b->max_code)
+		return 0;
+
+	while (b->code_size + n > b->max_code)
+		b->max_code = b->max_code ? b->max_code * 2 : 65536;
+
+	if (!(p = realloc(b->code, b->max_code)))
+		return -1;
+
+	b->code = p;
+	return 0;
+}
+
+static void jit_emit(jit_builder_t *b, const char *bytes, size_t n)
+{
+	memcpy(b->code + b->code_size, bytes, n);
+	b->code_size += n;
+}
+
+static void jit_put32(jit_builder_t *b, size_t pos, long value)
+{
+	unsigned long v = (unsigned long) value;
+
+	b->code[pos] = (unsigned char) v;
+	b->code[pos + 1] = (unsigned char) (v >> 8);
+	b->code[pos + 2] = (unsigned char) (v >> 16);
+	b->code[pos + 3] = (unsigned char) (v >> 24);
+}
+
+static void jit_emit32(jit_builder_t *b, long value)
+{
+	jit_put32(b, b->code_size, value);
+	b->code_size += 4;
+}
+
+/* emits a jump with a 32-bit displacement ('opcode' of one or two bytes) to the failure code at 0 */
+static void jit_emit_fail(jit_builder_t *b, const char *opcode, size_t n)
+{
+	jit_emit(b, opcode, n);
+	jit_emit32(b, -(long) (b->code_size + 4));
+}
+
+/*
+ * Compiles the keys 'lo' to 'hi', which have the same first 'depth' bytes (reversed).
+ * At entry of the code, rdi is the start of the key and rsi the end of its unmatched part.
+ */
+static int jit_build_node(jit_builder_t *b, size_t lo, size_t hi, size_t depth)
+{
+	unsigned char *bytes = b->bytes + depth * 256;
+	size_t *start = b->start + depth * 257, *fixup = b->fixup + depth * 256, it, nchildren = 0;
+	long *base = b->base + depth * 256;
+	int value = -1;
+
+	/* the keys are sorted, so the ending ones come first and the ones with the same next byte are adjacent */
+	for (; lo < hi && b->keys[lo].len == depth; lo++)
+		value = value < 0 ? b->keys[lo].value : value | (b->keys[lo].value & 0x0F); /* duplicates merge their flags */
+
+	for (it = lo; it < hi; it++) {
+		unsigned char c = jit_byte(&b->keys[it], depth);
+
+		if (!nchildren || bytes[nchildren - 1] != c) {
+			bytes[nchildren] = c;
+			start[nchildren++] = it;
+		}
+	}
+	start[nchildren] = hi;
+
+	if (jit_reserve(b, 64 + 1024))
+		return -1;
+
+	/* cmp rsi, rdi */
+	jit_emit(b, "\x48\x39\xFE", 3);
+
+	if (value >= 0) {
+		/* jne +6; mov eax, value; ret */
+		jit_emit(b, "\x75\x06\xB8", 3);
+		jit_emit32(b, value);
+		jit_emit(b, "\xC3", 1);
+	} else {
+		/* je fail */
+		jit_emit_fail(b, "\x0F\x84", 2);
+	}
+
+	if (!nchildren) {
+		/* jmp fail */
+		jit_emit_fail(b, "\xE9", 1);
+		return 0;
+	}
+
+	/* movzx eax, byte [rsi - 1]; dec rsi */
+	jit_emit(b, "\x0F\xB6\x46\xFF\x48\xFF\xCE", 7);
+
+	if (nchildren <= JIT_MAX_CHAIN) {
+		for (it = 0; it < nchildren; it++) {
+			/* cmp al, byte; je child */
+			jit_emit(b, "\x3C", 1);
+			jit_emit(b, (const char *) &bytes[it], 1);
+			jit_emit(b, "\x0F\x84", 2);
+			fixup[it] = b->code_size;
+			base[it] = (long) b->code_size + 4;
+			jit_emit32(b, 0);
+		}
+
+		/* jmp fail */
+		jit_emit_fail(b, "\xE9", 1);
+	} else {
+		unsigned first = bytes[0], range = bytes[nchildren - 1] - first, c;
+		size_t table;
+
+		/* sub eax, first; cmp eax, range; ja fail */
+		jit_emit(b, "\x2D", 1);
+		jit_emit32(b, (long) first);
+		jit_emit(b, "\x3D", 1);
+		jit_emit32(b, (long) range);
+		jit_emit_fail(b, "\x0F\x87", 2);
+
+		/* lea rcx, [rip + table]; movsxd rax, dword [rcx + rax * 4]; add rax, rcx; jmp rax */
+		jit_emit(b, "\x48\x8D\x0D", 3);
+		jit_emit32(b, 9);
+		jit_emit(b, "\x48\x63\x04\x81\x48\x01\xC8\xFF\xE0", 9);
+
+		/* the table of the 32-bit offsets of the children relative to the table, the missing ones fail */
+		table = b->code_size;
+		for (c = 0, it = 0; c <= range; c++) {
+			if (bytes[it] == first + c) {
+				fixup[it] = b->code_size;
+				base[it] = (long) table;
+				it++;
+			}
+			jit_emit32(b, -(long) table);
+		}
+	}
+
+	for (it = 0; it < nchildren; it++) {
+		const jit_key_t *first = &b->keys[start[it]], *last = &b->keys[start[it + 1] - 1];
+		size_t end = depth + 1, n, done;
+
+		/* the bytes that all keys of the child have in common, no key may end before */
+		while (end < first->len && jit_byte(first, end) == jit_byte(last, end))
+			end++;
+
+		jit_put32(b, fixup[it], (long) b->code_size - base[it]);
+
+		if ((n = end - depth - 1)) {
+			if (jit_reserve(b, 64 + n * 4))
+				return -1;
+
+			/* mov rax, rsi; sub rax, rdi; cmp rax, n; jb fail */
+			jit_emit(b, "\x48\x89\xF0\x48\x29\xF8\x48\x3D", 8);
+			jit_emit32(b, (long) n);
+			jit_emit_fail(b, "\x0F\x82", 2);
+
+			/* compare with immediates, the bytes at rsi - 1 - i are byte depth + 1 + i of the reversed string */
+			for (done = 0; done < n;) {
+				size_t width = n - done >= 8 ? 8 : n - done >= 4 ? 4 : n - done >= 2 ? 2 : 1, m;
+				unsigned char imm[8];
+
+				for (m = 0; m < width; m++)
+					imm[m] = jit_byte(first, depth + 1 + done + width - 1 - m);
+
+				if (width == 8) {
+					/* mov rax, [rsi - done - 8]; mov rcx, imm64; cmp rax, rcx */
+					jit_emit(b, "\x48\x8B\x86", 3);
+					jit_emit32(b, -(long) (done + 8));
+					jit_emit(b, "\x48\xB9", 2);
+					jit_emit(b, (const char *) imm, 8);
+					jit_emit(b, "\x48\x39\xC8", 3);
+				} else if (width == 4) {
+					/* cmp dword [rsi - done - 4], imm32 */
+					jit_emit(b, "\x81\xBE", 2);
+					jit_emit32(b, -(long) (done + 4));
+					jit_emit(b, (const char *) imm, 4);
+				} else if (width == 2) {
+					/* cmp word [rsi - done - 2], imm16 */
+					jit_emit(b, "\x66\x81\xBE", 3);
+					jit_emit32(b, -(long) (done + 2));
+					jit_emit(b, (const char *) imm, 2);
+				} else {
+					/* cmp byte [rsi - done - 1], imm8 */
+					jit_emit(b, "\x80\xBE", 2);
+					jit_emit32(b, -(long) (done + 1));
+					jit_emit(b, (const char *) imm, 1);
+				}
+
+				/* jne fail */
+				jit_emit_fail(b, "\x0F\x85", 2);
+				done += width;
+			}
+
+			/* sub rsi, n */
+			jit_emit(b, "\x48\x81\xEE", 3);
+			jit_emit32(b, (long) n);
+		}
+
+		if (jit_build_node(b, start[it], start[it + 1], end))
+			return -1;
+	}
+
+	return 0;
+}
+
+static void *jit_engine_build(const psl_engine_t *engine, const void *data)
+{
+	jit_builder_t b;
+	psl_jit_t *j = NULL;
+	void *code = MAP_FAILED;
+	size_t it, entry;
+
+	memset(&b, 0, sizeof(b));
+	b.payload = 1;
+
+	if (engine->foreach(data, jit_keys_add, &b))
+		goto out;
+
+	for (it = 0; it < b.nkeys; it++)
+		b.keys[it].s = b.pool + b.keys[it].offset;
+
+	qsort(b.keys, b.nkeys, sizeof(jit_key_t), jit_compare_key);
+
+	if (!(b.bytes = malloc((JIT_MAX_KEY + 1) * 256))
+		|| !(b.start = malloc((JIT_MAX_KEY + 1) * 257 * sizeof(size_t)))
+		|| !(b.fixup = malloc((JIT_MAX_KEY + 1) * 256 * sizeof(size_t)))
+		|| !(b.base = malloc((JIT_MAX_KEY + 1) * 256 * sizeof(long)))
+		|| jit_reserve(&b, 16))
+	{
+		goto out;
+	}
+
+	/* the failure code at 0: mov eax, -1; ret, padded with int3 up to the entry */
+	jit_emit(&b, "\xB8\xFF\xFF\xFF\xFF\xC3\xCC\xCC\xCC\xCC\xCC\xCC\xCC\xCC\xCC\xCC", 16);
+	entry = b.code_size;
+
+	if (jit_build_node(&b, 0, b.nkeys, 0))
+		goto out;
+
+	/* the code is never writable and executable at the same time */
+	if ((code = mmap(NULL, b.code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+		goto out;
+
+	memcpy(code, b.code, b.code_size);
+
+	if (mprotect(code, b.code_size, PROT_READ | PROT_EXEC))
+		goto out;
+
+	if (!(j = calloc(1, sizeof(psl_jit_t))))
+		goto out;
+
+	j->code = code;
+	j->code_size = b.code_size;
+	code = MAP_FAILED;
+	/* ISO C has no conversion of object pointers into function pointers */
+	{
+		unsigned char *func = (unsigned char *) j->code + entry;
+		memcpy(&j->func, &func, sizeof(j->func));
+	}
+
+	j->keys = b.keys;
+	j->nkeys = b.nkeys;
+	j->pool = b.pool;
+	j->pool_size = b.pool_size;
+	j->payload = b.payload && b.nkeys;
+	b.keys = NULL;
+	b.pool = NULL;
+
+out:
+	if (code != MAP_FAILED)
+		munmap(code, b.code_size);
+	free(b.base);
+	free(b.fixup);
+	free(b.start);
+	free(b.bytes);
+	free(b.code);
+	free(b.pool);
+	free(b.keys);
+
+	return j;
+}
+#else
+static void *jit_engine_build(const psl_engine_t *engine, const void *data)
+{
+	(void) engine;
+	(void) data;
+
+	return NULL; /* not supported, the interpreting engine is kept */
+}
+#endif
+
+const psl_engine_t psl_jit_engine = {
+	"jit",
+	jit_engine_lookup,
+	jit_engine_rule_id,
+	jit_engine_foreach,
+	jit_engine_memory_usage,
+	jit_engine_free,
+	jit_engine_build,
+	NULL, /* built at load time */
+	NULL
+};
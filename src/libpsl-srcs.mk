@@ -1 +1 @@
-LIBPSL_SRCS = psl.c lookup_string_in_fixed_set.c
\ No newline at end of file
+LIBPSL_SRCS = psl.c lookup_string_in_fixed_set.c scan.c scan.h engine.h mph.c darray.c louds.c jit.c inflate.c
\ No newline at end of file
@@ -5,10 +5,31 @@
  * Converted to C89 2015 by Tim Rühsen
  */
 
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
 #include <stddef.h>
+#include <stdlib.h>
+
+#if !defined(ENABLE_SIMD)
+/* vector nodes are searched byte by byte (./configure --disable-simd, meson -Dsimd=false) */
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define VECTOR_SSE2 1
+#  include <emmintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  endif
+#elif defined(__ARM_NEON) && defined(__GNUC__)
+#  define VECTOR_NEON 1
+#  include <arm_neon.h>
+#endif
 
 #define CHECK_LT(a, b) if ((a) >= b) return 0
 
+/* The number of bytes of the characters of a vector node with |count| children */
+#define VECTOR_CHARS_SIZE(count) (((size_t) (count) + 15) & ~(size_t) 15)
+
 static const char multibyte_length_table[16] = {
 	0, 0, 0, 0,	 /* 0x00-0x3F */
 	0, 0, 0, 0,	 /* 0x40-0x7F */
@@ -53,10 +74,11 @@ static void NextPos(const unsigned char** pos,
 
 /*
  * Read next offset from pos.
+ * This version assumes a range check was already performed by the caller.
  * Returns true if an offset could be read, false otherwise.
  */
 
-static int GetNextOffset(const unsigned char** pos,
+static int GetNextOffsetUnchecked(const unsigned char** pos,
 	const unsigned char* end,
 	const unsigned char** offset)
 {
@@ -65,11 +87,6 @@ static int GetNextOffset(const unsigned char** pos,
 	if (*pos == end)
 		return 0;
 
-	/* When reading an offset the byte array must always contain at least
-	 * three more bytes to consume. First the offset to read, then a node
-	 * to skip over and finally a destination node. No object can be smaller
-	 * than one byte. */
-	CHECK_LT(*pos + 2, end);
 	switch (**pos & 0x60) {
 	case 0x60: /* Read three byte offset */
 		*offset += (((*pos)[0] & 0x1F) << 16) | ((*pos)[1] << 8) | (*pos)[2];
@@ -91,6 +108,240 @@ static int GetNextOffset(const unsigned char** pos,
 	return 1;
 }
 
+/*
+ * Read next offset from pos.
+ * Returns true if an offset could be read, false otherwise.
+ */
+
+static int GetNextOffset(const unsigned char** pos,
+	const unsigned char* end,
+	const unsigned char** offset)
+{
+	if (*pos == end)
+		return 0;
+
+	/* When reading an offset the byte array must always contain at least
+	 * three more bytes to consume. First the offset to read, then a node
+	 * to skip over and finally a destination node. No object can be smaller
+	 * than one byte. */
+	CHECK_LT(*pos + 2, end);
+	return GetNextOffsetUnchecked(pos, end, offset);
+}
+
+/*
+ * Read the child with index |index| from the dense table or vector node
+ * at |table|, index 0 is the child that is just a return value, index
+ * i > 0 is the child for character lo + i - 1 (dense table) or the
+ * child i - 1 (vector node).
+ * Returns 1 and sets |offset| if there is such a child, 0 if not and
+ * -1 on malformed data.
+ */
+
+static int GetTableOffset(const unsigned char* table,
+	const unsigned char* end,
+	unsigned index,
+	const unsigned char** offset)
+{
+	const unsigned char* entry;
+	size_t distance;
+
+	if (table + 2 >= end)
+		return -1;
+	if (*table == 0x80)
+		entry = table + 2 + VECTOR_CHARS_SIZE(table[1]) + 3 * index;
+	else
+		entry = table + 3 + 3 * index;
+	if (entry + 2 >= end)
+		return -1;
+	distance = ((size_t) entry[0] << 16) | (entry[1] << 8) | entry[2];
+	if (!distance)
+		return 0;
+	*offset = table + distance;
+	return 1;
+}
+
+/*
+ * Get the number of entries of the dense table or vector node at |table|,
+ * see GetTableOffset().
+ */
+
+static unsigned GetTableEntries(const unsigned char* table)
+{
+	return *table == 0x80 ? table[1] + 1U : table[2] + 1U;
+}
+
+/*
+ * Get the index of the child with the first byte |c| in the |count|
+ * characters |chars| of a vector node, padded to VECTOR_CHARS_SIZE(count).
+ * Returns -1 if there is no such child.
+ */
+
+static int GetVectorIndex(const unsigned char* chars,
+	unsigned count,
+	unsigned char c)
+{
+	unsigned it;
+
+#if defined(VECTOR_SSE2)
+	__m128i needle = _mm_set1_epi8((char) c);
+
+	for (it = 0; it < count; it += 16) {
+		unsigned mask = (unsigned) _mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (chars + it)), needle));
+
+		if (mask) {
+#  ifdef _MSC_VER
+			unsigned long bit;
+			_BitScanForward(&bit, mask);
+#  else
+			unsigned bit = (unsigned) __builtin_ctz(mask);
+#  endif
+			/* a match in the padding (only for c == 0x00) is no match */
+			return it + bit < count ? (int) (it + bit) : -1;
+		}
+	}
+#elif defined(VECTOR_NEON)
+	uint8x16_t needle = vdupq_n_u8(c);
+
+	for (it = 0; it < count; it += 16) {
+		uint8x16_t eq = vceqq_u8(vld1q_u8(chars + it), needle);
+		/* 4 bits per byte of the compare result */
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+
+		if (mask) {
+			unsigned bit = (unsigned) __builtin_ctzll(mask) >> 2;
+			return it + bit < count ? (int) (it + bit) : -1;
+		}
+	}
+#else
+	for (it = 0; it < count; it++) {
+		if (chars[it] == c)
+			return (int) it;
+	}
+#endif
+
+	return -1;
+}
+
+/*
+ * Get the index of the only child in the dense table or vector node
+ * |table| that can match the first character in key, see GetTableOffset().
+ * Returns -1 if there is no such index.
+ */
+
+static int GetDenseIndex(const unsigned char* table,
+	const char* key,
+	const char* key_end,
+	const char* multibyte_start)
+{
+	unsigned c;
+	int index;
+
+	if (key == key_end)
+		return 0;
+
+	/* The byte that the label of the matching child starts with, see IsMatchUnchecked() */
+	if (multibyte_start)
+		c = (const unsigned char)*key ^ (multibyte_start == key ? 0x80 : 0xC0);
+	else if (GetMultibyteLength(*key))
+		c = 0x1F;
+	else
+		c = (const unsigned char)*key;
+
+	if (*table == 0x80) {
+		if ((index = GetVectorIndex(table + 2, table[1], (unsigned char) c)) < 0)
+			return -1;
+		return index + 1;
+	}
+
+	if (c < table[1] || c - table[1] >= table[2])
+		return -1;
+
+	return (int) (c - table[1] + 1);
+}
+
+/*
+ * Read the only child that can match the first character in key from the
+ * dense table or vector node at pos. These replace the offsets, so pos is
+ * set to end.
+ * Returns true if there is such a child, false otherwise.
+ */
+
+static int GetDenseChild(const unsigned char** pos,
+	const unsigned char* end,
+	const unsigned char** offset,
+	const char* key,
+	const char* key_end,
+	const char* multibyte_start)
+{
+	const unsigned char* table = *pos;
+	int index;
+
+	*pos = end;
+	CHECK_LT(table + 2, end);
+	if (*table == 0x80)
+		CHECK_LT(table + 1 + VECTOR_CHARS_SIZE(table[1]), end);
+
+	if ((index = GetDenseIndex(table, key, key_end, multibyte_start)) < 0)
+		return 0;
+
+	return GetTableOffset(table, end, (unsigned) index, offset) > 0;
+}
+
+/*
+ * Read the next child from pos, which is either a list of offsets, a
+ * dense table or a vector node.
+ * Returns true if a child could be read, false otherwise.
+ */
+
+static int GetNextChild(const unsigned char** pos,
+	const unsigned char* end,
+	const unsigned char** offset,
+	const char* key,
+	const char* key_end,
+	const char* multibyte_start)
+{
+	if (*pos != end && (**pos & 0x7F) == 0x00)
+		return GetDenseChild(pos, end, offset, key, key_end, multibyte_start);
+	return GetNextOffset(pos, end, offset);
+}
+
+/*
+ * Read the next child from pos, which is either a list of offsets, a
+ * dense table or a vector node.
+ * This version assumes the graph passed ValidateDafsa().
+ * Returns true if a child could be read, false otherwise.
+ */
+
+static int GetNextChildUnchecked(const unsigned char** pos,
+	const unsigned char* end,
+	const unsigned char** offset,
+	const char* key,
+	const char* key_end,
+	const char* multibyte_start)
+{
+	const unsigned char* table = *pos;
+	const unsigned char* entry;
+	int index;
+
+	if (table == end || (*table & 0x7F) != 0x00)
+		return GetNextOffsetUnchecked(pos, end, offset);
+
+	*pos = end;
+	if ((index = GetDenseIndex(table, key, key_end, multibyte_start)) < 0)
+		return 0;
+
+	if (*table == 0x80)
+		entry = table + 2 + VECTOR_CHARS_SIZE(table[1]) + 3 * index;
+	else
+		entry = table + 3 + 3 * index;
+	if (!(entry[0] | entry[1] | entry[2]))
+		return 0;
+
+	*offset = table + (((size_t) entry[0] << 16) | (entry[1] << 8) | entry[2]);
+	return 1;
+}
+
 /*
  * Check if byte at offset is last in label.
  */
@@ -163,19 +414,26 @@ static int IsEndCharMatch(const unsigned char* offset,
  * Returns true if a return value could be read, false otherwise.
  */
 
-static int GetReturnValue(const unsigned char* offset,
-	const unsigned char* end,
+static int GetReturnValueUnchecked(const unsigned char c,
 	const char* multibyte_start,
 	int* return_value)
 {
-	CHECK_LT(offset, end);
-	if (!multibyte_start && (*offset & 0xE0) == 0x80) {
-		*return_value = *offset & 0x0F;
+	if (!multibyte_start && (c & 0xF0) == 0x80) {
+		*return_value = c & 0x0F;
 		return 1;
 	}
 	return 0;
 }
 
+static int GetReturnValue(const unsigned char* offset,
+	const unsigned char* end,
+	const char* multibyte_start,
+	int* return_value)
+{
+	CHECK_LT(offset, end);
+	return GetReturnValueUnchecked(*offset, multibyte_start, return_value);
+}
+
 /*
  *  Looks up the string |key| with length |key_length| in a fixed set of
  * strings. The set of strings must be known at compile time. It is converted to
@@ -204,7 +462,7 @@ int LookupStringInFixedSet(const unsigned char* graph,
 	const char* key_end = key + key_length;
 	const char* multibyte_start = 0;
 
-	while (GetNextOffset(&pos, end, &offset)) {
+	while (GetNextChild(&pos, end, &offset, key, key_end, multibyte_start)) {
 		/*char <char>+ end_char offsets
 		 * char <char>+ return value
 		 * char end_char offsets
@@ -264,6 +522,448 @@ int LookupStringInFixedSet(const unsigned char* graph,
 	return -1; /* No match */
 }
 
+/*
+ * The traversal of LookupStringInValidFixedSet(). On a match, |return_pos|
+ * is set to the return value in the graph.
+ */
+static int LookupValidString(const unsigned char* graph,
+	size_t length,
+	const char* key,
+	size_t key_length,
+	const unsigned char** return_pos)
+{
+	const unsigned char* pos = graph;
+	const unsigned char* end = graph + length;
+	const unsigned char* offset = pos;
+	const char* key_end = key + key_length;
+	const char* multibyte_start = 0;
+
+	while (GetNextChildUnchecked(&pos, end, &offset, key, key_end, multibyte_start)) {
+		int did_consume = 0;
+
+		if (key != key_end && !(*offset & 0x80)) {
+			/* Leading <char> is not a match. Don't dive into this child */
+			if (!IsMatchUnchecked(*offset, key, multibyte_start))
+				continue;
+			did_consume = 1;
+			NextPos(&offset, &key, &multibyte_start);
+
+			/* Remove all remaining <char> nodes possible */
+			while (!(*offset & 0x80) && key != key_end) {
+				if (!IsMatchUnchecked(*offset, key, multibyte_start))
+					return -1;
+				NextPos(&offset, &key, &multibyte_start);
+			}
+		}
+		if (key == key_end) {
+			int return_value;
+
+			if (GetReturnValueUnchecked(*offset, multibyte_start, &return_value)) {
+				*return_pos = offset;
+				return return_value;
+			}
+			if (did_consume)
+				return -1;
+			continue;
+		}
+		if (!IsMatchUnchecked(*offset ^ 0x80, key, multibyte_start)) {
+			if (did_consume)
+				return -1; /* Unexpected */
+			continue;
+		}
+		NextPos(&offset, &key, &multibyte_start);
+		pos = offset; /* Dive into child */
+	}
+
+	return -1; /* No match */
+}
+
+/* prototype to skip warning with -Wmissing-prototypes */
+int LookupStringInValidFixedSet(const unsigned char*, size_t,const char*, size_t);
+
+/*
+ * Same as LookupStringInFixedSet(), but without the range checks on the
+ * graph. Only to be used for graphs that passed ValidateDafsa().
+ */
+int LookupStringInValidFixedSet(const unsigned char* graph,
+	size_t length,
+	const char* key,
+	size_t key_length)
+{
+	const unsigned char* return_pos;
+
+	return LookupValidString(graph, length, key, key_length, &return_pos);
+}
+
+/* prototype to skip warning with -Wmissing-prototypes */
+int LookupPayloadInValidFixedSet(const unsigned char*, size_t,const char*, size_t, const unsigned char**);
+
+/*
+ * Same as LookupStringInValidFixedSet(), but also sets |payload| to the
+ * bytes following the return value (see <payload> in psl-make-dafsa).
+ * Only to be used for graphs that passed ValidateDafsa() with the size
+ * of the payloads.
+ */
+int LookupPayloadInValidFixedSet(const unsigned char* graph,
+	size_t length,
+	const char* key,
+	size_t key_length,
+	const unsigned char** payload)
+{
+	const unsigned char* return_pos;
+	int return_value;
+
+	if ((return_value = LookupValidString(graph, length, key, key_length, &return_pos)) != -1)
+		*payload = return_pos + 1;
+
+	return return_value;
+}
+
+/*
+ * Returns |c| converted to lowercase if |fold| is set and |c| is an ASCII
+ * uppercase letter, else |c|.
+ */
+static unsigned char FoldCase(unsigned char c, int fold)
+{
+	return fold && c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+/*
+ * The traversal for 7-bit ASCII keys. Without multibyte characters in the
+ * key there is no multibyte state to keep, each character of the key is
+ * compared to a graph byte directly. If |fold| is set, the key characters
+ * are folded to lowercase while comparing.
+ */
+static int LookupAsciiString(const unsigned char* graph,
+	size_t length,
+	const char* key,
+	size_t key_length,
+	int fold)
+{
+	const unsigned char* pos = graph;
+	const unsigned char* end = graph + length;
+	const unsigned char* offset = pos;
+	const unsigned char* ukey = (const unsigned char*)key;
+	const unsigned char* key_end = ukey + key_length;
+	char c = 0;
+
+	for (;;) {
+		int did_consume = 0;
+
+		/* a dense table is indexed by the (folded) next character of the key */
+		if (ukey != key_end)
+			c = (char) FoldCase(*ukey, fold);
+		if (!GetNextChildUnchecked(&pos, end, &offset, &c, &c + (ukey != key_end), 0))
+			break;
+
+		if (ukey != key_end && !(*offset & 0x80)) {
+			/* Leading <char> is not a match. Don't dive into this child */
+			if (*offset != FoldCase(*ukey, fold))
+				continue;
+			did_consume = 1;
+			offset++, ukey++;
+
+			/* Remove all remaining <char> nodes possible */
+			while (!(*offset & 0x80) && ukey != key_end) {
+				if (*offset != FoldCase(*ukey, fold))
+					return -1;
+				offset++, ukey++;
+			}
+		}
+		if (ukey == key_end) {
+			if ((*offset & 0xF0) == 0x80)
+				return *offset & 0x0F;
+			if (did_consume)
+				return -1;
+			continue;
+		}
+		if ((*offset ^ 0x80) != FoldCase(*ukey, fold)) {
+			if (did_consume)
+				return -1; /* Unexpected */
+			continue;
+		}
+		offset++, ukey++;
+		pos = offset; /* Dive into child */
+	}
+
+	return -1; /* No match */
+}
+
+/* prototype to skip warning with -Wmissing-prototypes */
+int LookupAsciiStringInValidFixedSet(const unsigned char*, size_t,const char*, size_t);
+
+/*
+ * Same as LookupStringInValidFixedSet(), but only for 7-bit ASCII keys.
+ */
+int LookupAsciiStringInValidFixedSet(const unsigned char* graph,
+	size_t length,
+	const char* key,
+	size_t key_length)
+{
+	return LookupAsciiString(graph, length, key, key_length, 0);
+}
+
+/* prototype to skip warning with -Wmissing-prototypes */
+int LookupAsciiStringInValidFixedSetIgnoreCase(const unsigned char*, size_t,const char*, size_t);
+
+/*
+ * Same as LookupAsciiStringInValidFixedSet(), but ASCII letters in the key
+ * match regardless of their case. As the strings in the graph are lowercase,
+ * this is the same as looking up the lowercased key, without a copy.
+ */
+int LookupAsciiStringInValidFixedSetIgnoreCase(const unsigned char* graph,
+	size_t length,
+	const char* key,
+	size_t key_length)
+{
+	return LookupAsciiString(graph, length, key, key_length, 1);
+}
+
+/*
+ * Read the children at |pos| that a walk needs at the end of a label: the
+ * child that is just a return value, its value is stored in |value| (-1 if
+ * there is none), and if |want_dot| is set, the child that starts with '.'.
+ * Both are found with a single pass over the offsets.
+ * Returns the child that starts with '.' or NULL.
+ */
+
+static const unsigned char* GetLabelEndChildren(const unsigned char* pos,
+	const unsigned char* end,
+	int want_dot,
+	int* value)
+{
+	const unsigned char* table = pos;
+	const unsigned char* offset = pos;
+	const unsigned char* dot = NULL;
+	char c = '.';
+
+	*value = -1;
+
+	if (pos != end && (*pos & 0x7F) == 0x00) {
+		/* Dense table or vector node, index 0 is the return value */
+		if (GetNextChildUnchecked(&pos, end, &offset, &c, &c, 0))
+			*value = *offset & 0x0F;
+		pos = table;
+		if (want_dot && GetNextChildUnchecked(&pos, end, &offset, &c, &c + 1, 0))
+			dot = offset;
+		return dot;
+	}
+
+	while (GetNextOffsetUnchecked(&pos, end, &offset)) {
+		if ((*offset & 0xF0) == 0x80) {
+			*value = *offset & 0x0F;
+			if (!want_dot || dot)
+				break;
+		} else if ((*offset & 0x7F) == '.') {
+			dot = offset;
+			if (*value != -1)
+				break;
+		}
+	}
+
+	return dot;
+}
+
+/* prototype to skip warning with -Wmissing-prototypes */
+void LookupAsciiLabelsInValidFixedSet(const unsigned char*, size_t, const char*, size_t, int, int*, size_t);
+
+/*
+ * Looks up the suffixes of the 7-bit ASCII |key| that start at a label in a
+ * graph of strings with reversed labels (psl-make-dafsa --reverse-labels),
+ * with a single walk along the labels of |key| from right to left.
+ * Sets values[i] to the return value of the suffix made of the last i + 1
+ * labels of |key| or to -1 if it is not in the graph, for i < |nvalues|.
+ * If |fold| is set, ASCII letters in the key match regardless of their case.
+ * The graph must have passed ValidateDafsa().
+ */
+
+void LookupAsciiLabelsInValidFixedSet(const unsigned char* graph,
+	size_t length,
+	const char* key,
+	size_t key_length,
+	int fold,
+	int* values,
+	size_t nvalues)
+{
+	const unsigned char* pos = graph;
+	const unsigned char* end = graph + length;
+	const unsigned char* offset = NULL; /* the next byte of a label, NULL at the children at |pos| */
+	const unsigned char* ukey = (const unsigned char*)key;
+	const unsigned char* label_end = ukey + key_length;
+	const unsigned char* start;
+	const unsigned char* p;
+	size_t it = 0;
+	char c;
+
+	while (it < nvalues) {
+		for (start = label_end; start > ukey && start[-1] != '.'; start--)
+			;
+
+		for (p = start; p < label_end; p++) {
+			c = (char) FoldCase(*p, fold);
+
+			if (offset && *offset == (unsigned char) c) {
+				offset++;
+				continue;
+			}
+
+			if (!offset) {
+				/* Find the child whose label starts with |c|, offsets are relative */
+				offset = pos;
+				do {
+					if (!GetNextChildUnchecked(&pos, end, &offset, &c, &c + 1, 0))
+						goto done;
+				} while ((*offset & 0x7F) != (unsigned char) c || (*offset & 0xF0) == 0x80);
+			} else if ((*offset ^ 0x80) != (unsigned char) c || (*offset & 0xF0) == 0x80) {
+				goto done;
+			}
+
+			if (*offset & 0x80) {
+				/* <end_char>, dive into the children */
+				pos = offset + 1;
+				offset = NULL;
+			} else {
+				offset++;
+			}
+		}
+
+		/* The suffix walked so far ends here, the labels are separated by '.' in the graph as well */
+		if (offset) {
+			values[it++] = (*offset & 0xF0) == 0x80 ? *offset & 0x0F : -1;
+			if (start == ukey || it == nvalues || (*offset & 0x7F) != '.')
+				break;
+		} else {
+			offset = GetLabelEndChildren(pos, end, start != ukey && it + 1 < nvalues, &values[it]);
+			it++;
+			if (!offset)
+				break;
+		}
+
+		if (*offset & 0x80) {
+			pos = offset + 1;
+			offset = NULL;
+		} else {
+			offset++;
+		}
+		label_end = start - 1;
+	}
+
+done:
+	for (; it < nvalues; it++)
+		values[it] = -1;
+}
+
+/*
+ * Marks the children listed at |pos| (offsets, dense table or vector node)
+ * in |node|.
+ * Returns 0 if the list or a child is out of range, 1 otherwise.
+ */
+static int MarkChildren(const unsigned char* graph,
+	const unsigned char* pos,
+	const unsigned char* end,
+	unsigned char* node)
+{
+	const unsigned char* prev = pos;
+	const unsigned char* offset = pos;
+	unsigned it;
+	int rc;
+
+	if (pos >= end)
+		return 0;
+
+	if (*pos == 0x00) {
+		/* <lo> is at least 0x1F, the indexed characters are below 0x80 */
+		if (pos + 2 >= end || pos[1] < 0x1F || pos[1] + pos[2] > 0x80)
+			return 0;
+		for (it = 0; it <= pos[2]; it++) {
+			if ((rc = GetTableOffset(pos, end, it, &offset)) < 0 || (rc && offset >= end))
+				return 0;
+			if (rc)
+				node[offset - graph] = 1;
+		}
+		return 1;
+	}
+
+	if (*pos == 0x80) {
+		/* the characters are in the range of a dense table, each character has a child */
+		if (pos + 1 >= end || !pos[1] || (size_t) (end - pos) <= 2 + VECTOR_CHARS_SIZE(pos[1]))
+			return 0;
+		for (it = 0; it < pos[1]; it++) {
+			if (pos[2 + it] < 0x1F || pos[2 + it] >= 0x80)
+				return 0;
+		}
+		for (it = 0; it <= pos[1]; it++) {
+			if ((rc = GetTableOffset(pos, end, it, &offset)) < 0 || (rc && offset >= end) || (!rc && it))
+				return 0;
+			if (rc)
+				node[offset - graph] = 1;
+		}
+		return 1;
+	}
+
+	while (GetNextOffset(&pos, end, &offset)) {
+		/*
+		 * children always follow their parent, so the graph can't contain cycles.
+		 * A distance of 0 would be read as dense table (0x00) or vector node (0x80)
+		 * by the lookups, which read the list offset by offset.
+		 */
+		if (offset <= prev || offset >= end)
+			return 0;
+		node[offset - graph] = 1;
+		prev = offset;
+	}
+
+	/* GetNextOffset() also returns 0 if the list exceeds the graph */
+	return pos == end;
+}
+
+/* prototype to skip warning with -Wmissing-prototypes */
+int ValidateDafsa(const unsigned char *graph, size_t length, size_t payload_size);
+
+/*
+ * Checks the structure of the DAFSA |graph| with |length| bytes: all offsets
+ * point forward (no cycles) and into the graph, all labels are terminated by
+ * an <end_char> or a <return value> plus |payload_size| bytes within the
+ * graph and all characters are in the ranges described in psl-make-dafsa.
+ * Returns 1 if LookupStringInValidFixedSet() may be used for |graph|, 0 if not.
+ */
+int ValidateDafsa(const unsigned char *graph, size_t length, size_t payload_size)
+{
+	const unsigned char* end = graph + length;
+	const unsigned char* pos;
+	unsigned char* node; /* 1 if a node starts at this position */
+	size_t it;
+	int valid = 0;
+
+	if (!length || !(node = calloc(length, 1)))
+		return 0;
+
+	if (!MarkChildren(graph, graph, end, node))
+		goto out;
+
+	/* children have higher positions than their parents, so one pass visits all reachable nodes */
+	for (it = 1; it < length; it++) {
+		if (!node[it])
+			continue;
+
+		/* <char>* followed by either <end_char> <children> or <return value> */
+		for (pos = graph + it; pos < end && *pos >= 0x1F && *pos < 0x80; pos++)
+			;
+		if (pos == end || (*pos >= 0x90 && *pos < 0x9F) || *pos < 0x80)
+			goto out;
+		if (*pos < 0x90 && (size_t) (end - pos) <= payload_size)
+			goto out;
+		if (*pos >= 0x9F && !MarkChildren(graph, pos + 1, end, node))
+			goto out;
+	}
+
+	valid = 1;
+
+out:
+	free(node);
+	return valid;
+}
+
 /* prototype to skip warning with -Wmissing-prototypes */
 int GetUtfMode(const unsigned char *graph, size_t length);
 
@@ -271,3 +971,225 @@ int GetUtfMode(const unsigned char *graph, size_t length)
 {
 	return length > 0 && graph[length - 1] < 0x80;
 }
+
+static int GetMaxDots(const unsigned char* graph,
+	const unsigned char* node,
+	const unsigned char* end,
+	unsigned char* memo,
+	int depth);
+
+/*
+ * Returns the maximum of GetMaxDots() of the children at |pos| (offsets,
+ * dense table or vector node) or -1 on malformed data.
+ */
+static int GetMaxDotsOfChildren(const unsigned char* graph,
+	const unsigned char* pos,
+	const unsigned char* end,
+	unsigned char* memo,
+	int depth)
+{
+	const unsigned char* offset = pos;
+	int max = 0, n, rc;
+	unsigned it;
+
+	if (pos < end && (*pos & 0x7F) == 0x00) {
+		if (pos + 2 >= end)
+			return -1;
+		for (it = 0; it < GetTableEntries(pos); it++) {
+			if ((rc = GetTableOffset(pos, end, it, &offset)) < 0)
+				return -1;
+			if (!rc)
+				continue;
+			if ((n = GetMaxDots(graph, offset, end, memo, depth + 1)) < 0)
+				return -1;
+			if (n > max)
+				max = n;
+		}
+		return max;
+	}
+
+	while (GetNextOffset(&pos, end, &offset)) {
+		if ((n = GetMaxDots(graph, offset, end, memo, depth + 1)) < 0)
+			return -1;
+		if (n > max)
+			max = n;
+	}
+
+	return max;
+}
+
+/*
+ * Returns the maximum number of '.' found on any path starting at the
+ * node |node| or -1 on malformed data. |memo| caches the result per node
+ * (value + 1, 0 = not yet visited). Offsets always point forward, so the
+ * graph can't contain cycles, |depth| just limits the recursion on
+ * malformed data.
+ */
+static int GetMaxDots(const unsigned char* graph,
+	const unsigned char* node,
+	const unsigned char* end,
+	unsigned char* memo,
+	int depth)
+{
+	const unsigned char* pos;
+	int dots = 0, max;
+
+	if (node >= end)
+		return -1;
+	if (memo[node - graph])
+		return memo[node - graph] - 1;
+	if (depth > 256)
+		return -1;
+
+	/* <char>* followed by either <end_char> <offsets> or <return value> */
+	for (pos = node; pos < end && *pos < 0x80; pos++)
+		dots += *pos == '.';
+	if (pos == end)
+		return -1;
+
+	if (*pos > 0x8F) {
+		dots += (*pos & 0x7F) == '.';
+
+		if ((max = GetMaxDotsOfChildren(graph, pos + 1, end, memo, depth)) < 0)
+			return -1;
+		dots += max;
+	}
+
+	if (dots > 254)
+		return -1;
+
+	memo[node - graph] = (unsigned char) (dots + 1);
+	return dots;
+}
+
+/* prototype to skip warning with -Wmissing-prototypes */
+int GetMaxLabels(const unsigned char *graph, size_t length);
+
+/*
+ * Returns the maximum number of labels of the strings in the DAFSA
+ * or 0 if unknown (malformed data or out of memory).
+ */
+int GetMaxLabels(const unsigned char *graph, size_t length)
+{
+	unsigned char* memo;
+	int max;
+
+	if (!length || !(memo = calloc(length, 1)))
+		return 0;
+
+	max = GetMaxDotsOfChildren(graph, graph, graph + length, memo, -1);
+
+	free(memo);
+
+	return max + 1;
+}
+
+static int ForEachStringOfChildren(const unsigned char* pos,
+	const unsigned char* end,
+	char* key,
+	size_t key_length,
+	int multibyte,
+	int (*callback)(const char*, size_t, int, const unsigned char*, void*),
+	void* data);
+
+/*
+ * Appends the characters of the node |node| to |key| and calls |callback|
+ * for each string reachable from there. |multibyte| is the number of
+ * outstanding bytes of a multibyte sequence, -1 if the next byte is a
+ * leading byte.
+ */
+static int ForEachStringOfNode(const unsigned char* node,
+	const unsigned char* end,
+	char* key,
+	size_t key_length,
+	int multibyte,
+	int (*callback)(const char*, size_t, int, const unsigned char*, void*),
+	void* data)
+{
+	const unsigned char* pos;
+	unsigned char c;
+
+	for (pos = node; pos < end; pos++) {
+		if (*pos >= 0x80 && *pos <= 0x8F)
+			return callback(key, key_length, *pos & 0x0F, pos + 1, data);
+
+		c = *pos & 0x7F;
+		if (c == 0x1F && !multibyte) {
+			/* the next byte is the leading byte of a multibyte sequence */
+			multibyte = -1;
+		} else {
+			if (key_length >= 256)
+				return -1;
+			if (multibyte < 0) {
+				c ^= 0x80;
+				multibyte = GetMultibyteLength((char) c) - 1;
+			} else if (multibyte > 0) {
+				c ^= 0xC0;
+				multibyte--;
+			}
+			key[key_length++] = (char) c;
+		}
+
+		if (*pos & 0x80)
+			return ForEachStringOfChildren(pos + 1, end, key, key_length, multibyte, callback, data);
+	}
+
+	return -1;
+}
+
+/*
+ * Calls ForEachStringOfNode() for the children at |pos| (offsets, dense
+ * table or vector node).
+ */
+static int ForEachStringOfChildren(const unsigned char* pos,
+	const unsigned char* end,
+	char* key,
+	size_t key_length,
+	int multibyte,
+	int (*callback)(const char*, size_t, int, const unsigned char*, void*),
+	void* data)
+{
+	const unsigned char* offset = pos;
+	unsigned it;
+	int rc;
+
+	if (pos < end && (*pos & 0x7F) == 0x00) {
+		for (it = 0; it < GetTableEntries(pos); it++) {
+			if (GetTableOffset(pos, end, it, &offset) > 0
+				&& (rc = ForEachStringOfNode(offset, end, key, key_length, multibyte, callback, data)))
+				return rc;
+		}
+		return 0;
+	}
+
+	while (GetNextOffset(&pos, end, &offset)) {
+		if ((rc = ForEachStringOfNode(offset, end, key, key_length, multibyte, callback, data)))
+			return rc;
+	}
+
+	return 0;
+}
+
+/* prototype to skip warning with -Wmissing-prototypes */
+int ForEachStringInValidFixedSet(const unsigned char* graph,
+	size_t length,
+	int (*callback)(const char*, size_t, int, const unsigned char*, void*),
+	void* data);
+
+/*
+ * Calls |callback| with each string of the DAFSA |graph| with |length| bytes,
+ * its length, its return value and its payload (the bytes following the
+ * return value). The string is not NUL terminated.
+ * The graph must have passed ValidateDafsa().
+ * Returns 0 when all strings have been visited, the non-zero return value of
+ * |callback| that stopped the iteration or -1 if a string exceeds 256 bytes.
+ */
+int ForEachStringInValidFixedSet(const unsigned char* graph,
+	size_t length,
+	int (*callback)(const char*, size_t, int, const unsigned char*, void*),
+	void* data)
+{
+	char key[256];
+
+	return ForEachStringOfChildren(graph, graph + length, key, 0, 0, callback, data);
+}
@@ -0,0 +1,388 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of libpsl.
+ *
+ * The LOUDS trie engine (psl-make-dafsa --output-format=louds).
+ *
+ * A succinct trie of the reversed rule strings: the tree structure takes two bits
+ * per node (level-order unary degree sequence), each node a 6-bit label and a terminal bit.
+ * The file is used as it is, e.g. mapped read-only into memory. Just the small sampling
+ * tables for select (the position of the n-th 0 bit) and rank (the number of 1 bits
+ * up to a position) are built by open().
+ *
+ * The strings are reversed, so a lookup walks the domain from its end and passes
+ * each label boundary of the domain on its way, like the suffixes the PSL rules are about.
+ * The layout is described in psl-make-dafsa.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+
+#define LOUDS_HEADER_SIZE 76
+#define LOUDS_FLAG_UTF8    0x01
+#define LOUDS_FLAG_PAYLOAD 0x02
+#define LOUDS_PAYLOAD_SIZE 4
+#define LOUDS_SELECT_SAMPLE 64 /* zero bits per select sample */
+#define LOUDS_RANK_BLOCK 128 /* bits per rank sample */
+#define LOUDS_MAX_KEY 255
+
+typedef struct {
+	psl_blob_t
+		blob;
+	const unsigned char
+		*louds, /* 2n - 1 bits */
+		*terminal, /* n bits */
+		*labels, /* n - 1 codes of 6 bits */
+		*values, /* 4 bits or a payload for each terminal node */
+		*symbols; /* the byte of each label code */
+	unsigned
+		n, /* number of nodes */
+		nterminals,
+		*select0, /* the position of each LOUDS_SELECT_SAMPLE'th 0 bit of 'louds' */
+		*rank; /* the number of 1 bits of 'terminal' before each block of LOUDS_RANK_BLOCK bits */
+	unsigned char
+		code[256]; /* the label code of each byte, 0 if there is none */
+	unsigned
+		payload : 1;
+} psl_louds_t;
+
+static unsigned get32(const unsigned char *p)
+{
+	return ((unsigned) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static int get_bit(const unsigned char *bits, unsigned pos)
+{
+	return bits[pos >> 3] & (0x80 >> (pos & 7));
+}
+
+/* the number of 1 bits of each byte value */
+#define B2(n) n, n + 1, n + 1, n + 2
+#define B4(n) B2(n), B2(n + 1), B2(n + 1), B2(n + 2)
+#define B6(n) B4(n), B4(n + 1), B4(n + 1), B4(n + 2)
+static const unsigned char popcount8[256] = { B6(0), B6(1), B6(1), B6(2) };
+#undef B6
+#undef B4
+#undef B2
+
+static unsigned get_label(const psl_louds_t *l, unsigned node)
+{
+	unsigned pos = (node - 1) * 6; /* the root has no label */
+	const unsigned char *p = l->labels + (pos >> 3);
+
+	return (((p[0] << 8) | p[1]) >> (10 - (pos & 7))) & 0x3F;
+}
+
+/* returns the position of the 0 bit number 'i' (from 0) of 'louds', the caller checks i < n */
+static unsigned select0(const psl_louds_t *l, unsigned i)
+{
+	unsigned pos = l->select0[i / LOUDS_SELECT_SAMPLE], zeros;
+	const unsigned char *p = l->louds + (pos >> 3);
+	/* the number of the 0 bit counted from the start of the byte of the sampled 0 bit */
+	unsigned left = i % LOUDS_SELECT_SAMPLE + (8 - popcount8[*p | (0xFF >> (pos & 7))]);
+
+	while ((zeros = 8 - popcount8[*p]) <= left) {
+		left -= zeros;
+		p++;
+	}
+
+	for (pos = (unsigned) (p - l->louds) << 3;; pos++)
+		if (!get_bit(l->louds, pos) && !left--)
+			return pos;
+}
+
+/* returns the number of terminal nodes before 'node' */
+static unsigned rank_terminal(const psl_louds_t *l, unsigned node)
+{
+	unsigned count = l->rank[node / LOUDS_RANK_BLOCK], pos;
+
+	for (pos = node & ~(LOUDS_RANK_BLOCK - 1); pos + 8 <= node; pos += 8)
+		count += popcount8[l->terminal[pos >> 3]];
+
+	for (; pos < node; pos++)
+		if (get_bit(l->terminal, pos))
+			count++;
+
+	return count;
+}
+
+/* returns the position of the first child bit of 'node' in 'louds' and the number of the first child in 'first' */
+static unsigned children(const psl_louds_t *l, unsigned node, unsigned *first)
+{
+	unsigned pos = node ? select0(l, node - 1) + 1 : 0;
+
+	*first = pos - node + 1;
+	return pos;
+}
+
+/* returns the value index of the rule string 'key' or -1 if there is no such rule */
+static int louds_find(const psl_louds_t *l, const char *key, size_t len, int nocase)
+{
+	const unsigned char *k = (const unsigned char *) key + len;
+	unsigned node = 0, pos, child, code, label;
+
+	while (k > (const unsigned char *) key) {
+		unsigned c = *--k;
+
+		if (nocase && c >= 'A' && c <= 'Z')
+			c |= 0x20;
+
+		if (!(code = l->code[c]))
+			return -1;
+
+		/* the children are sorted by their label codes */
+		for (pos = children(l, node, &child); get_bit(l->louds, pos); pos++, child++) {
+			if ((label = get_label(l, child)) >= code)
+				break;
+		}
+
+		if (!get_bit(l->louds, pos) || label != code)
+			return -1;
+
+		node = child;
+	}
+
+	if (!get_bit(l->terminal, node))
+		return -1;
+
+	return (int) rank_terminal(l, node);
+}
+
+static int louds_flags(const psl_louds_t *l, unsigned index)
+{
+	if (l->payload)
+		return l->values[index * LOUDS_PAYLOAD_SIZE] & 0x0F;
+
+	return (l->values[index >> 1] >> (index & 1 ? 0 : 4)) & 0x0F;
+}
+
+static int louds_engine_lookup(const void *data, const char *key, size_t len, int is_ascii, int nocase)
+{
+	const psl_louds_t *l = (const psl_louds_t *) data;
+	int index;
+
+	(void) is_ascii;
+
+	if ((index = louds_find(l, key, len, nocase)) < 0)
+		return -1;
+
+	return louds_flags(l, (unsigned) index);
+}
+
+static int louds_engine_rule_id(const void *data, const char *key, size_t len)
+{
+	const psl_louds_t *l = (const psl_louds_t *) data;
+	const unsigned char *payload;
+	int index;
+
+	if (!l->payload || (index = louds_find(l, key, len, 0)) < 0)
+		return -1;
+
+	payload = l->values + index * LOUDS_PAYLOAD_SIZE;
+
+	return (payload[1] << 16) | (payload[2] << 8) | payload[3];
+}
+
+typedef struct {
+	const psl_louds_t
+		*l;
+	psl_rule_callback_t
+		callback;
+	void
+		*data;
+	unsigned char
+		buf[LOUDS_MAX_KEY]; /* the reversed string is built from the end */
+} louds_foreach_t;
+
+/* calls the callback for each rule string below 'node', 'depth' bytes of the string are at the end of f->buf */
+static int louds_foreach_node(louds_foreach_t *f, unsigned node, size_t depth)
+{
+	const psl_louds_t *l = f->l;
+	const unsigned char *key = f->buf + sizeof(f->buf) - depth;
+	unsigned pos, child;
+	int rc;
+
+	if (get_bit(l->terminal, node)) {
+		unsigned index = rank_terminal(l, node);
+
+		if ((rc = f->callback((const char *) key, depth, louds_flags(l, index),
+			l->payload ? l->values + index * LOUDS_PAYLOAD_SIZE : NULL, f->data)))
+		{
+			return rc;
+		}
+	}
+
+	for (pos = children(l, node, &child); get_bit(l->louds, pos); pos++, child++) {
+		if (depth >= sizeof(f->buf))
+			return -1;
+
+		f->buf[sizeof(f->buf) - depth - 1] = l->symbols[get_label(l, child)];
+
+		if ((rc = louds_foreach_node(f, child, depth + 1)))
+			return rc;
+	}
+
+	return 0;
+}
+
+static int louds_engine_foreach(const void *data, psl_rule_callback_t callback, void *user_data)
+{
+	louds_foreach_t f;
+
+	f.l = (const psl_louds_t *) data;
+	f.callback = callback;
+	f.data = user_data;
+
+	return louds_foreach_node(&f, 0, 0);
+}
+
+static size_t louds_engine_memory_usage(const void *data)
+{
+	const psl_louds_t *l = (const psl_louds_t *) data;
+
+	return sizeof(psl_louds_t) + l->blob.mem_size
+		+ ((l->n + LOUDS_SELECT_SAMPLE - 1) / LOUDS_SELECT_SAMPLE + 1) * sizeof(unsigned)
+		+ (l->n / LOUDS_RANK_BLOCK + 1) * sizeof(unsigned);
+}
+
+static void louds_engine_free(void *data)
+{
+	psl_louds_t *l = (psl_louds_t *) data;
+
+	psl_blob_free(&l->blob);
+	free(l->select0);
+	free(l->rank);
+	free(l);
+}
+
+static void *louds_engine_open(psl_blob_t *blob, psl_engine_info_t *info)
+{
+	const unsigned char *p = blob->data;
+	psl_louds_t *l;
+	size_t louds_size, terminal_size, labels_size, values_size;
+	unsigned pos, nbits, zeros, ones, it;
+
+	if (blob->size < LOUDS_HEADER_SIZE || p[0] > (LOUDS_FLAG_UTF8 | LOUDS_FLAG_PAYLOAD))
+		return NULL;
+
+	if (!(l = calloc(1, sizeof(psl_louds_t))))
+		return NULL;
+
+	l->payload = !!(p[0] & LOUDS_FLAG_PAYLOAD);
+	l->n = get32(p + 4);
+	l->nterminals = get32(p + 8);
+	l->symbols = p + 12;
+
+	/* check the sizes before multiplying them, a file has less than 4 bits per node */
+	if (!l->n || l->n > blob->size * 4 || l->nterminals > l->n)
+		goto fail;
+
+	nbits = 2 * l->n - 1;
+	louds_size = (nbits + 7) / 8;
+	terminal_size = (l->n + 7) / 8;
+	labels_size = ((size_t) (l->n - 1) * 6 + 7) / 8 + 1;
+	values_size = l->payload ? (size_t) l->nterminals * LOUDS_PAYLOAD_SIZE : (l->nterminals + 1) / 2;
+
+	if (blob->size != LOUDS_HEADER_SIZE + louds_size + terminal_size + labels_size + values_size)
+		goto fail;
+
+	l->louds = p + LOUDS_HEADER_SIZE;
+	l->terminal = l->louds + louds_size;
+	l->labels = l->terminal + terminal_size;
+	l->values = l->labels + labels_size;
+
+	for (it = 1; it < 64; it++)
+		if (l->symbols[it])
+			l->code[l->symbols[it]] = (unsigned char) it;
+
+	if (!(l->select0 = malloc(((l->n + LOUDS_SELECT_SAMPLE - 1) / LOUDS_SELECT_SAMPLE + 1) * sizeof(unsigned)))
+		|| !(l->rank = malloc((l->n / LOUDS_RANK_BLOCK + 1) * sizeof(unsigned))))
+	{
+		goto fail;
+	}
+
+	/*
+	 * A valid LOUDS has n 0 bits and n - 1 1 bits, ending with a 0 bit.
+	 * The children of each node have higher numbers than the node, so walks end.
+	 */
+	for (pos = zeros = ones = 0; pos < nbits; pos++) {
+		if (get_bit(l->louds, pos)) {
+			if (++ones <= zeros || ones >= l->n)
+				goto fail;
+		} else {
+			if (zeros % LOUDS_SELECT_SAMPLE == 0)
+				l->select0[zeros / LOUDS_SELECT_SAMPLE] = pos;
+			zeros++;
+		}
+	}
+
+	if (zeros != l->n || get_bit(l->louds, nbits - 1))
+		goto fail;
+
+	for (pos = ones = 0; pos < l->n; pos++) {
+		if (pos % LOUDS_RANK_BLOCK == 0)
+			l->rank[pos / LOUDS_RANK_BLOCK] = ones;
+		if (get_bit(l->terminal, pos))
+			ones++;
+	}
+
+	if (ones != l->nterminals)
+		goto fail;
+
+	for (it = 1; it < l->n; it++)
+		if (get_label(l, it) == 0)
+			goto fail;
+
+	l->blob = *blob;
+
+	if (info) {
+		info->utf8 = !!(p[0] & LOUDS_FLAG_UTF8);
+		info->payload = l->payload;
+		info->max_nlabels = p[1];
+	}
+
+	return l;
+
+fail:
+	free(l->select0);
+	free(l->rank);
+	free(l);
+	return NULL;
+}
+
+const psl_engine_t psl_louds_engine = {
+	"louds",
+	louds_engine_lookup,
+	louds_engine_rule_id,
+	louds_engine_foreach,
+	louds_engine_memory_usage,
+	louds_engine_free,
+	NULL, /* built by psl-make-dafsa */
+	louds_engine_open,
+	NULL
+};
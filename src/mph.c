@@ -0,0 +1,558 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of libpsl.
+ *
+ * The minimal perfect hash engine (psl-make-dafsa --output-format=mph).
+ *
+ * The rule strings are placed into a table with exactly one slot per string,
+ * using the hash and displace method: each string falls into a bucket of about
+ * four strings, and the 16-bit displacement of the bucket selects a free slot
+ * for each of its strings. A probe hashes the key once and reads the displacement
+ * and then the slot, which holds a 32-bit fingerprint of its string. Most keys
+ * that are no rule strings fail at the fingerprint, the others at the final
+ * comparison with the string in the pool.
+ *
+ * The layout is described in psl-make-dafsa. The table can also be built at
+ * runtime from the rule strings of another engine (psl_load_ex() with PSL_ENGINE_MPH).
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+
+#define MPH_HEADER_SIZE 20
+#define MPH_FLAG_UTF8    0x01
+#define MPH_FLAG_PAYLOAD 0x02
+#define MPH_PAYLOAD_SIZE 4
+#define MPH_MAX_POOL     0xFFFFFF /* 24-bit pool offsets */
+
+typedef struct {
+	psl_blob_t
+		blob;
+	const unsigned char
+		*disp, /* 16-bit displacement of each bucket */
+		*slots, /* fingerprint + (pool offset << 8 | flags) of each string */
+		*pool;
+	unsigned
+		n, /* number of strings and slots */
+		nbuckets,
+		seed,
+		pool_size;
+	unsigned
+		payload : 1;
+} psl_mph_t;
+
+static unsigned get16(const unsigned char *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static unsigned get32(const unsigned char *p)
+{
+	return ((unsigned) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void put32(unsigned char *p, unsigned x)
+{
+	p[0] = (unsigned char) (x >> 24);
+	p[1] = (unsigned char) (x >> 16);
+	p[2] = (unsigned char) (x >> 8);
+	p[3] = (unsigned char) x;
+}
+
+static unsigned char fold_case(unsigned char c, int nocase)
+{
+	return nocase && c >= 'A' && c <= 'Z' ? (unsigned char) (c | 0x20) : c;
+}
+
+/* the finalizer of MurmurHash3 */
+static unsigned fmix32(unsigned h)
+{
+	h ^= h >> 16;
+	h = (h * 0x85EBCA6BU) & 0xFFFFFFFFU;
+	h ^= h >> 13;
+	h = (h * 0xC2B2AE35U) & 0xFFFFFFFFU;
+	h ^= h >> 16;
+	return h;
+}
+
+/* FNV-1a with a seed */
+static unsigned mph_hash(unsigned seed, const char *key, size_t len, int nocase)
+{
+	const unsigned char *k = (const unsigned char *) key;
+	unsigned hash = 2166136261U ^ seed;
+
+	for (; len; len--, k++)
+		hash = ((hash ^ fold_case(*k, nocase)) * 16777619U) & 0xFFFFFFFFU;
+
+	return hash;
+}
+
+static unsigned mph_bucket(unsigned h, unsigned nbuckets)
+{
+	return fmix32(h) % nbuckets;
+}
+
+static unsigned mph_fingerprint(unsigned h)
+{
+	return fmix32(h ^ 0x5BD1E995U);
+}
+
+static unsigned mph_slot(unsigned h, unsigned d, unsigned n)
+{
+	return fmix32(((h ^ 0x7FEB352DU) + d * 0x9E3779B9U) & 0xFFFFFFFFU) % n;
+}
+
+/* returns the slot of 'key' or NULL if it is not in the table */
+static const unsigned char *mph_find(const psl_mph_t *m, const char *key, size_t len, int nocase)
+{
+	const unsigned char *slot, *s;
+	unsigned h;
+	size_t it;
+
+	if (!m->n)
+		return NULL;
+
+	h = mph_hash(m->seed, key, len, nocase);
+	slot = m->slots + 8 * mph_slot(h, get16(m->disp + 2 * mph_bucket(h, m->nbuckets)), m->n);
+
+	if (get32(slot) != mph_fingerprint(h))
+		return NULL;
+
+	/* open() made sure that the string is NUL terminated within the pool */
+	s = m->pool + (get32(slot + 4) >> 8);
+	for (it = 0; it < len; it++) {
+		if (s[it] != fold_case((unsigned char) key[it], nocase))
+			return NULL;
+	}
+
+	return s[len] ? NULL : slot;
+}
+
+static int mph_engine_lookup(const void *data, const char *key, size_t len, int is_ascii, int nocase)
+{
+	const unsigned char *slot;
+
+	(void) is_ascii;
+
+	if (!(slot = mph_find((const psl_mph_t *) data, key, len, nocase)))
+		return -1;
+
+	return slot[7] & 0x0F;
+}
+
+static int mph_engine_rule_id(const void *data, const char *key, size_t len)
+{
+	const psl_mph_t *m = (const psl_mph_t *) data;
+	const unsigned char *slot, *payload;
+
+	if (!m->payload || !(slot = mph_find(m, key, len, 0)))
+		return -1;
+
+	payload = m->pool + (get32(slot + 4) >> 8) - MPH_PAYLOAD_SIZE;
+
+	return (payload[1] << 16) | (payload[2] << 8) | payload[3];
+}
+
+static int mph_engine_foreach(const void *data, psl_rule_callback_t callback, void *user_data)
+{
+	const psl_mph_t *m = (const psl_mph_t *) data;
+	const unsigned char *slot, *s;
+	unsigned it;
+	int rc;
+
+	for (it = 0, slot = m->slots; it < m->n; it++, slot += 8) {
+		s = m->pool + (get32(slot + 4) >> 8);
+
+		if ((rc = callback((const char *) s, strlen((const char *) s), slot[7] & 0x0F,
+			m->payload ? s - MPH_PAYLOAD_SIZE : NULL, user_data)))
+		{
+			return rc;
+		}
+	}
+
+	return 0;
+}
+
+static size_t mph_engine_memory_usage(const void *data)
+{
+	const psl_mph_t *m = (const psl_mph_t *) data;
+
+	return sizeof(psl_mph_t) + m->blob.mem_size;
+}
+
+static void mph_engine_free(void *data)
+{
+	psl_mph_t *m = (psl_mph_t *) data;
+
+	psl_blob_free(&m->blob);
+	free(m);
+}
+
+static void *mph_engine_open(psl_blob_t *blob, psl_engine_info_t *info)
+{
+	const unsigned char *p = blob->data, *slot;
+	psl_mph_t *m;
+	size_t slots_offset, pool_offset;
+	unsigned it, value;
+
+	if (blob->size < MPH_HEADER_SIZE || p[0] > (MPH_FLAG_UTF8 | MPH_FLAG_PAYLOAD))
+		return NULL;
+
+	if (!(m = calloc(1, sizeof(psl_mph_t))))
+		return NULL;
+
+	m->payload = !!(p[0] & MPH_FLAG_PAYLOAD);
+	m->n = get32(p + 4);
+	m->nbuckets = get32(p + 8);
+	m->seed = get32(p + 12);
+	m->pool_size = get32(p + 16);
+
+	/* check the sizes before multiplying them */
+	if (!m->nbuckets || m->nbuckets > blob->size / 2 || m->n > blob->size / 8)
+		goto fail;
+
+	slots_offset = (MPH_HEADER_SIZE + 2 * (size_t) m->nbuckets + 7) & ~(size_t) 7;
+	pool_offset = slots_offset + 8 * (size_t) m->n;
+
+	if (pool_offset > blob->size || m->pool_size != blob->size - pool_offset || m->pool_size > MPH_MAX_POOL + 1)
+		goto fail;
+
+	m->disp = p + MPH_HEADER_SIZE;
+	m->slots = p + slots_offset;
+	m->pool = p + pool_offset;
+
+	/* each slot has to point to a NUL terminated string within the pool */
+	for (it = 0, slot = m->slots; it < m->n; it++, slot += 8) {
+		value = get32(slot + 4);
+
+		if ((value & 0xF0) || (value >> 8) >= m->pool_size || (m->payload && (value >> 8) < MPH_PAYLOAD_SIZE))
+			goto fail;
+
+		if (!memchr(m->pool + (value >> 8), 0, m->pool_size - (value >> 8)))
+			goto fail;
+	}
+
+	m->blob = *blob;
+
+	if (info) {
+		info->utf8 = !!(p[0] & MPH_FLAG_UTF8);
+		info->payload = m->payload;
+		info->max_nlabels = p[1];
+	}
+
+	return m;
+
+fail:
+	free(m);
+	return NULL;
+}
+
+/* a string collected by mph_engine_build() */
+typedef struct {
+	unsigned
+		offset, /* of the string in the pool */
+		hash;
+	unsigned char
+		flags,
+		payload[MPH_PAYLOAD_SIZE],
+		has_payload;
+} mph_key_t;
+
+typedef struct {
+	mph_key_t
+		*keys;
+	char
+		*pool;
+	size_t
+		nkeys,
+		max_keys,
+		pool_size,
+		max_pool;
+	int
+		max_nlabels;
+} mph_keys_t;
+
+/* callback for the foreach function of an engine */
+static int mph_keys_add(const char *rule, size_t len, int flags, const unsigned char *payload, void *data)
+{
+	mph_keys_t *k = (mph_keys_t *) data;
+	mph_key_t *key;
+	size_t it;
+	int nlabels;
+	void *p;
+
+	if (k->nkeys >= k->max_keys) {
+		if (!(p = realloc(k->keys, (k->max_keys = k->max_keys ? k->max_keys * 2 : 8192) * sizeof(mph_key_t))))
+			return -1;
+		k->keys = p;
+	}
+
+	if (k->pool_size + len + 1 > k->max_pool) {
+		while (k->pool_size + len + 1 > k->max_pool)
+			k->max_pool = k->max_pool ? k->max_pool * 2 : 65536;
+		if (!(p = realloc(k->pool, k->max_pool)))
+			return -1;
+		k->pool = p;
+	}
+
+	key = &k->keys[k->nkeys++];
+	key->offset = (unsigned) k->pool_size;
+	key->flags = (unsigned char) (flags & 0x0F);
+	if ((key->has_payload = !!payload))
+		memcpy(key->payload, payload, MPH_PAYLOAD_SIZE);
+
+	memcpy(k->pool + k->pool_size, rule, len);
+	k->pool[k->pool_size + len] = 0;
+	k->pool_size += len + 1;
+
+	for (nlabels = 1, it = 0; it < len; it++)
+		if (rule[it] == '.')
+			nlabels++;
+
+	if (nlabels > k->max_nlabels)
+		k->max_nlabels = nlabels;
+
+	return 0;
+}
+
+static int mph_compare_hash(const void *p1, const void *p2)
+{
+	unsigned h1 = *(const unsigned *) p1, h2 = *(const unsigned *) p2;
+
+	return h1 < h2 ? -1 : h1 > h2;
+}
+
+/* returns 0 if all keys have different hash values with 'seed' */
+static int mph_hash_keys(mph_keys_t *k, unsigned seed, unsigned *tmp)
+{
+	size_t it;
+
+	for (it = 0; it < k->nkeys; it++) {
+		const char *s = k->pool + k->keys[it].offset;
+
+		tmp[it] = k->keys[it].hash = mph_hash(seed, s, strlen(s), 0);
+	}
+
+	qsort(tmp, k->nkeys, sizeof(unsigned), mph_compare_hash);
+
+	for (it = 1; it < k->nkeys; it++)
+		if (tmp[it] == tmp[it - 1])
+			return -1;
+
+	return 0;
+}
+
+/*
+ * Finds the displacement of each bucket, the largest buckets first while most slots are free.
+ * 'order' gets the keys sorted by bucket, 'start' the index of the first key of each bucket in 'order'.
+ * Returns 0 on success.
+ */
+static int mph_place(const mph_keys_t *k, unsigned nbuckets, unsigned *disp, unsigned *order,
+	unsigned *start, unsigned *buckets, unsigned char *taken)
+{
+	unsigned n = (unsigned) k->nkeys, it, count, b, d, size, max_size = 0, *slots;
+	int rc = 0;
+
+	/* counting sort of the keys by bucket */
+	memset(start, 0, (nbuckets + 1) * sizeof(unsigned));
+	for (it = 0; it < n; it++)
+		start[mph_bucket(k->keys[it].hash, nbuckets) + 1]++;
+	for (b = 0; b < nbuckets; b++) {
+		if (start[b + 1] > max_size)
+			max_size = start[b + 1];
+		start[b + 1] += start[b];
+	}
+	memcpy(buckets, start, nbuckets * sizeof(unsigned));
+	for (it = 0; it < n; it++)
+		order[buckets[mph_bucket(k->keys[it].hash, nbuckets)]++] = it;
+
+	/* the buckets in order of decreasing size */
+	for (count = 0, size = max_size; size > 0; size--)
+		for (b = 0; b < nbuckets; b++)
+			if (start[b + 1] - start[b] == size)
+				buckets[count++] = b;
+
+	if (!(slots = malloc((max_size + 1) * sizeof(unsigned))))
+		return -1;
+
+	memset(taken, 0, n);
+	memset(disp, 0, nbuckets * sizeof(unsigned));
+
+	for (it = 0; it < count; it++) {
+		unsigned i, j, first, nkeys;
+
+		b = buckets[it];
+		first = start[b];
+		nkeys = start[b + 1] - first;
+
+		for (d = 0; d < 65536; d++) {
+			for (i = 0; i < nkeys; i++) {
+				slots[i] = mph_slot(k->keys[order[first + i]].hash, d, n);
+				if (taken[slots[i]])
+					break;
+				for (j = 0; j < i && slots[j] != slots[i]; j++);
+				if (j < i)
+					break;
+			}
+			if (i == nkeys)
+				break;
+		}
+
+		if (d == 65536) {
+			rc = -1;
+			break;
+		}
+
+		for (i = 0; i < nkeys; i++)
+			taken[slots[i]] = 1;
+		disp[b] = d;
+	}
+
+	free(slots);
+	return rc;
+}
+
+static void *mph_engine_build(const psl_engine_t *engine, const void *data)
+{
+	mph_keys_t k;
+	psl_blob_t blob;
+	unsigned *disp = NULL, *order = NULL, *start = NULL, *buckets = NULL, *tmp = NULL;
+	unsigned char *taken = NULL, *buf = NULL, *p;
+	unsigned n, nbuckets, seed, it;
+	size_t slots_offset, pool_offset, pool_size;
+	void *m = NULL;
+	int payload = 1;
+
+	memset(&k, 0, sizeof(k));
+
+	if (engine->foreach(data, mph_keys_add, &k))
+		goto out;
+
+	/* the 24-bit pool offsets also limit the number of strings */
+	if (k.nkeys > MPH_MAX_POOL)
+		goto out;
+
+	n = (unsigned) k.nkeys;
+	nbuckets = n > 3 ? (n + 3) / 4 : 1;
+
+	for (it = 0; it < n; it++)
+		if (!k.keys[it].has_payload)
+			payload = 0;
+
+	pool_size = k.pool_size + (payload ? n * MPH_PAYLOAD_SIZE : 0);
+	if (pool_size > MPH_MAX_POOL)
+		goto out;
+
+	if (!(disp = malloc(nbuckets * sizeof(unsigned)))
+		|| !(order = malloc((n + 1) * sizeof(unsigned)))
+		|| !(tmp = malloc((n + 1) * sizeof(unsigned)))
+		|| !(start = malloc((nbuckets + 1) * sizeof(unsigned)))
+		|| !(buckets = malloc(nbuckets * sizeof(unsigned)))
+		|| !(taken = malloc(n + 1)))
+	{
+		goto out;
+	}
+
+	/* the same search as psl-make-dafsa, the seeds from 0 upwards */
+	for (seed = 0; seed < 256; seed++) {
+		if (mph_hash_keys(&k, seed, tmp) == 0 && mph_place(&k, nbuckets, disp, order, start, buckets, taken) == 0)
+			break;
+	}
+
+	if (seed == 256)
+		goto out;
+
+	slots_offset = (MPH_HEADER_SIZE + 2 * (size_t) nbuckets + 7) & ~(size_t) 7;
+	pool_offset = slots_offset + 8 * (size_t) n;
+
+	if (!(buf = calloc(1, pool_offset + pool_size)))
+		goto out;
+
+	buf[0] = MPH_FLAG_UTF8 | (payload ? MPH_FLAG_PAYLOAD : 0);
+	buf[1] = (unsigned char) (k.max_nlabels > 255 ? 255 : k.max_nlabels);
+	put32(buf + 4, n);
+	put32(buf + 8, nbuckets);
+	put32(buf + 12, seed);
+	put32(buf + 16, (unsigned) pool_size);
+
+	for (it = 0; it < nbuckets; it++) {
+		buf[MPH_HEADER_SIZE + 2 * it] = (unsigned char) (disp[it] >> 8);
+		buf[MPH_HEADER_SIZE + 2 * it + 1] = (unsigned char) disp[it];
+	}
+
+	for (p = buf + pool_offset, it = 0; it < n; it++) {
+		const mph_key_t *key = &k.keys[it];
+		const char *s = k.pool + key->offset;
+		size_t len = strlen(s);
+		unsigned char *slot;
+
+		if (payload) {
+			memcpy(p, key->payload, MPH_PAYLOAD_SIZE);
+			p += MPH_PAYLOAD_SIZE;
+		}
+
+		slot = buf + slots_offset + 8 * mph_slot(key->hash, disp[mph_bucket(key->hash, nbuckets)], n);
+		put32(slot, mph_fingerprint(key->hash));
+		put32(slot + 4, ((unsigned) (p - buf - pool_offset) << 8) | key->flags);
+
+		memcpy(p, s, len + 1);
+		p += len + 1;
+	}
+
+	memset(&blob, 0, sizeof(blob));
+	blob.data = blob.mem = buf;
+	blob.size = blob.mem_size = pool_offset + pool_size;
+
+	if ((m = mph_engine_open(&blob, NULL)))
+		buf = NULL; /* owned by the engine data */
+
+out:
+	free(buf);
+	free(taken);
+	free(buckets);
+	free(start);
+	free(tmp);
+	free(order);
+	free(disp);
+	free(k.pool);
+	free(k.keys);
+
+	return m;
+}
+
+const psl_engine_t psl_mph_engine = {
+	"mph",
+	mph_engine_lookup,
+	mph_engine_rule_id,
+	mph_engine_foreach,
+	mph_engine_memory_usage,
+	mph_engine_free,
+	mph_engine_build,
+	mph_engine_open,
+	NULL
+};
@@ -41,13 +41,22 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
-#if defined(_WIN32) && (defined(WITH_LIBIDN2) || defined(WITH_LIBIDN))
+#if defined(_WIN32) && (defined(WITH_LIBIDN2) || defined(WITH_LIBIDN) || defined(WITH_NATIVE_IDNA))
 # ifndef WIN32_LEAN_AND_MEAN
 # define WIN32_LEAN_AND_MEAN
 # endif
 # include <windows.h> /* for GetACP() */
 #endif
 
+#if defined(_WIN32)
+# ifndef WIN32_LEAN_AND_MEAN
+# define WIN32_LEAN_AND_MEAN
+# endif
+# include <windows.h> /* for InitOnceExecuteOnce() and InterlockedIncrement() */
+#elif defined(ENABLE_BUILTIN) && defined(ENABLE_BUILTIN_COMPRESSED)
+# include <pthread.h> /* for pthread_once() */
+#endif
+
 #if defined(_MSC_VER) && ! defined(ssize_t)
 # include <basetsd.h>
 typedef SSIZE_T ssize_t;
@@ -65,10 +74,17 @@ typedef SSIZE_T ssize_t;
 # include <langinfo.h>
 #endif
 
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
+
 #ifdef _WIN32
 #	include <malloc.h>
 #endif
 
+#include "scan.h"
+#include "engine.h"
+
 #ifdef WITH_LIBICU
 #	include <unicode/uversion.h>
 #	include <unicode/ustring.h>
@@ -114,18 +130,22 @@ typedef SSIZE_T ssize_t;
 #define PRIV_PSL_FLAG_WILDCARD  (1<<1)
 #define PRIV_PSL_FLAG_ICANN     (1<<2) /* entry of ICANN section */
 #define PRIV_PSL_FLAG_PRIVATE   (1<<3) /* entry of PRIVATE section */
-#define PRIV_PSL_FLAG_PLAIN     (1<<4) /* just used for PSL syntax checking */
+#define PRIV_PSL_FLAG_PLAIN     (1<<4) /* explicit rule foo.bar, not just implied by *.foo.bar, see psl_apply_diff() */
 
 typedef struct {
 	char
 		label_buf[128];
 	const char *
 		label;
+	int
+		id; /* rule ID, see psl_suffix_rule_id() */
 	unsigned short
 		length;
 	unsigned char
 		nlabels, /* number of labels */
 		flags;
+	long
+		refs; /* number of vectors sharing this entry, see psl_apply_diff() */
 } psl_entry_t;
 
 /* stripped down version libmget vector routines */
@@ -139,24 +159,83 @@ typedef struct {
 		cur;     /* number of elements in use */
 } psl_vector_t;
 
-struct psl_ctx_st {
-	psl_vector_t
-		*suffixes;
+/*
+ * The TLDs of a PSL, each with the max. number of labels of a public suffix ending with it.
+ * Open addressing hash table, each slot is (pool offset << 8) | depth or 0 if empty.
+ */
+typedef struct {
+	unsigned
+		*slot;
 	unsigned char
-		*dafsa;
+		*pool; /* the NUL terminated TLDs */
 	size_t
-		dafsa_size;
-	int
-		nsuffixes,
-		nexceptions,
-		nwildcards;
+		nslots, /* power of 2, at least twice the number of TLDs */
+		ntlds,
+		nrules, /* number of rules added */
+		pool_size,
+		max_pool;
+} psl_tld_table_t;
+
+/*
+ * The rules of a PSL by their ID, as returned by psl_rule_by_id().
+ * Each entry is (pool offset << 8) | 0x80 | PSL_RULE_* flags or 0 if there is no rule with this ID.
+ */
+typedef struct {
+	unsigned
+		*entry;
+	char
+		*pool; /* the NUL terminated rules, with '!' or '*.' prefix */
+	size_t
+		nrules, /* highest ID + 1 */
+		max_rules,
+		nadded, /* number of strings added */
+		pool_size,
+		max_pool;
+} psl_rule_table_t;
+
+/* the <payload> of a DAFSA string (psl-make-dafsa --payload): extended flags + 24-bit rule ID */
+#define PAYLOAD_SIZE 4
+#define PAYLOAD_FLAG_PUNYCODE (1<<5) /* punycode variant of an international rule */
+
+/* the data of the DAFSA engine */
+typedef struct {
+	psl_blob_t
+		blob; /* the DAFSA without header, blob.mem is NULL for the builtin DAFSA */
+	unsigned
+		valid : 1, /* 1: DAFSA passed ValidateDafsa(), lookups can skip the range checks */
+		payload : 1, /* 1: each DAFSA string has a payload of PAYLOAD_SIZE bytes */
+		reversed : 1; /* 1: the labels of the strings are in reverse order (psl-make-dafsa --reverse-labels) */
+} psl_dafsa_t;
+
+struct psl_ctx_st {
+	const psl_engine_t
+		*engine;
+	void
+		*engine_data;
 	unsigned
 		utf8 : 1; /* 1: data contains UTF-8 + punycode encoded rules */
+	int
+		nsuffixes, /* -1 if unknown */
+		nexceptions,
+		nwildcards,
+		max_nlabels, /* max. number of labels of a rule, 0 if unknown */
+		sections; /* PRIV_PSL_FLAG_ICANN and/or PRIV_PSL_FLAG_PRIVATE to use just these rules, 0 for all */
+	psl_tld_table_t
+		tlds; /* no limits known if tlds.slot is NULL */
+	psl_rule_table_t
+		rules; /* no rule IDs if rules.entry is NULL */
+	const psl_ctx_t
+		*base; /* the context an overlay adds its rules to, NULL if none */
 };
 
 /* include the PSL data generated by psl-make-dafsa */
 #ifdef ENABLE_BUILTIN
 #include "suffixes_dafsa.h"
+#ifdef ENABLE_BUILTIN_COMPRESSED
+/* the TLD table, inflated from kDafsaCompressed with the DAFSA by builtin_inflate() */
+static const unsigned *_psl_tld_slots;
+static const unsigned char *_psl_tld_pool;
+#endif
 #else
 static const unsigned char kDafsa[] = "";
 static time_t _psl_file_time = 0;
@@ -165,6 +244,13 @@ static int _psl_nexceptions = 0;
 static int _psl_nwildcards = 0;
 static const char _psl_sha1_checksum[] = "";
 static const char _psl_filename[] = "";
+static const unsigned _psl_tld_slots[1];
+static const unsigned char _psl_tld_pool[1];
+#endif
+
+#ifdef WITH_NATIVE_IDNA
+/* include the Unicode tables generated by psl-make-idna-tables */
+#include "idna_tables.h"
 #endif
 
 /* references to these PSLs will result in lookups to built-in data */
@@ -194,6 +280,33 @@ static psl_vector_t *vector_alloc(int max, int (*cmp)(const psl_entry_t **, cons
 	return v;
 }
 
+/*
+ * The entries of a vector may be shared with the vectors of other contexts (see psl_apply_diff()),
+ * which may be free'd by other threads.
+ */
+static void entry_ref(psl_entry_t *e)
+{
+#if GCC_VERSION_AT_LEAST(4, 7) || defined(__clang__)
+	__atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED);
+#elif defined(_WIN32)
+	InterlockedIncrement(&e->refs);
+#else
+	e->refs++;
+#endif
+}
+
+/* returns 1 if 'e' is not shared any more and has to be free'd */
+static int entry_unref(psl_entry_t *e)
+{
+#if GCC_VERSION_AT_LEAST(4, 7) || defined(__clang__)
+	return __atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) == 0;
+#elif defined(_WIN32)
+	return InterlockedDecrement(&e->refs) == 0;
+#else
+	return --e->refs == 0;
+#endif
+}
+
 static void vector_free(psl_vector_t **v)
 {
 	if (v && *v) {
@@ -201,7 +314,8 @@ static void vector_free(psl_vector_t **v)
 			int it;
 
 			for (it = 0; it < (*v)->cur; it++)
-				free((*v)->entry[it]);
+				if (entry_unref((*v)->entry[it]))
+					free((*v)->entry[it]);
 
 			free((*v)->entry);
 		}
@@ -244,6 +358,7 @@ static int vector_add(psl_vector_t *v, const psl_entry_t *elem)
 			return -1;
 
 		memcpy(elemp, elem, sizeof(psl_entry_t));
+		((psl_entry_t *) elemp)->refs = 1;
 
 		if (v->max == v->cur) {
 			void *m = realloc(v->entry, (v->max *= 2) * sizeof(psl_entry_t *));
@@ -324,11 +439,18 @@ static char *psl_strdup(const char *s)
 	return strcpy(p, s);
 }
 
-#if !defined(WITH_LIBIDN) && !defined(WITH_LIBIDN2) && !defined(WITH_LIBICU)
+static int mem_is_ascii(const char *s, size_t n)
+{
+	return psl_scan_is_ascii(s, n);
+}
+
 /*
  * When configured without runtime IDNA support (./configure --disable-runtime), we need a pure ASCII
  * representation of non-ASCII characters in labels as found in UTF-8 domain names.
  * This is because the current DAFSA format used may only hold character values [21..127].
+ *
+ * The decoder is always needed, it converts ACE labels back to UTF-8 for psl_registrable_domain_unicode()
+ * and psl_unregistrable_domain_unicode().
  *
   Code copied from http://www.nicemice.net/idn/punycode-spec.gz on
   2011-01-04 with SHA-1 a966a8017f6be579d74a50a226accc7607c40133
@@ -382,13 +504,6 @@ enum {
 	initial_bias = 72, initial_n = 0x80, delimiter = 0x2D
 };
 
-static char encode_digit(punycode_uint d)
-{
-	return d + 22 + 75 * (d < 26);
-	/*  0..25 map to ASCII a..z or A..Z */
-	/* 26..35 map to ASCII 0..9         */
-}
-#define flagged(bcp) ((punycode_uint)(bcp) - 65 < 26)
 static const punycode_uint maxint = -1;
 
 static punycode_uint adapt(punycode_uint delta, punycode_uint numpoints, int firsttime)
@@ -406,6 +521,191 @@ static punycode_uint adapt(punycode_uint delta, punycode_uint numpoints, int fir
 	return k + (base - tmin + 1) * delta / (delta + skew);
 }
 
+/* decode_digit(cp) returns the numeric value of a basic code */
+/* point (for use in representing integers) in the range 0 to */
+/* base-1, or base if cp does not represent a value.          */
+static punycode_uint decode_digit(punycode_uint cp)
+{
+	return cp - 48 < 10 ? cp - 22 : cp - 65 < 26 ? cp - 65 : cp - 97 < 26 ? cp - 97 : base;
+}
+
+static enum punycode_status punycode_decode(
+	size_t input_length,
+	const char input[],
+	size_t *output_length,
+	punycode_uint output[])
+{
+	punycode_uint n, out, i, max_out, bias, oldi, w, k, digit, t;
+	size_t b, j, in;
+
+	/* Initialize the state: */
+
+	n = initial_n;
+	out = i = 0;
+	max_out = *output_length > maxint ? maxint : (punycode_uint) *output_length;
+	bias = initial_bias;
+
+	/* Handle the basic code points:  Let b be the number of input code */
+	/* points before the last delimiter, or 0 if there is none, then    */
+	/* copy the first b code points to the output.                      */
+
+	for (b = j = 0; j < input_length; ++j)
+		if (input[j] == delimiter)
+			b = j;
+
+	if (b > max_out)
+		return punycode_big_output;
+
+	for (j = 0; j < b; ++j) {
+		if ((unsigned char) input[j] >= 0x80)
+			return punycode_bad_input;
+		output[out++] = (unsigned char) input[j];
+	}
+
+	/* Main decoding loop:  Start just after the last delimiter if any  */
+	/* basic code points were copied; start at the beginning otherwise. */
+
+	for (in = b > 0 ? b + 1 : 0; in < input_length; ++out) {
+
+		/* in is the index of the next ASCII code point to be consumed, */
+		/* and out is the number of code points in the output array.   */
+
+		/* Decode a generalized variable-length integer into delta,  */
+		/* which gets added to i.  The overflow checking is easier   */
+		/* if we increase i as we go, then subtract off its starting */
+		/* value at the end to obtain delta.                         */
+
+		for (oldi = i, w = 1, k = base;; k += base) {
+			if (in >= input_length)
+				return punycode_bad_input;
+			digit = decode_digit((unsigned char) input[in++]);
+			if (digit >= base)
+				return punycode_bad_input;
+			if (digit > (maxint - i) / w)
+				return punycode_overflow;
+			i += digit * w;
+			t = k <= bias ? tmin : k >= bias + tmax ? tmax : k - bias;
+			if (digit < t)
+				break;
+			if (w > maxint / (base - t))
+				return punycode_overflow;
+			w *= (base - t);
+		}
+
+		bias = adapt(i - oldi, out + 1, oldi == 0);
+
+		/* i was supposed to wrap around from out+1 to 0,   */
+		/* incrementing n each time, so we'll fix that now: */
+
+		if (i / (out + 1) > maxint - n)
+			return punycode_overflow;
+		n += i / (out + 1);
+		i %= (out + 1);
+
+		/* Insert n at position i of the output: */
+
+		if (out >= max_out)
+			return punycode_big_output;
+
+		memmove(output + i + 1, output + i, (out - i) * sizeof *output);
+		output[i++] = n;
+	}
+
+	*output_length = (size_t) out;
+	return punycode_success;
+}
+
+/*
+ * Encode code point 'cp' as UTF-8 into 'out' (if not NULL).
+ * Returns the number of bytes needed.
+ */
+static size_t utf8_put(punycode_uint cp, char *out)
+{
+	unsigned char *o = (unsigned char *) out;
+
+	if (cp < 0x80) {
+		if (o) o[0] = (unsigned char) cp;
+		return 1;
+	} else if (cp < 0x800) {
+		if (o) {
+			o[0] = (unsigned char) (0xC0 | (cp >> 6));
+			o[1] = (unsigned char) (0x80 | (cp & 0x3F));
+		}
+		return 2;
+	} else if (cp < 0x10000) {
+		if (o) {
+			o[0] = (unsigned char) (0xE0 | (cp >> 12));
+			o[1] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+			o[2] = (unsigned char) (0x80 | (cp & 0x3F));
+		}
+		return 3;
+	}
+
+	if (o) {
+		o[0] = (unsigned char) (0xF0 | (cp >> 18));
+		o[1] = (unsigned char) (0x80 | ((cp >> 12) & 0x3F));
+		o[2] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+		o[3] = (unsigned char) (0x80 | (cp & 0x3F));
+	}
+	return 4;
+}
+
+/*
+ * Copy 'domain' into 'buf', ACE labels (xn--...) are decoded into UTF-8.
+ * Returns 'buf' or NULL if an ACE label is invalid or 'buf' is too small.
+ */
+static const char *domain_to_unicode(const char *domain, char *buf, size_t bufsize)
+{
+	punycode_uint input[64];
+	size_t outlen = 0, labellen, inputlen, it;
+	const char *label, *e;
+
+	for (label = domain;; label = e + 1) {
+		if (!(e = strchr(label, '.')))
+			e = label + strlen(label);
+		labellen = e - label;
+
+		if (labellen > 4 && (label[0] | 0x20) == 'x' && (label[1] | 0x20) == 'n' && label[2] == '-' && label[3] == '-') {
+			inputlen = countof(input);
+			if (punycode_decode(labellen - 4, label + 4, &inputlen, input) != punycode_success)
+				return NULL;
+
+			for (it = 0; it < inputlen; it++) {
+				if (input[it] > 0x10FFFF || (input[it] >= 0xD800 && input[it] <= 0xDFFF))
+					return NULL;
+				if (outlen + utf8_put(input[it], NULL) >= bufsize)
+					return NULL;
+				outlen += utf8_put(input[it], buf + outlen);
+			}
+		} else {
+			if (outlen + labellen >= bufsize)
+				return NULL;
+			memcpy(buf + outlen, label, labellen);
+			outlen += labellen;
+		}
+
+		if (!*e)
+			break;
+
+		if (outlen + 1 >= bufsize)
+			return NULL;
+		buf[outlen++] = '.';
+	}
+
+	buf[outlen] = 0;
+
+	return buf;
+}
+
+#if !defined(WITH_LIBIDN) && !defined(WITH_LIBIDN2) && !defined(WITH_LIBICU)
+static char encode_digit(punycode_uint d)
+{
+	return d + 22 + 75 * (d < 26);
+	/*  0..25 map to ASCII a..z or A..Z */
+	/* 26..35 map to ASCII 0..9         */
+}
+
+
 static enum punycode_status punycode_encode(
 	size_t input_length_orig,
 	const punycode_uint input[],
@@ -509,6 +809,7 @@ static enum punycode_status punycode_encode(
 	return punycode_success;
 }
 
+#ifndef WITH_NATIVE_IDNA
 static ssize_t utf8_to_utf32(const char *in, size_t inlen, punycode_uint *out, size_t outlen)
 {
 	size_t n = 0;
@@ -539,7 +840,7 @@ static ssize_t utf8_to_utf32(const char *in, size_t inlen, punycode_uint *out, s
 		} else if (inleft >= 4 && (*s & 0xF8) == 0xF0) /* 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx */ {
 			if ((s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 || (s[3] & 0xC0) != 0x80)
 				return -1;
-			out[n++] = ((*s & 0x07) << 18) | ((s[1] & 0x3F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+			out[n++] = ((*s & 0x07) << 18) | ((s[1] & 0x3F) << 12) | ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
 			s += 4;
 		} else if (!inleft) {
 			break;
@@ -550,15 +851,6 @@ static ssize_t utf8_to_utf32(const char *in, size_t inlen, punycode_uint *out, s
 	return n;
 }
 
-static int mem_is_ascii(const char *s, size_t n)
-{
-	for (; n; n--) /* 'while(n--)' generates unsigned integer overflow on n = 0 */
-		if (*((unsigned char *)s++) >= 128)
-			return 0;
-
-	return 1;
-}
-
 static int domain_to_punycode(const char *domain, char *out, size_t outsize)
 {
 	size_t outlen = 0, labellen;
@@ -602,131 +894,478 @@ static int domain_to_punycode(const char *domain, char *out, size_t outsize)
 
 	return 0;
 }
-#endif
+#else
+/*
+ * Native IDNA support (./configure --enable-runtime=native).
+ *
+ * The UTS#46 mapping and the lowercase data are looked up in two-stage tables
+ * generated at build time by psl-make-idna-tables. Both map to decomposed strings,
+ * which are composed afterwards into NFC resp. NFKC by idna_compose().
+ * Mapped labels are punycode encoded by punycode_encode() from above.
+ *
+ * Not implemented are the CONTEXTJ/Bidi validity checks.
+ */
+enum {
+	idna_valid = 0,
+	idna_mapped = 1,
+	idna_ignored = 2,
+	idna_disallowed = 3
+};
 
-static int isspace_ascii(const char c)
+#define IDNA_STATUS(v) ((v) >> 30)
+#define IDNA_LENGTH(v) (((v) >> 24) & 0x3F)
+#define IDNA_OFFSET(v) ((v) & 0xFFFFFF)
+
+static unsigned int idna_table_lookup(
+	const unsigned short *stage1,
+	const unsigned short *stage2,
+	const unsigned int *values,
+	int shift,
+	punycode_uint cp)
 {
-	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	if (cp >= 0x110000)
+		return (unsigned int) idna_disallowed << 30;
+
+	return values[stage2[((size_t) stage1[cp >> shift] << shift) | (cp & ((1U << shift) - 1))]];
 }
 
-static int str_is_ascii(const char *s)
+#define UTS46_VALUE(cp) \
+	idna_table_lookup(psl_uts46_stage1, psl_uts46_stage2, psl_uts46_values, PSL_UTS46_SHIFT, cp)
+#define LOWER_VALUE(cp) \
+	idna_table_lookup(psl_lower_stage1, psl_lower_stage2, psl_lower_values, PSL_LOWER_SHIFT, cp)
+#define CCC_VALUE(cp) \
+	psl_ccc_stage2[((size_t) psl_ccc_stage1[(cp) >> PSL_CCC_SHIFT] << PSL_CCC_SHIFT) | ((cp) & ((1U << PSL_CCC_SHIFT) - 1))]
+
+/* the Hangul syllables are composed algorithmically, see chapter 3.12 of the Unicode standard */
+#define HANGUL_SBASE 0xAC00
+#define HANGUL_LBASE 0x1100
+#define HANGUL_VBASE 0x1161
+#define HANGUL_TBASE 0x11A7
+#define HANGUL_LCOUNT 19
+#define HANGUL_VCOUNT 21
+#define HANGUL_TCOUNT 28
+#define HANGUL_SCOUNT (HANGUL_LCOUNT * HANGUL_VCOUNT * HANGUL_TCOUNT)
+
+/* Returns the primary composite of 'first' and 'second', 0 if there is none */
+static punycode_uint idna_compose_pair(punycode_uint first, punycode_uint second)
 {
-	while (*s && *((unsigned char *)s) < 128) s++;
+	size_t l = 0, r = countof(psl_compose) / 3, m;
 
-	return !*s;
+	if (first - HANGUL_LBASE < HANGUL_LCOUNT && second - HANGUL_VBASE < HANGUL_VCOUNT)
+		return HANGUL_SBASE + ((first - HANGUL_LBASE) * HANGUL_VCOUNT + second - HANGUL_VBASE) * HANGUL_TCOUNT;
+
+	if (first - HANGUL_SBASE < HANGUL_SCOUNT && (first - HANGUL_SBASE) % HANGUL_TCOUNT == 0
+		&& second - HANGUL_TBASE - 1 < HANGUL_TCOUNT - 1)
+		return first + second - HANGUL_TBASE;
+
+	/* binary search in the triples of first, second and composite */
+	while (l < r) {
+		m = (l + r) / 2;
+
+		if (psl_compose[m * 3] < first || (psl_compose[m * 3] == first && psl_compose[m * 3 + 1] < second))
+			l = m + 1;
+		else
+			r = m;
+	}
+
+	if (l < countof(psl_compose) / 3 && psl_compose[l * 3] == first && psl_compose[l * 3 + 1] == second)
+		return psl_compose[l * 3 + 2];
+
+	return 0;
 }
 
-#if defined(WITH_LIBIDN)
 /*
- * Work around a libidn <= 1.30 vulnerability.
- *
- * The function checks for a valid UTF-8 character sequence before
- * passing it to idna_to_ascii_8z().
- *
- * [1] https://lists.gnu.org/archive/html/help-libidn/2015-05/msg00002.html
- * [2] https://lists.gnu.org/archive/html/bug-wget/2015-06/msg00002.html
- * [3] https://curl.haxx.se/mail/lib-2015-06/0143.html
+ * Brings the decomposed code points 'cp' into canonical order and composes them,
+ * which gives NFC (NFKC after a compatibility decomposition).
+ * Returns the number of code points left.
  */
-static int utf8_is_valid(const char *utf8)
+static size_t idna_compose(punycode_uint *cp, size_t n)
 {
-	const unsigned char *s = (const unsigned char *) utf8;
+	size_t it, it2, out, starter = 0;
+	int has_starter = 0, ccc, last_ccc = 0;
+	punycode_uint c, composite;
 
-	while (*s) {
-		if ((*s & 0x80) == 0) /* 0xxxxxxx ASCII char */
-			s++;
-		else if ((*s & 0xE0) == 0xC0) /* 110xxxxx 10xxxxxx */ {
-			if ((s[1] & 0xC0) != 0x80)
-				return 0;
-			s += 2;
-		} else if ((*s & 0xF0) == 0xE0) /* 1110xxxx 10xxxxxx 10xxxxxx */ {
-			if ((s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80)
-				return 0;
-			s += 3;
-		} else if ((*s & 0xF8) == 0xF0) /* 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx */ {
-			if ((s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 || (s[3] & 0xC0) != 0x80)
-				return 0;
-			s += 4;
-		} else
-			return 0;
+	/* stable sort of each run of combining marks by their combining class */
+	for (it = 1; it < n; it++) {
+		if (!(ccc = CCC_VALUE(cp[it])))
+			continue;
+
+		for (c = cp[it], it2 = it; it2 > 0 && CCC_VALUE(cp[it2 - 1]) > ccc; it2--)
+			cp[it2] = cp[it2 - 1];
+		cp[it2] = c;
 	}
 
-	return 1;
-}
-#endif
+	/* a code point composes with the last starter if no code point of the same or a higher class is in between */
+	for (it = out = 0; it < n; it++) {
+		ccc = CCC_VALUE(cp[it]);
 
-typedef void *psl_idna_t;
+		if (has_starter && (out == starter + 1 || last_ccc < ccc) && (composite = idna_compose_pair(cp[starter], cp[it]))) {
+			cp[starter] = composite;
+			continue;
+		}
 
-static psl_idna_t *psl_idna_open(void)
-{
-#if defined(WITH_LIBICU)
-	UErrorCode status = 0;
-	return (void *)uidna_openUTS46(UIDNA_USE_STD3_RULES | UIDNA_NONTRANSITIONAL_TO_ASCII, &status);
-#endif
-	return NULL;
-}
+		if (!ccc) {
+			starter = out;
+			has_starter = 1;
+		}
 
-static void psl_idna_close(psl_idna_t *idna)
-{
-	(void) idna;
+		last_ccc = ccc;
+		cp[out++] = cp[it];
+	}
 
-#if defined(WITH_LIBICU)
-	if (idna)
-		uidna_close((UIDNA *)idna);
-#endif
+	return out;
 }
 
-static int psl_idna_toASCII(psl_idna_t *idna, const char *utf8, char **ascii)
+/*
+ * Decode the UTF-8 sequence at *s and advance *s.
+ * Returns the code point or -1 on invalid input.
+ */
+static long utf8_next(const unsigned char **s, const unsigned char *e)
 {
-	int ret = -1;
+	const unsigned char *p = *s;
+	size_t inleft = e - p;
+	long cp;
+
+	if ((*p & 0x80) == 0) { /* 0xxxxxxx ASCII char */
+		*s = p + 1;
+		return *p;
+	} else if (inleft >= 2 && (*p & 0xE0) == 0xC0) /* 110xxxxx 10xxxxxx */ {
+		if ((p[1] & 0xC0) != 0x80)
+			return -1;
+		cp = ((*p & 0x1F) << 6) | (p[1] & 0x3F);
+		*s = p + 2;
+		return cp >= 0x80 ? cp : -1;
+	} else if (inleft >= 3 && (*p & 0xF0) == 0xE0) /* 1110xxxx 10xxxxxx 10xxxxxx */ {
+		if ((p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80)
+			return -1;
+		cp = ((long) (*p & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+		*s = p + 3;
+		return cp >= 0x800 && (cp < 0xD800 || cp > 0xDFFF) ? cp : -1;
+	} else if (inleft >= 4 && (*p & 0xF8) == 0xF0) /* 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx */ {
+		if ((p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80 || (p[3] & 0xC0) != 0x80)
+			return -1;
+		cp = ((long) (*p & 0x07) << 18) | ((long) (p[1] & 0x3F) << 12) | ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+		*s = p + 4;
+		return cp >= 0x10000 && cp < 0x110000 ? cp : -1;
+	}
 
-#if defined(WITH_LIBICU)
-	(void) idna;
+	return -1;
+}
 
-	/* IDNA2008 UTS#46 punycode conversion */
-	if (idna) {
-		char lookupname_buf[128] = "", *lookupname = lookupname_buf;
-		UErrorCode status = 0;
-		UIDNAInfo info = UIDNA_INFO_INITIALIZER;
-		UChar utf16_dst[128], utf16_src_buf[128];
-		UChar *utf16_src = utf16_src_buf;
-		int32_t utf16_src_length, bytes_written;
-		int32_t utf16_dst_length;
+/* UTS#46 toASCII (nontransitional, UseSTD3ASCIIRules) */
+static int native_to_ascii(const char *utf8, char *out, size_t outsize)
+{
+	punycode_uint mapped[512];
+	const unsigned char *s = (const unsigned char *) utf8, *e = s + strlen(utf8);
+	size_t n = 0, outlen = 0, start, it, labellen;
 
-		u_strFromUTF8(utf16_src, countof(utf16_src_buf), &utf16_src_length, utf8, -1, &status);
-		if (!U_SUCCESS(status)) goto cleanup; /* UTF-8 to UTF-16 conversion failed */
+	/* map the input, the result may contain additional label separators */
+	while (s < e) {
+		long cp = utf8_next(&s, e);
+		unsigned int value;
 
-		if (utf16_src_length >= (int) countof(utf16_src_buf)) {
-			utf16_src = malloc((utf16_src_length + 1) * sizeof(UChar));
-			if (!utf16_src) goto cleanup;
+		if (cp < 0)
+			return 1;
 
-			u_strFromUTF8(utf16_src, utf16_src_length, NULL, utf8, -1, &status);
-			if (!U_SUCCESS(status)) goto cleanup; /* UTF-8 to UTF-16 conversion failed */
+		value = UTS46_VALUE((punycode_uint) cp);
 
-			utf16_src[utf16_src_length] = 0; /* u_strFromUTF8() doesn't 0-terminate if dest is filled up */
+		switch (IDNA_STATUS(value)) {
+		case idna_valid:
+			if (n >= countof(mapped))
+				return 1;
+			mapped[n++] = (punycode_uint) cp;
+			break;
+		case idna_mapped: {
+			const unsigned char *m = psl_idna_pool + IDNA_OFFSET(value);
+			const unsigned char *me = m + IDNA_LENGTH(value);
+
+			while (m < me) {
+				if (n >= countof(mapped) || (cp = utf8_next(&m, me)) < 0)
+					return 1;
+				mapped[n++] = (punycode_uint) cp;
+			}
+			break;
+		}
+		case idna_ignored:
+			break;
+		default:
+			return 1;
 		}
+	}
 
-		utf16_dst_length = uidna_nameToASCII((UIDNA *)idna, utf16_src, utf16_src_length, utf16_dst, countof(utf16_dst), &info, &status);
-		if (!U_SUCCESS(status)) goto cleanup; /* to ASCII conversion failed */
+	n = idna_compose(mapped, n);
 
-		u_strToUTF8(lookupname, sizeof(lookupname_buf), &bytes_written, utf16_dst, utf16_dst_length, &status);
-		if (!U_SUCCESS(status)) goto cleanup; /* UTF-16 to UTF-8 conversion failed */
+	for (start = 0; start <= n; start = it + 1) {
+		for (it = start; it < n && mapped[it] != '.'; it++);
 
-		if (bytes_written >= (int) sizeof(lookupname_buf)) {
-			lookupname = malloc(bytes_written + 1);
-			if (!lookupname) goto cleanup;
+		if (start > 0) {
+			if (outlen + 1 >= outsize)
+				return 1;
+			out[outlen++] = '.';
+		}
 
-			u_strToUTF8(lookupname, bytes_written, NULL, utf16_dst, utf16_dst_length, &status);
-			if (!U_SUCCESS(status)) goto cleanup; /* UTF-16 to UTF-8 conversion failed */
+		for (labellen = start; labellen < it && mapped[labellen] < 0x80; labellen++);
 
-			lookupname[bytes_written] = 0; /* u_strToUTF8() doesn't 0-terminate if dest is filled up */
+		if (labellen == it) {
+			/* ASCII label, copy as is */
+			if (it - start > 63 || outlen + it - start >= outsize)
+				return 1;
+			for (labellen = start; labellen < it; labellen++)
+				out[outlen++] = (char) mapped[labellen];
 		} else {
-			if (!(lookupname = psl_strdup(lookupname)))
-				goto cleanup;
-		}
+			if (outlen + 4 >= outsize)
+				return 1;
 
-		if (ascii) {
-			*ascii = lookupname;
-			lookupname = NULL;
+			memcpy(out + outlen, "xn--", 4);
+			outlen += 4;
+
+			labellen = outsize - outlen - 1; /* -1 to leave space for the trailing \0 */
+			if (punycode_encode(it - start, mapped + start, &labellen, out + outlen) || labellen > 59)
+				return 1;
+			outlen += labellen;
+		}
+	}
+
+	out[outlen] = 0;
+
+	return 0;
+}
+
+/* Avoid using strcasecmp() or _stricmp(), ignore '-' and '_' */
+static int charset_is(const char *charset, const char *name)
+{
+	while (*charset || *name) {
+		if (*charset == '-' || *charset == '_')
+			charset++;
+		else if (*name == '-')
+			name++;
+		else if (tolower((unsigned char) *charset) == *name)
+			charset++, name++;
+		else
+			return 0;
+	}
+
+	return 1;
+}
+
+/* code points of ISO-8859-15 that differ from ISO-8859-1 */
+static punycode_uint latin9_to_ucs(unsigned char c)
+{
+	switch (c) {
+	case 0xA4: return 0x20AC;
+	case 0xA6: return 0x0160;
+	case 0xA8: return 0x0161;
+	case 0xB4: return 0x017D;
+	case 0xB8: return 0x017E;
+	case 0xBC: return 0x0152;
+	case 0xBD: return 0x0153;
+	case 0xBE: return 0x0178;
+	default: return c;
+	}
+}
+
+/*
+ * Convert 'str' from 'charset' into lowercase + NFKD code points, not yet in canonical order.
+ * The code points are written to 'out' if not NULL.
+ * Returns the number of code points or a psl_error_t value.
+ */
+static long native_map_lower(const char *str, const char *charset, punycode_uint *out)
+{
+	const unsigned char *s = (const unsigned char *) str, *e = s + strlen(str);
+	int utf8 = 0, latin9 = 0, ascii = 0;
+	long cp, n = 0;
+
+	if (charset_is(charset, "utf-8"))
+		utf8 = 1;
+	else if (charset_is(charset, "iso-8859-15") || charset_is(charset, "latin-9"))
+		latin9 = 1;
+	else if (charset_is(charset, "ascii") || charset_is(charset, "us-ascii") || charset_is(charset, "ansi-x3.4-1968"))
+		ascii = 1;
+	else if (!charset_is(charset, "iso-8859-1") && !charset_is(charset, "latin-1"))
+		return PSL_ERR_CONVERTER;
+
+	while (s < e) {
+		unsigned int value;
+
+		if (utf8) {
+			if ((cp = utf8_next(&s, e)) < 0)
+				return PSL_ERR_TO_UTF8;
+		} else if (ascii && *s >= 0x80)
+			return PSL_ERR_TO_UTF8;
+		else
+			cp = latin9 ? latin9_to_ucs(*s++) : *s++;
+
+		value = LOWER_VALUE((punycode_uint) cp);
+
+		if (IDNA_STATUS(value) == idna_mapped) {
+			const unsigned char *m = psl_idna_pool + IDNA_OFFSET(value);
+			const unsigned char *me = m + IDNA_LENGTH(value);
+
+			while (m < me) {
+				cp = utf8_next(&m, me);
+				if (out)
+					out[n] = (punycode_uint) cp;
+				n++;
+			}
+		} else {
+			if (out)
+				out[n] = (punycode_uint) cp;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Convert 'str' from 'charset' into lowercase + NFKC UTF-8.
+ * The result is returned in 'lower' if not NULL.
+ * Returns a psl_error_t value.
+ */
+static int native_to_utf8lower(const char *str, const char *charset, char **lower)
+{
+	punycode_uint *cp;
+	long n;
+	size_t it, len;
+	char *out;
+
+	/* the first call just counts the code points, the second one maps */
+	if ((n = native_map_lower(str, charset, NULL)) < 0)
+		return (int) n;
+
+	if (!lower)
+		return PSL_SUCCESS;
+
+	if (!(cp = malloc((n + 1) * sizeof(punycode_uint))))
+		return PSL_ERR_NO_MEM;
+
+	native_map_lower(str, charset, cp);
+	n = (long) idna_compose(cp, (size_t) n);
+
+	for (len = 0, it = 0; it < (size_t) n; it++)
+		len += utf8_put(cp[it], NULL);
+
+	if (!(out = malloc(len + 1))) {
+		free(cp);
+		return PSL_ERR_NO_MEM;
+	}
+
+	for (len = 0, it = 0; it < (size_t) n; it++)
+		len += utf8_put(cp[it], out + len);
+	out[len] = 0;
+
+	free(cp);
+	*lower = out;
+
+	return PSL_SUCCESS;
+}
+#endif /* WITH_NATIVE_IDNA */
+#endif
+
+static int isspace_ascii(const char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int str_is_ascii(const char *s)
+{
+	return mem_is_ascii(s, strlen(s));
+}
+
+#if defined(WITH_LIBIDN)
+/*
+ * Work around a libidn <= 1.30 vulnerability.
+ *
+ * The function checks for a valid UTF-8 character sequence before
+ * passing it to idna_to_ascii_8z().
+ *
+ * [1] https://lists.gnu.org/archive/html/help-libidn/2015-05/msg00002.html
+ * [2] https://lists.gnu.org/archive/html/bug-wget/2015-06/msg00002.html
+ * [3] https://curl.haxx.se/mail/lib-2015-06/0143.html
+ */
+static int utf8_is_valid(const char *utf8)
+{
+	psl_scan_t scan;
+
+	psl_scan_domain(utf8, strlen(utf8), &scan);
+
+	return scan.valid;
+}
+#endif
+
+typedef void *psl_idna_t;
+
+static psl_idna_t *psl_idna_open(void)
+{
+#if defined(WITH_LIBICU)
+	UErrorCode status = 0;
+	return (void *)uidna_openUTS46(UIDNA_USE_STD3_RULES | UIDNA_NONTRANSITIONAL_TO_ASCII, &status);
+#endif
+	return NULL;
+}
+
+static void psl_idna_close(psl_idna_t *idna)
+{
+	(void) idna;
+
+#if defined(WITH_LIBICU)
+	if (idna)
+		uidna_close((UIDNA *)idna);
+#endif
+}
+
+static int psl_idna_toASCII(psl_idna_t *idna, const char *utf8, char **ascii)
+{
+	int ret = -1;
+
+#if defined(WITH_LIBICU)
+	(void) idna;
+
+	/* IDNA2008 UTS#46 punycode conversion */
+	if (idna) {
+		char lookupname_buf[128] = "", *lookupname = lookupname_buf;
+		UErrorCode status = 0;
+		UIDNAInfo info = UIDNA_INFO_INITIALIZER;
+		UChar utf16_dst[128], utf16_src_buf[128];
+		UChar *utf16_src = utf16_src_buf;
+		int32_t utf16_src_length, bytes_written;
+		int32_t utf16_dst_length;
+
+		u_strFromUTF8(utf16_src, countof(utf16_src_buf), &utf16_src_length, utf8, -1, &status);
+		if (!U_SUCCESS(status)) goto cleanup; /* UTF-8 to UTF-16 conversion failed */
+
+		if (utf16_src_length >= (int) countof(utf16_src_buf)) {
+			utf16_src = malloc((utf16_src_length + 1) * sizeof(UChar));
+			if (!utf16_src) goto cleanup;
+
+			u_strFromUTF8(utf16_src, utf16_src_length, NULL, utf8, -1, &status);
+			if (!U_SUCCESS(status)) goto cleanup; /* UTF-8 to UTF-16 conversion failed */
+
+			utf16_src[utf16_src_length] = 0; /* u_strFromUTF8() doesn't 0-terminate if dest is filled up */
+		}
+
+		utf16_dst_length = uidna_nameToASCII((UIDNA *)idna, utf16_src, utf16_src_length, utf16_dst, countof(utf16_dst), &info, &status);
+		if (!U_SUCCESS(status)) goto cleanup; /* to ASCII conversion failed */
+
+		u_strToUTF8(lookupname, sizeof(lookupname_buf), &bytes_written, utf16_dst, utf16_dst_length, &status);
+		if (!U_SUCCESS(status)) goto cleanup; /* UTF-16 to UTF-8 conversion failed */
+
+		if (bytes_written >= (int) sizeof(lookupname_buf)) {
+			lookupname = malloc(bytes_written + 1);
+			if (!lookupname) goto cleanup;
+
+			u_strToUTF8(lookupname, bytes_written, NULL, utf16_dst, utf16_dst_length, &status);
+			if (!U_SUCCESS(status)) goto cleanup; /* UTF-16 to UTF-8 conversion failed */
+
+			lookupname[bytes_written] = 0; /* u_strToUTF8() doesn't 0-terminate if dest is filled up */
+		} else {
+			if (!(lookupname = psl_strdup(lookupname)))
+				goto cleanup;
+		}
+
+		if (ascii) {
+			*ascii = lookupname;
+			lookupname = NULL;
 		}
 
 		ret = 0;
@@ -788,6 +1427,16 @@ cleanup:
 		ret = 0;
 	} /* else
 		fprintf(stderr, "toASCII failed (%d): %s\n", rc, idna_strerror(rc)); */
+#elif defined(WITH_NATIVE_IDNA)
+	char lookupname[256];
+
+	(void) idna;
+
+	if (native_to_ascii(utf8, lookupname, sizeof(lookupname)) == 0) {
+		if (ascii)
+			if ((*ascii = psl_strdup(lookupname)))
+				ret = 0;
+	}
 #else
 	char lookupname[128];
 
@@ -817,6 +1466,7 @@ static void add_punycode_if_needed(psl_idna_t *idna, psl_vector_t *v, psl_entry_
 			/* fprintf(stderr, "toASCII '%s' -> '%s'\n", e->label_buf, lookupname); */
 			if (suffix_init(&suffix, lookupname, strlen(lookupname)) == 0) {
 				suffix.flags = e->flags;
+				suffix.id = e->id;
 				if ((suffixp = vector_get(v, vector_add(v, &suffix))))
 					suffixp->label = suffixp->label_buf; /* set label to changed address */
 			}
@@ -826,513 +1476,2336 @@ static void add_punycode_if_needed(psl_idna_t *idna, psl_vector_t *v, psl_entry_
 	}
 }
 
+/*
+ * Convert the non-ASCII labels of 'domain' into punycode, ASCII labels are copied unchanged.
+ * Returns 0 on success, the result in '*ascii' has to be free'd by the caller.
+ */
+static int psl_idna_labels_toASCII(psl_idna_t *idna, const char *domain, char **ascii)
+{
+	const char *label, *e;
+	char *out = NULL, *tmp, *conv, buf[256];
+	size_t outlen = 0, labellen, convlen;
+
+	for (label = domain;; label = e + 1) {
+		if (!(e = strchr(label, '.')))
+			e = label + strlen(label);
+		labellen = e - label;
+
+		if (mem_is_ascii(label, labellen)) {
+			conv = NULL;
+			convlen = labellen;
+		} else {
+			if (labellen >= sizeof(buf))
+				goto fail;
+
+			memcpy(buf, label, labellen);
+			buf[labellen] = 0;
+
+			if (psl_idna_toASCII(idna, buf, &conv))
+				goto fail;
+
+			convlen = strlen(conv);
+		}
+
+		if (!(tmp = realloc(out, outlen + convlen + 2))) {
+			free(conv);
+			goto fail;
+		}
+
+		out = tmp;
+		memcpy(out + outlen, conv ? conv : label, convlen);
+		outlen += convlen;
+		free(conv);
+
+		if (!*e)
+			break;
+
+		out[outlen++] = '.';
+	}
+
+	out[outlen] = 0;
+	*ascii = out;
+
+	return 0;
+
+fail:
+	free(out);
+	return -1;
+}
+
 /* prototypes */
 int LookupStringInFixedSet(const unsigned char* graph, size_t length, const char* key, size_t key_length);
+int LookupStringInValidFixedSet(const unsigned char* graph, size_t length, const char* key, size_t key_length);
+int LookupAsciiStringInValidFixedSet(const unsigned char* graph, size_t length, const char* key, size_t key_length);
+int LookupAsciiStringInValidFixedSetIgnoreCase(const unsigned char* graph, size_t length, const char* key, size_t key_length);
+int LookupPayloadInValidFixedSet(const unsigned char* graph, size_t length, const char* key, size_t key_length, const unsigned char** payload);
+void LookupAsciiLabelsInValidFixedSet(const unsigned char* graph, size_t length, const char* key, size_t key_length, int fold, int* values, size_t nvalues);
+int ValidateDafsa(const unsigned char *graph, size_t length, size_t payload_size);
 int GetUtfMode(const unsigned char *graph, size_t length);
+int GetMaxLabels(const unsigned char *graph, size_t length);
+int psl_inflate(unsigned char *out, size_t out_size, const unsigned char *in, size_t in_size);
+int ForEachStringInValidFixedSet(const unsigned char *graph, size_t length,
+	int (*callback)(const char *, size_t, int, const unsigned char *, void *), void *data);
 
-static int is_public_suffix(const psl_ctx_t *psl, const char *domain, int type)
+/*
+ * The vector engine: the rules sorted by suffix_compare(), used for PSL files.
+ */
+
+static int vector_engine_lookup(const void *data, const char *key, size_t len, int is_ascii, int nocase)
 {
+	const psl_vector_t *v = (const psl_vector_t *) data;
+	const psl_entry_t *e;
 	psl_entry_t suffix;
 	const char *p;
-	char *punycode = NULL;
-	int need_conversion = 0;
 
-	/* this function should be called without leading dots, just make sure */
-	if (*domain == '.')
-		domain++;
+	(void) is_ascii;
 
-	suffix.nlabels = 1;
+	/* suffix_init() ignores longer rules */
+	if (len >= sizeof(suffix.label_buf) - 1)
+		return -1;
 
-	for (p = domain; *p; p++) {
-		if (*p == '.') {
-			if (suffix.nlabels == 255) /* weird input, avoid 8bit overflow */
-				return 0;
-			suffix.nlabels++;
-		}
-		else if (*((unsigned char *)p) >= 128)
-			need_conversion = 1; /* in case domain is non-ascii we need a toASCII conversion */
+	if (nocase) {
+		memcpy(suffix.label_buf, key, len + 1);
+		psl_scan_tolower_ascii(suffix.label_buf, len);
+		key = suffix.label_buf;
 	}
 
-	if (suffix.nlabels == 1) {
-		/* TLD, this is the prevailing '*' match. If type excludes the '*' rule, continue.
-		 */
-		if (!(type & PSL_TYPE_NO_STAR_RULE))
-			return 1;
-	}
+	suffix.label = key;
+	suffix.length = (unsigned short) len;
+	suffix.nlabels = 1;
+	for (p = key; (p = strchr(p, '.')); p++)
+		suffix.nlabels++;
 
-	type &= ~PSL_TYPE_NO_STAR_RULE;
+	if (!(e = vector_get(v, vector_find(v, &suffix))))
+		return -1;
 
-	if (psl->utf8 || psl == &builtin_psl)
-		need_conversion = 0;
+	return e->flags & 0x0F;
+}
 
-	if (need_conversion) {
-		psl_idna_t *idna = psl_idna_open();
+static int vector_engine_rule_id(const void *data, const char *key, size_t len)
+{
+	const psl_vector_t *v = (const psl_vector_t *) data;
+	const psl_entry_t *e;
+	psl_entry_t suffix;
 
-		if (psl_idna_toASCII(idna, domain, &punycode) == 0) {
-			suffix.label = punycode;
-			suffix.length = strlen(punycode);
-		} else {
-			/* fallback */
+	if (len >= sizeof(suffix.label_buf) - 1)
+		return -1;
 
-			suffix.label = domain;
-			suffix.length = p - suffix.label;
-		}
+	memcpy(suffix.label_buf, key, len);
+	suffix.label_buf[len] = 0;
+	suffix_init(&suffix, suffix.label_buf, len);
 
-		psl_idna_close(idna);
-	} else {
-		suffix.label = domain;
-		suffix.length = p - suffix.label;
-	}
+	if (!(e = vector_get(v, vector_find(v, &suffix))))
+		return -1;
+
+	return e->id;
+}
 
-	if (psl == &builtin_psl || psl->dafsa) {
-		size_t dafsa_size = psl == &builtin_psl ? sizeof(kDafsa) : psl->dafsa_size;
-		const unsigned char *dafsa = psl == &builtin_psl ? kDafsa : psl->dafsa;
-		int rc = LookupStringInFixedSet(dafsa, dafsa_size, suffix.label, suffix.length);
-		if (rc != -1) {
-			/* check for correct rule type */
-			if (type == PSL_TYPE_ICANN && !(rc & PRIV_PSL_FLAG_ICANN))
-				goto suffix_no;
-			else if (type == PSL_TYPE_PRIVATE && !(rc & PRIV_PSL_FLAG_PRIVATE))
-				goto suffix_no;
+static int vector_engine_foreach(const void *data, psl_rule_callback_t callback, void *user_data)
+{
+	const psl_vector_t *v = (const psl_vector_t *) data;
+	int it, rc;
 
-			if (rc & PRIV_PSL_FLAG_EXCEPTION)
-				goto suffix_no;
+	for (it = 0; it < v->cur; it++) {
+		const psl_entry_t *e = v->entry[it];
+		unsigned char payload[PAYLOAD_SIZE];
 
-			/* wildcard *.foo.bar implicitly make foo.bar a public suffix */
-			/* definitely a match, no matter if the found rule is a wildcard or not */
-			goto suffix_yes;
-		}
-		if ((suffix.label = strchr(suffix.label, '.'))) {
-			suffix.label++;
-			suffix.length = strlen(suffix.label);
-			suffix.nlabels--;
-
-			rc = LookupStringInFixedSet(dafsa, dafsa_size, suffix.label, suffix.length);
-			if (rc != -1) {
-				/* check for correct rule type */
-				if (type == PSL_TYPE_ICANN && !(rc & PRIV_PSL_FLAG_ICANN))
-					goto suffix_no;
-				else if (type == PSL_TYPE_PRIVATE && !(rc & PRIV_PSL_FLAG_PRIVATE))
-					goto suffix_no;
-
-				if (rc & PRIV_PSL_FLAG_WILDCARD)
-					goto suffix_yes;
-			}
+		if (e->id < 0) {
+			rc = callback(e->label, e->length, e->flags & 0x0F, NULL, user_data);
+		} else {
+			/* the same payload as psl-make-dafsa --payload, the PSL has international rules just in UTF-8 */
+			payload[0] = (unsigned char) (e->flags & 0x0F);
+			if (!str_is_ascii(e->label))
+				payload[0] |= PSL_RULE_IDN;
+			else if (strstr(e->label, "xn--"))
+				payload[0] |= PSL_RULE_IDN | PAYLOAD_FLAG_PUNYCODE;
+			payload[1] = (unsigned char) (e->id >> 16);
+			payload[2] = (unsigned char) (e->id >> 8);
+			payload[3] = (unsigned char) e->id;
+
+			rc = callback(e->label, e->length, e->flags & 0x0F, payload, user_data);
 		}
-	} else {
-		psl_entry_t *rule = vector_get(psl->suffixes, 0);
 
-		if (!rule || rule->nlabels < suffix.nlabels - 1)
-			goto suffix_no;
+		if (rc)
+			return rc;
+	}
 
-		rule = vector_get(psl->suffixes, vector_find(psl->suffixes, &suffix));
+	return 0;
+}
 
-		if (rule) {
-			/* check for correct rule type */
-			if (type == PSL_TYPE_ICANN && !(rule->flags & PRIV_PSL_FLAG_ICANN))
-				goto suffix_no;
-			else if (type == PSL_TYPE_PRIVATE && !(rule->flags & PRIV_PSL_FLAG_PRIVATE))
-				goto suffix_no;
+static size_t vector_engine_memory_usage(const void *data)
+{
+	const psl_vector_t *v = (const psl_vector_t *) data;
 
-			if (rule->flags & PRIV_PSL_FLAG_EXCEPTION)
-				goto suffix_no;
+	return sizeof(psl_vector_t) + v->max * sizeof(psl_entry_t *) + v->cur * sizeof(psl_entry_t);
+}
 
-			/* wildcard *.foo.bar implicitly make foo.bar a public suffix */
-			/* definitely a match, no matter if the found rule is a wildcard or not */
-			goto suffix_yes;
-		}
+static void vector_engine_free(void *data)
+{
+	psl_vector_t *v = (psl_vector_t *) data;
 
-		if ((suffix.label = strchr(suffix.label, '.'))) {
-			suffix.label++;
-			suffix.length = strlen(suffix.label);
-			suffix.nlabels--;
+	vector_free(&v);
+}
 
-			rule = vector_get(psl->suffixes, vector_find(psl->suffixes, &suffix));
+/* callback for the foreach function of an engine */
+static int vector_engine_add(const char *rule, size_t len, int flags, const unsigned char *payload, void *data)
+{
+	psl_vector_t *v = (psl_vector_t *) data;
+	psl_entry_t suffix, *suffixp;
+	char buf[sizeof(suffix.label_buf)];
 
-			if (rule) {
-				/* check for correct rule type */
-				if (type == PSL_TYPE_ICANN && !(rule->flags & PRIV_PSL_FLAG_ICANN))
-					goto suffix_no;
-				else if (type == PSL_TYPE_PRIVATE && !(rule->flags & PRIV_PSL_FLAG_PRIVATE))
-					goto suffix_no;
+	if (len >= sizeof(buf) - 1)
+		return 0; /* ignored like by suffix_init() */
 
-				if (rule->flags & PRIV_PSL_FLAG_WILDCARD)
-					goto suffix_yes;
+	/* the number of strings may grow exponentially with the size of a (crafted) DAFSA */
+	if (v->cur >= 1024 * 1024)
+		return -1;
+
+	memcpy(buf, rule, len);
+	buf[len] = 0;
+	suffix_init(&suffix, buf, len);
+	suffix.flags = (unsigned char) flags;
+	suffix.id = payload ? (payload[1] << 16) | (payload[2] << 8) | payload[3] : -1;
+
+	if (!(suffixp = vector_get(v, vector_add(v, &suffix))))
+		return -1;
+
+	suffixp->label = suffixp->label_buf; /* set label to changed address */
+	return 0;
+}
+
+static void *vector_engine_build(const psl_engine_t *engine, const void *data)
+{
+	psl_vector_t *v = vector_alloc(8*1024, suffix_compare_array);
+
+	if (v && engine->foreach(data, vector_engine_add, v)) {
+		vector_free(&v);
+		return NULL;
+	}
+
+	vector_sort(v);
+	return v;
+}
+
+static const psl_engine_t vector_engine = {
+	"vector",
+	vector_engine_lookup,
+	vector_engine_rule_id,
+	vector_engine_foreach,
+	vector_engine_memory_usage,
+	vector_engine_free,
+	vector_engine_build,
+	NULL,
+	NULL
+};
+
+/*
+ * The DAFSA engine: the builtin data and the DAFSA files generated by psl-make-dafsa.
+ */
+
+/*
+ * Returns a copy of the 'len' bytes of 'key' with the labels in reverse order, NUL terminated,
+ * in 'buf' if it has room for it or else allocated, NULL on error.
+ */
+static char *reverse_labels(char *buf, size_t size, const char *key, size_t len)
+{
+	const char *end = key + len, *p;
+	char *out, *reversed;
+
+	if (len < size)
+		reversed = buf;
+	else if (!(reversed = malloc(len + 1)))
+		return NULL;
+
+	for (out = reversed;; end = p - 1) {
+		for (p = end; p > key && p[-1] != '.'; p--)
+			;
+
+		memcpy(out, p, end - p);
+		out += end - p;
+
+		if (p == key)
+			break;
+
+		*out++ = '.';
+	}
+	*out = 0;
+
+	return reversed;
+}
+
+static int dafsa_lookup(const psl_dafsa_t *d, const char *key, size_t len, int is_ascii, int nocase)
+{
+	char buf[256], *lower;
+	int rc;
+
+	if (d->valid) {
+		/* the ASCII traversal folds the case while walking the graph */
+		if (nocase)
+			return LookupAsciiStringInValidFixedSetIgnoreCase(d->blob.data, d->blob.size, key, len);
+
+		return is_ascii ? LookupAsciiStringInValidFixedSet(d->blob.data, d->blob.size, key, len)
+			: LookupStringInValidFixedSet(d->blob.data, d->blob.size, key, len);
+	}
+
+	if (!nocase)
+		return LookupStringInFixedSet(d->blob.data, d->blob.size, key, len);
+
+	if (len < sizeof(buf))
+		lower = buf;
+	else if (!(lower = malloc(len + 1)))
+		return -1;
+
+	memcpy(lower, key, len);
+	psl_scan_tolower_ascii(lower, len);
+	rc = LookupStringInFixedSet(d->blob.data, d->blob.size, lower, len);
+
+	if (lower != buf)
+		free(lower);
+
+	return rc;
+}
+
+static int dafsa_engine_lookup(const void *data, const char *key, size_t len, int is_ascii, int nocase)
+{
+	const psl_dafsa_t *d = (const psl_dafsa_t *) data;
+	char buf[256], *reversed;
+	int rc;
+
+	if (!d->reversed)
+		return dafsa_lookup(d, key, len, is_ascii, nocase);
+
+	if (!(reversed = reverse_labels(buf, sizeof(buf), key, len)))
+		return -1;
+
+	rc = dafsa_lookup(d, reversed, len, is_ascii, nocase);
+
+	if (reversed != buf)
+		free(reversed);
+
+	return rc;
+}
+
+static int dafsa_engine_rule_id(const void *data, const char *key, size_t len)
+{
+	const psl_dafsa_t *d = (const psl_dafsa_t *) data;
+	const unsigned char *payload;
+	char buf[256], *reversed = NULL;
+	int rc;
+
+	if (!d->valid || !d->payload)
+		return -1;
+
+	if (d->reversed && !(key = reversed = reverse_labels(buf, sizeof(buf), key, len)))
+		return -1;
+
+	rc = LookupPayloadInValidFixedSet(d->blob.data, d->blob.size, key, len, &payload);
+
+	if (reversed && reversed != buf)
+		free(reversed);
+
+	if (rc == -1)
+		return -1;
+
+	return (payload[1] << 16) | (payload[2] << 8) | payload[3];
+}
+
+typedef struct {
+	psl_rule_callback_t
+		callback;
+	void
+		*data;
+	unsigned
+		payload : 1, /* 0: hide the bytes after the return value */
+		reversed : 1; /* 1: restore the order of the labels of the strings */
+} psl_foreach_t;
+
+/*
+ * callback for ForEachStringInValidFixedSet(), hides the bytes after the return value of DAFSAs without payloads
+ * and passes the strings of DAFSAs with reversed labels in the order of the rules
+ */
+static int dafsa_engine_rule(const char *rule, size_t len, int flags, const unsigned char *payload, void *data)
+{
+	const psl_foreach_t *f = (const psl_foreach_t *) data;
+	char buf[256], *reversed;
+	int rc;
+
+	if (!f->payload)
+		payload = NULL;
+
+	if (!f->reversed)
+		return f->callback(rule, len, flags, payload, f->data);
+
+	if (!(reversed = reverse_labels(buf, sizeof(buf), rule, len)))
+		return -1;
+
+	rc = f->callback(reversed, len, flags, payload, f->data);
+
+	if (reversed != buf)
+		free(reversed);
+
+	return rc;
+}
+
+static int dafsa_engine_foreach(const void *data, psl_rule_callback_t callback, void *user_data)
+{
+	const psl_dafsa_t *d = (const psl_dafsa_t *) data;
+	psl_foreach_t f;
+
+	/* the traversal relies on the checks of ValidateDafsa() */
+	if (!d->valid)
+		return -1;
+
+	if (d->payload && !d->reversed)
+		return ForEachStringInValidFixedSet(d->blob.data, d->blob.size, callback, user_data);
+
+	f.callback = callback;
+	f.data = user_data;
+	f.payload = d->payload;
+	f.reversed = d->reversed;
+
+	return ForEachStringInValidFixedSet(d->blob.data, d->blob.size, dafsa_engine_rule, &f);
+}
+
+static int dafsa_engine_lookup_labels(const void *data, const char *key, size_t len, int nocase, int *flags, size_t nlabels)
+{
+	const psl_dafsa_t *d = (const psl_dafsa_t *) data;
+
+	/* the walk needs the labels in reverse order and relies on the checks of ValidateDafsa() */
+	if (!d->reversed || !d->valid)
+		return -1;
+
+	LookupAsciiLabelsInValidFixedSet(d->blob.data, d->blob.size, key, len, nocase, flags, nlabels);
+
+	return 0;
+}
+
+static size_t dafsa_engine_memory_usage(const void *data)
+{
+	const psl_dafsa_t *d = (const psl_dafsa_t *) data;
+
+	return d->blob.mem ? sizeof(psl_dafsa_t) + d->blob.mem_size : d->blob.size;
+}
+
+static void dafsa_engine_free(void *data)
+{
+	psl_dafsa_t *d = (psl_dafsa_t *) data;
+
+	psl_blob_free(&d->blob);
+	free(d);
+}
+
+static const psl_engine_t dafsa_engine = {
+	"dafsa",
+	dafsa_engine_lookup,
+	dafsa_engine_rule_id,
+	dafsa_engine_foreach,
+	dafsa_engine_memory_usage,
+	dafsa_engine_free,
+	NULL, /* built by psl-make-dafsa */
+	NULL, /* opened by load() */
+	dafsa_engine_lookup_labels
+};
+
+#if defined ENABLE_BUILTIN && defined ENABLE_BUILTIN_CODE
+/*
+ * The built-in rules compiled into _psl_builtin_lookup() (psl-make-dafsa --output-format=cxx-code).
+ * kDafsa is still used to enumerate the rules.
+ */
+static int builtin_engine_lookup(const void *data, const char *key, size_t len, int is_ascii, int nocase)
+{
+	char buf[256], *lower;
+	int rc;
+
+	(void) data;
+	(void) is_ascii;
+
+	if (!nocase)
+		return _psl_builtin_lookup((const unsigned char *) key, len);
+
+	if (len < sizeof(buf))
+		lower = buf;
+	else if (!(lower = malloc(len + 1)))
+		return -1;
+
+	memcpy(lower, key, len);
+	psl_scan_tolower_ascii(lower, len);
+	rc = _psl_builtin_lookup((const unsigned char *) lower, len);
+
+	if (lower != buf)
+		free(lower);
+
+	return rc;
+}
+
+static const psl_engine_t builtin_engine = {
+	"builtin-code",
+	builtin_engine_lookup,
+	dafsa_engine_rule_id,
+	dafsa_engine_foreach,
+	dafsa_engine_memory_usage,
+	dafsa_engine_free,
+	NULL, /* built by psl-make-dafsa */
+	NULL,
+	NULL
+};
+#else
+#define builtin_engine dafsa_engine
+#endif
+
+#if defined ENABLE_BUILTIN && defined ENABLE_BUILTIN_COMPRESSED
+static psl_dafsa_t
+	builtin_dafsa = { { NULL, 0, NULL, 0, 0 }, 1, 0, 0 }; /* the DAFSA is set by builtin_inflate() */
+#else
+static const psl_dafsa_t
+	builtin_dafsa = { { kDafsa, sizeof(kDafsa), NULL, 0, 0 }, 1, 0, 0 }; /* validated by psl-make-dafsa */
+#endif
+
+static const psl_ctx_t
+	builtin_psl = {
+		&builtin_engine, (void *) &builtin_dafsa, 1, 0, 0, 0, 0, 0,
+		{ NULL, NULL, 0, 0, 0, 0, 0 }, /* see tld_depth() */
+		{ NULL, NULL, 0, 0, 0, 0, 0 },
+		NULL
+	};
+
+/*
+ * Returns the flags of the rule string 'key' (see psl_engine_t.lookup) or -1
+ * if there is no such rule in the sections used by 'psl'.
+ */
+static int engine_lookup(const psl_ctx_t *psl, const char *key, size_t len, int is_ascii, int nocase)
+{
+	int flags = psl->engine->lookup(psl->engine_data, key, len, is_ascii, nocase), base_flags;
+
+	if (flags != -1 && psl->sections && !(flags & psl->sections))
+		flags = -1;
+
+	/* the rules of an overlay add to the ones of its base, like duplicate rules of a PSL file */
+	if (psl->base && (base_flags = engine_lookup(psl->base, key, len, is_ascii, nocase)) != -1)
+		flags = flags == -1 ? base_flags : flags | base_flags;
+
+	return flags;
+}
+
+/*
+ * Sets flags[i] to engine_lookup() of the suffix made of the last i + 1 labels of the ASCII 'key',
+ * for the 'nlabels' labels of 'key' (at most 256), with a single traversal per engine.
+ * Returns -1 if an engine of 'psl' or of its base doesn't support this, 0 otherwise.
+ */
+static int engine_lookup_labels(const psl_ctx_t *psl, const char *key, size_t len, int nocase, int *flags, size_t nlabels)
+{
+	int base_flags[256];
+	size_t it;
+
+	if (!psl->engine->lookup_labels || nlabels > countof(base_flags))
+		return -1;
+
+	if (psl->base && engine_lookup_labels(psl->base, key, len, nocase, base_flags, nlabels))
+		return -1;
+
+	if (psl->engine->lookup_labels(psl->engine_data, key, len, nocase, flags, nlabels))
+		return -1;
+
+	for (it = 0; it < nlabels; it++) {
+		if (flags[it] != -1 && psl->sections && !(flags[it] & psl->sections))
+			flags[it] = -1;
+
+		if (psl->base && base_flags[it] != -1)
+			flags[it] = flags[it] == -1 ? base_flags[it] : flags[it] | base_flags[it];
+	}
+
+	return 0;
+}
+
+typedef struct {
+	psl_rule_callback_t
+		callback;
+	void
+		*data;
+	int
+		sections;
+} psl_section_filter_t;
+
+/* callback for the foreach function of an engine, skips the rules of other sections */
+static int engine_filter(const char *rule, size_t len, int flags, const unsigned char *payload, void *data)
+{
+	const psl_section_filter_t *f = (const psl_section_filter_t *) data;
+
+	if (!(flags & f->sections))
+		return 0;
+
+	return f->callback(rule, len, flags, payload, f->data);
+}
+
+/* calls 'callback' for each rule string in the sections used by 'psl' (see psl_engine_t.foreach) */
+static int engine_foreach(const psl_ctx_t *psl, psl_rule_callback_t callback, void *data)
+{
+	psl_section_filter_t f;
+
+	if (!psl->sections)
+		return psl->engine->foreach(psl->engine_data, callback, data);
+
+	f.callback = callback;
+	f.data = data;
+	f.sections = psl->sections;
+
+	return psl->engine->foreach(psl->engine_data, engine_filter, &f);
+}
+
+/* returns 'c' in lowercase if 'nocase' is set and 'c' is an ASCII uppercase letter */
+static unsigned char fold_case(unsigned char c, int nocase)
+{
+	return nocase && c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+/* compares the NUL terminated string 's' with the 'len' bytes of 'tld', returns 0 if equal */
+static int tld_compare(const unsigned char *s, const char *tld, size_t len, int nocase)
+{
+	const unsigned char *t = (const unsigned char *) tld;
+
+	for (; len; len--, s++, t++)
+		if (*s != fold_case(*t, nocase))
+			return 1;
+
+	return *s != 0;
+}
+
+/* FNV-1a, psl-make-dafsa uses the same for the builtin table */
+static unsigned tld_hash(const char *tld, size_t len, int nocase)
+{
+	const unsigned char *t = (const unsigned char *) tld;
+	unsigned hash = 2166136261U;
+
+	for (; len; len--, t++)
+		hash = ((hash ^ fold_case(*t, nocase)) * 16777619U) & 0xFFFFFFFFU;
+
+	return hash;
+}
+
+/*
+ * Returns the slot of 'tld' or the empty slot where to insert it.
+ * With 'nocase' set, 'tld' is looked up as if converted to lowercase.
+ */
+static size_t tld_slot(const unsigned *slots, size_t nslots, const unsigned char *pool, const char *tld, size_t len, int nocase)
+{
+	size_t it = tld_hash(tld, len, nocase) & (nslots - 1);
+
+	while (slots[it] && tld_compare(pool + (slots[it] >> 8), tld, len, nocase))
+		it = (it + 1) & (nslots - 1);
+
+	return it;
+}
+
+/* returns the max. number of labels of a public suffix matched by a rule with 'nlabels' labels and 'flags' */
+static int rule_depth(int nlabels, int flags)
+{
+	/* wildcard *.foo.bar matches one label more than foo.bar */
+	if (flags & PRIV_PSL_FLAG_WILDCARD)
+		return nlabels + 1;
+
+	/* an exception just makes its parent a public suffix, the TLD always is one */
+	if (flags & PRIV_PSL_FLAG_EXCEPTION)
+		return 1;
+
+	return nlabels;
+}
+
+/* doubles the number of slots of 't' */
+static int tld_table_grow(psl_tld_table_t *t)
+{
+	size_t nslots = t->nslots ? t->nslots * 2 : 1024, it;
+	unsigned *slots;
+
+	if (!(slots = calloc(nslots, sizeof(unsigned))))
+		return -1;
+
+	for (it = 0; it < t->nslots; it++) {
+		if (t->slot[it]) {
+			const unsigned char *tld = t->pool + (t->slot[it] >> 8);
+
+			slots[tld_slot(slots, nslots, t->pool, (const char *) tld, strlen((const char *) tld), 0)] = t->slot[it];
+		}
+	}
+
+	free(t->slot);
+	t->slot = slots;
+	t->nslots = nslots;
+
+	return 0;
+}
+
+/* adds the TLD of the 'len' bytes of 'rule' to 't', keeping the max. depth per TLD */
+static int tld_table_add(psl_tld_table_t *t, const char *rule, size_t len, int flags)
+{
+	const char *tld = rule + len, *p;
+	size_t it;
+	int nlabels = 1, depth;
+	void *m;
+
+	while (tld > rule && tld[-1] != '.')
+		tld--;
+
+	for (p = rule; p < tld; p++)
+		nlabels += *p == '.';
+
+	if ((depth = rule_depth(nlabels, flags)) > 255)
+		depth = 255;
+
+	len = rule + len - tld;
+	t->nrules++;
+
+	if ((t->ntlds + 1) * 2 > t->nslots && tld_table_grow(t))
+		return -1;
+
+	if (t->slot[it = tld_slot(t->slot, t->nslots, t->pool, tld, len, 0)]) {
+		if ((t->slot[it] & 0xFF) < (unsigned) depth)
+			t->slot[it] = (t->slot[it] & ~0xFFU) | (unsigned) depth;
+		return 0;
+	}
+
+	/* the pool offset has to fit into 24 bits */
+	if (t->pool_size + len + 1 > 0xFFFFFF)
+		return -1;
+
+	if (t->pool_size + len + 1 > t->max_pool) {
+		if (!(m = realloc(t->pool, t->max_pool = (t->max_pool ? t->max_pool * 2 : 8192) + len + 1)))
+			return -1;
+		t->pool = m;
+	}
+
+	t->slot[it] = (unsigned) (t->pool_size << 8) | (unsigned) depth;
+	t->ntlds++;
+
+	memcpy(t->pool + t->pool_size, tld, len);
+	t->pool[t->pool_size + len] = 0;
+	t->pool_size += len + 1;
+
+	return 0;
+}
+
+/* callback for the foreach function of an engine */
+static int tld_table_add_rule(const char *rule, size_t len, int flags, const unsigned char *payload, void *data)
+{
+	psl_tld_table_t *t = (psl_tld_table_t *) data;
+
+	(void) payload;
+
+	/* the number of strings may grow exponentially with the size of a (crafted) DAFSA */
+	if (t->nrules >= 1024 * 1024)
+		return -1;
+
+	return tld_table_add(t, rule, len, flags);
+}
+
+static void tld_table_free(psl_tld_table_t *t)
+{
+	free(t->slot);
+	free(t->pool);
+	memset(t, 0, sizeof(*t));
+}
+
+/* sets up the TLD table of 'psl' from the loaded rules, without a table the lookups are not bounded */
+static void tld_table_init(psl_ctx_t *psl)
+{
+	if (engine_foreach(psl, tld_table_add_rule, &psl->tlds) || !psl->tlds.ntlds)
+		tld_table_free(&psl->tlds);
+}
+
+/* adds the 'len' bytes of 'rule' with 'flags' (PSL_RULE_*) as rule 'id' to 't', an existing rule is kept */
+static int rule_table_add(psl_rule_table_t *t, unsigned id, const char *rule, size_t len, int flags)
+{
+	const char *prefix = flags & PSL_RULE_EXCEPTION ? "!" : flags & PSL_RULE_WILDCARD ? "*." : "";
+	size_t prefix_len = strlen(prefix), size;
+	void *m;
+
+	/* the number of strings may grow exponentially with the size of a (crafted) DAFSA */
+	if (++t->nadded > 1024 * 1024 || id >= 1024 * 1024)
+		return -1;
+
+	if (id >= t->max_rules) {
+		size = t->max_rules ? t->max_rules * 2 : 8192;
+		while (size <= id)
+			size *= 2;
+
+		if (!(m = realloc(t->entry, size * sizeof(unsigned))))
+			return -1;
+
+		t->entry = m;
+		memset(t->entry + t->max_rules, 0, (size - t->max_rules) * sizeof(unsigned));
+		t->max_rules = size;
+	}
+
+	if (t->entry[id])
+		return 0;
+
+	/* the pool offset has to fit into 24 bits */
+	if (t->pool_size + prefix_len + len + 1 > 0xFFFFFF)
+		return -1;
+
+	if (t->pool_size + prefix_len + len + 1 > t->max_pool) {
+		if (!(m = realloc(t->pool, t->max_pool = (t->max_pool ? t->max_pool * 2 : 65536) + prefix_len + len + 1)))
+			return -1;
+		t->pool = m;
+	}
+
+	t->entry[id] = (unsigned) (t->pool_size << 8) | 0x80 | (unsigned) flags;
+	if (id >= t->nrules)
+		t->nrules = id + 1;
+
+	memcpy(t->pool + t->pool_size, prefix, prefix_len);
+	memcpy(t->pool + t->pool_size + prefix_len, rule, len);
+	t->pool[t->pool_size + prefix_len + len] = 0;
+	t->pool_size += prefix_len + len + 1;
+
+	return 0;
+}
+
+/* callback for the foreach function of an engine */
+static int rule_table_add_payload(const char *rule, size_t len, int flags, const unsigned char *payload, void *data)
+{
+	psl_ctx_t *psl = (psl_ctx_t *) data;
+
+	(void) flags;
+
+	if (!payload)
+		return 0;
+
+	/* the UTF-8 variant of an international rule has the same ID, just the ASCII DAFSA lacks it */
+	if ((payload[0] & PAYLOAD_FLAG_PUNYCODE) && psl->utf8)
+		return 0;
+
+	return rule_table_add(&psl->rules, ((unsigned) payload[1] << 16) | (payload[2] << 8) | payload[3],
+		rule, len, payload[0] & 0x1F);
+}
+
+static void rule_table_free(psl_rule_table_t *t)
+{
+	free(t->entry);
+	free(t->pool);
+	memset(t, 0, sizeof(*t));
+}
+
+/*
+ * Looks up 'rule' (without '!' or '*.' prefix) in a PSL with rule IDs.
+ * Returns the rule ID and sets 'flags' (PSL_RULE_*) or returns -1 if there is no such rule.
+ */
+static int rule_lookup(const psl_ctx_t *psl, const char *rule, int *flags)
+{
+	int id = psl->engine->rule_id(psl->engine_data, rule, strlen(rule));
+
+	if (id < 0 || (size_t) id >= psl->rules.nrules || !psl->rules.entry[id])
+		return -1;
+
+	*flags = psl->rules.entry[id] & 0x7F;
+	return id;
+}
+
+/* returns the depth of the TLD of 'domain' in the TLD table of 'psl', see tld_depth() */
+static int tld_table_depth(const psl_ctx_t *psl, const char *domain, int nocase)
+{
+	const unsigned *slots = psl->tlds.slot;
+	const unsigned char *pool = psl->tlds.pool;
+	size_t nslots = psl->tlds.nslots, len;
+	const char *tld, *p;
+	unsigned slot;
+
+	if (psl == &builtin_psl) {
+		slots = _psl_tld_slots;
+		pool = _psl_tld_pool;
+#if defined ENABLE_BUILTIN && defined ENABLE_BUILTIN_COMPRESSED
+		nslots = _psl_tld_nslots;
+#else
+		nslots = countof(_psl_tld_slots);
+#endif
+	} else if (!slots)
+		return -1;
+
+	if ((tld = strrchr(domain, '.')))
+		tld++;
+	else
+		tld = domain;
+	len = strlen(tld);
+
+	if ((slot = slots[tld_slot(slots, nslots, pool, tld, len, nocase)]))
+		return slot & 0xFF;
+
+	/* a non-ASCII TLD is converted to punycode before the lookup if the PSL has no UTF-8 rules */
+	if (!psl->utf8) {
+		for (p = tld; *p; p++)
+			if (*p & 0x80)
+				return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the max. number of labels of a public suffix of 'domain', judged by its TLD,
+ * 0 if the TLD is not listed (just the prevailing '*' rule applies) or -1 if unknown.
+ */
+static int tld_depth(const psl_ctx_t *psl, const char *domain, int nocase)
+{
+	int depth = tld_table_depth(psl, domain, nocase), base_depth;
+
+	if (psl->base && depth >= 0) {
+		if ((base_depth = tld_depth(psl->base, domain, nocase)) < 0 || base_depth > depth)
+			return base_depth;
+	}
+
+	return depth;
+}
+
+/*
+ * Skips the leftmost labels of 'domain' while it has more than 'nlabels' labels,
+ * counted like is_public_suffix() does (ignoring a leading dot).
+ */
+static const char *skip_labels(const char *domain, int nlabels)
+{
+	const char *p;
+	int ndots = 0;
+
+	for (p = domain; *p; p++)
+		ndots += *p == '.';
+
+	while (ndots - (*domain == '.') >= nlabels && (p = strchr(domain, '.'))) {
+		domain = p + 1;
+		ndots--;
+	}
+
+	return domain;
+}
+
+/*
+ * The checks of is_public_suffix() that need no lookup. Returns 0 or 1 if they decide, else -1
+ * with a leading dot skipped in '*domain', its length in '*len' and its scan result in 'scan'.
+ */
+static int suffix_precheck(const psl_ctx_t *psl, const char **domain, size_t *len, int type, psl_scan_t *scan)
+{
+	int nlabels, depth;
+
+	/* this function should be called without leading dots, just make sure */
+	if (**domain == '.')
+		(*domain)++;
+
+	*len = strlen(*domain);
+	psl_scan_domain(*domain, *len, scan);
+
+	if (scan->ndots >= 255) /* weird input, avoid 8bit overflow */
+		return 0;
+
+	nlabels = (int) scan->ndots + 1;
+
+	if (nlabels == 1) {
+		/* TLD, this is the prevailing '*' match. If type excludes the '*' rule, continue.
+		 */
+		if (!(type & PSL_TYPE_NO_STAR_RULE))
+			return 1;
+	}
+
+	/*
+	 * No rule ends with a TLD that is not listed and no public suffix has more labels
+	 * than the deepest rule below its TLD. This avoids the lookups for most internal names.
+	 */
+	if ((depth = tld_depth(psl, *domain, type & PSL_TYPE_IGNORE_CASE)) >= 0 && nlabels > depth)
+		return 0;
+
+	/*
+	 * A domain with more labels than the longest rule (+1 for a wildcard) can't match.
+	 * The conversion to punycode never reduces the number of labels.
+	 */
+	if (psl->max_nlabels && nlabels > psl->max_nlabels + 1)
+		return 0;
+
+	return -1;
+}
+
+/*
+ * Returns the result for the flags 'rc' of the lookup of the whole domain
+ * or -1 if there is no rule and the parent domain has to be looked up.
+ */
+static int suffix_match(int rc, int type)
+{
+	if (rc == -1)
+		return -1;
+
+	/* check for correct rule type */
+	if (type == PSL_TYPE_ICANN && !(rc & PRIV_PSL_FLAG_ICANN))
+		return 0;
+	else if (type == PSL_TYPE_PRIVATE && !(rc & PRIV_PSL_FLAG_PRIVATE))
+		return 0;
+
+	if (rc & PRIV_PSL_FLAG_EXCEPTION)
+		return 0;
+
+	/* wildcard *.foo.bar implicitly make foo.bar a public suffix */
+	/* definitely a match, no matter if the found rule is a wildcard or not */
+	return 1;
+}
+
+/* Returns the result for the flags 'rc' of the lookup of the parent domain. */
+static int parent_match(int rc, int type)
+{
+	if (rc == -1)
+		return 0;
+
+	/* check for correct rule type */
+	if (type == PSL_TYPE_ICANN && !(rc & PRIV_PSL_FLAG_ICANN))
+		return 0;
+	else if (type == PSL_TYPE_PRIVATE && !(rc & PRIV_PSL_FLAG_PRIVATE))
+		return 0;
+
+	return (rc & PRIV_PSL_FLAG_WILDCARD) != 0;
+}
+
+static int is_public_suffix(const psl_ctx_t *psl, const char *domain, int type)
+{
+	psl_entry_t suffix;
+	psl_scan_t scan;
+	const char *p;
+	char *punycode = NULL, *lower = NULL, lower_buf[256];
+	size_t len, nlabels;
+	int need_conversion, is_ascii, rc, nocase = type & PSL_TYPE_IGNORE_CASE, flags[256];
+
+	if ((rc = suffix_precheck(psl, &domain, &len, type, &scan)) != -1)
+		return rc;
+
+	p = domain + len;
+	need_conversion = scan.nonascii; /* in case domain is non-ascii we need a toASCII conversion */
+	is_ascii = !scan.nonascii;
+	type &= ~(PSL_TYPE_NO_STAR_RULE | PSL_TYPE_IGNORE_CASE);
+
+	/* the engines match ASCII keys without case, everything else works on a lowercase copy */
+	if (nocase && !is_ascii) {
+		if (len < sizeof(lower_buf))
+			lower = lower_buf;
+		else if (!(lower = malloc(len + 1)))
+			return 0;
+
+		memcpy(lower, domain, len + 1);
+		psl_scan_tolower_ascii(lower, len);
+		domain = lower;
+		p = domain + len;
+		nocase = 0;
+	}
+
+	if (psl->utf8)
+		need_conversion = 0;
+
+	if (need_conversion) {
+		psl_idna_t *idna = psl_idna_open();
+
+		/* just convert the non-ASCII labels */
+		if (psl_idna_labels_toASCII(idna, domain, &punycode) == 0) {
+			suffix.label = punycode;
+			suffix.length = strlen(punycode);
+			is_ascii = 1;
+		} else {
+			/* fallback */
+
+			suffix.label = domain;
+			suffix.length = p - suffix.label;
+		}
+
+		psl_idna_close(idna);
+	} else {
+		suffix.label = domain;
+		suffix.length = p - suffix.label;
+	}
+
+	nlabels = scan.ndots + 1; /* the conversion to punycode keeps the labels */
+
+	if (is_ascii && engine_lookup_labels(psl, suffix.label, suffix.length, nocase, flags, nlabels) == 0) {
+		/* the rules of the domain and of its parent from a single traversal */
+		if ((rc = suffix_match(flags[nlabels - 1], type)) == -1)
+			rc = nlabels > 1 ? parent_match(flags[nlabels - 2], type) : 0;
+	} else if ((rc = suffix_match(engine_lookup(psl, suffix.label, suffix.length, is_ascii, nocase), type)) == -1) {
+		if ((suffix.label = strchr(suffix.label, '.'))) {
+			suffix.label++;
+			suffix.length = strlen(suffix.label);
+
+			rc = parent_match(engine_lookup(psl, suffix.label, suffix.length, is_ascii, nocase), type);
+		} else
+			rc = 0;
+	}
+
+	if (punycode)
+		free(punycode);
+	if (lower != lower_buf)
+		free(lower);
+	return rc;
+}
+
+/*
+ * Returns the longest suffix of 'domain' that is a public suffix (see is_public_suffix()) or the last label
+ * of 'domain' if there is none, the same as checking the suffixes from left to right, but with a single
+ * engine_lookup_labels() for all of them.
+ * Returns NULL if the engines of 'psl' don't support that or 'domain' has non-ASCII characters or empty labels,
+ * these are left to is_public_suffix().
+ */
+static const char *longest_public_suffix(const psl_ctx_t *psl, const char *domain, int type)
+{
+	const char *label[256], *p;
+	size_t nlabels = 0, it;
+	int flags[256], rc;
+
+	if (*domain == '.')
+		return NULL;
+
+	label[nlabels++] = domain;
+
+	for (p = domain; *p; p++) {
+		if (*p & 0x80)
+			return NULL;
+
+		if (*p == '.') {
+			if (p[1] == '.' || nlabels >= countof(label))
+				return NULL;
+
+			label[nlabels++] = p + 1;
+		}
+	}
+
+	if (engine_lookup_labels(psl, domain, p - domain, type & PSL_TYPE_IGNORE_CASE, flags, nlabels))
+		return NULL;
+
+	/* the last label is returned anyway, whether it is a public suffix or not */
+	type &= ~(PSL_TYPE_NO_STAR_RULE | PSL_TYPE_IGNORE_CASE);
+
+	for (it = nlabels - 1; it > 0; it--) {
+		if ((rc = suffix_match(flags[it], type)) == -1)
+			rc = parent_match(flags[it - 1], type);
+
+		if (rc)
+			return label[nlabels - 1 - it];
+	}
+
+	return label[nlabels - 1];
+}
+
+/**
+ * psl_is_public_suffix:
+ * @psl: PSL context
+ * @domain: Domain string
+ *
+ * This function checks if @domain is a public suffix by the means of the
+ * [Mozilla Public Suffix List](https://publicsuffix.org).
+ *
+ * For cookie domain checking see psl_is_cookie_domain_acceptable().
+ *
+ * International @domain names have to be either in UTF-8 (lowercase + NFKC) or in ASCII/ACE format (punycode).
+ * Other encodings likely result in incorrect return values.
+ * Use helper function psl_str_to_utf8lower() for normalization @domain.
+ *
+ * @psl is a context returned by either psl_load_file(), psl_load_fp() or
+ * psl_builtin().
+ *
+ * Returns: 1 if domain is a public suffix, 0 if not.
+ *
+ * Since: 0.1
+ */
+int psl_is_public_suffix(const psl_ctx_t *psl, const char *domain)
+{
+	if (!psl || !domain)
+		return 1;
+
+	return is_public_suffix(psl, domain, PSL_TYPE_ANY);
+}
+
+/**
+ * psl_is_public_suffix2:
+ * @psl: PSL context
+ * @domain: Domain string
+ * @type: Domain type
+ *
+ * This function checks if @domain is a public suffix by the means of the
+ * [Mozilla Public Suffix List](https://publicsuffix.org).
+ *
+ * @type specifies the PSL section where to perform the lookup. Valid values are
+ * %PSL_TYPE_PRIVATE, %PSL_TYPE_ICANN, %PSL_TYPE_NO_STAR_RULE, and %PSL_TYPE_ANY.
+ *
+ * %PSL_TYPE_NO_STAR_RULE switches of the 'prevailing star rule' (see
+ * [List](https://publicsuffix.org/list) under 'Algorithm' 2.).
+ * Applying the flag means that TLDs not explicitly listed in the PSL are *not* treated as public suffixes.
+ *
+ * %PSL_TYPE_IGNORE_CASE (since 0.22.0) lets ASCII letters in @domain match regardless of their case,
+ * so mixed-case ASCII domains don't have to be converted to lowercase before.
+ *
+ * International @domain names have to be either in UTF-8 (lowercase + NFKC) or in ASCII/ACE format (punycode).
+ * Other encodings likely result in incorrect return values.
+ * Use helper function psl_str_to_utf8lower() for normalization @domain.
+ *
+ * @psl is a context returned by either psl_load_file(), psl_load_fp() or
+ * psl_builtin().
+ *
+ * Returns: 1 if domain is a public suffix, 0 if not.
+ *
+ * Since: 0.1
+ */
+int psl_is_public_suffix2(const psl_ctx_t *psl, const char *domain, int type)
+{
+	if (!psl || !domain)
+		return 1;
+
+	return is_public_suffix(psl, domain, type);
+}
+
+/**
+ * psl_unregistrable_domain:
+ * @psl: PSL context
+ * @domain: Domain string
+ *
+ * This function finds the longest public suffix part of @domain by the means
+ * of the [Mozilla Public Suffix List](https://publicsuffix.org).
+ *
+ * International @domain names have to be either in UTF-8 (lowercase + NFKC) or in ASCII/ACE format (punycode).
+ * Other encodings likely result in incorrect return values.
+ * Use helper function psl_str_to_utf8lower() for normalization @domain.
+ *
+ * @psl is a context returned by either psl_load_file(), psl_load_fp() or
+ * psl_builtin().
+ *
+ * Returns: Pointer to longest public suffix part of @domain or %NULL if @domain
+ * does not contain a public suffix (or if @psl is %NULL).
+ *
+ * Since: 0.1
+ */
+const char *psl_unregistrable_domain(const psl_ctx_t *psl, const char *domain)
+{
+	return psl_unregistrable_domain2(psl, domain, 0);
+}
+
+/**
+ * psl_registrable_domain:
+ * @psl: PSL context
+ * @domain: Domain string
+ *
+ * This function finds the shortest private suffix part of @domain by the means
+ * of the [Mozilla Public Suffix List](https://publicsuffix.org).
+ *
+ * International @domain names have to be either in UTF-8 (lowercase + NFKC) or in ASCII/ACE format (punycode).
+ * Other encodings likely result in incorrect return values.
+ * Use helper function psl_str_to_utf8lower() for normalization @domain.
+ *
+ * @psl is a context returned by either psl_load_file(), psl_load_fp() or
+ * psl_builtin().
+ *
+ * Returns: Pointer to shortest private suffix part of @domain or %NULL if @domain
+ * does not contain a private suffix (or if @psl is %NULL).
+ *
+ * Since: 0.1
+ */
+const char *psl_registrable_domain(const psl_ctx_t *psl, const char *domain)
+{
+	return psl_registrable_domain2(psl, domain, 0);
+}
+
+/**
+ * psl_unregistrable_domain2:
+ * @psl: PSL context
+ * @domain: Domain string
+ * @type: Domain type
+ *
+ * This function works like psl_unregistrable_domain(), but checks the suffixes of @domain
+ * with @type as described at psl_is_public_suffix2().
+ *
+ * With %PSL_TYPE_IGNORE_CASE, mixed-case ASCII domains don't have to be converted to lowercase before.
+ *
+ * Returns: Pointer to longest public suffix part of @domain or %NULL if @domain
+ * does not contain a public suffix (or if @psl is %NULL).
+ *
+ * Since: 0.22.0
+ */
+const char *psl_unregistrable_domain2(const psl_ctx_t *psl, const char *domain, int type)
+{
+	int nlabels = 0, depth;
+	const char *p;
+
+	if (!psl || !domain)
+		return NULL;
+
+	/*
+	 * In the main loop we introduce a O(N^2) behavior to avoid code duplication.
+	 * To avoid nasty CPU hogging, we limit the lookup to max. 8 domain labels to the right.
+	 */
+	for (p = domain + strlen(domain) - 1; p >= domain; p--) {
+		if (*p == '.' && ++nlabels > 8) {
+			domain = p + 1;
+			break;
+		}
+	}
+
+	/* no public suffix has more labels than the deepest rule below its TLD */
+	if ((depth = tld_depth(psl, domain, type & PSL_TYPE_IGNORE_CASE)) >= 0) {
+		domain = skip_labels(domain, depth ? depth : 1);
+
+		/* a TLD that is not listed or has no deeper rules is the public suffix itself */
+		if (depth <= 1 && !(type & PSL_TYPE_NO_STAR_RULE))
+			return domain;
+	}
+
+	/* the rules of all suffixes from a single traversal */
+	if ((p = longest_public_suffix(psl, domain, type)))
+		return p;
+
+	/*
+	 *  We check from left to right to catch special PSL entries like 'forgot.his.name':
+	 *   'forgot.his.name' and 'name' are in the PSL while 'his.name' is not.
+	 */
+
+	while (!is_public_suffix(psl, domain, type)) {
+		if ((domain = strchr(domain, '.')))
+			domain++;
+		else
+			break; /* prevent endless loop if is_public_suffix() is broken. */
+	}
+
+	return domain;
+}
+
+/**
+ * psl_registrable_domain2:
+ * @psl: PSL context
+ * @domain: Domain string
+ * @type: Domain type
+ *
+ * This function works like psl_registrable_domain(), but checks the suffixes of @domain
+ * with @type as described at psl_is_public_suffix2().
+ *
+ * With %PSL_TYPE_IGNORE_CASE, mixed-case ASCII domains don't have to be converted to lowercase before.
+ *
+ * Returns: Pointer to shortest private suffix part of @domain or %NULL if @domain
+ * does not contain a private suffix (or if @psl is %NULL).
+ *
+ * Since: 0.22.0
+ */
+const char *psl_registrable_domain2(const psl_ctx_t *psl, const char *domain, int type)
+{
+	const char *p, *regdom = NULL;
+	int nlabels = 0, depth;
+
+	if (!psl || !domain || *domain == '.')
+		return NULL;
+
+	/*
+	 * In the main loop we introduce a O(N^2) behavior to avoid code duplication.
+	 * To avoid nasty CPU hogging, we limit the lookup to max. 8 domain labels to the right.
+	 */
+	for (p = domain + strlen(domain) - 1; p >= domain; p--) {
+		if (*p == '.' && ++nlabels > 8) {
+			domain = p + 1;
+			break;
+		}
+	}
+
+	/*
+	 * No public suffix has more labels than the deepest rule below its TLD,
+	 * so we start with the label left of the longest possible public suffix.
+	 */
+	if ((depth = tld_depth(psl, domain, type & PSL_TYPE_IGNORE_CASE)) >= 0) {
+		if ((p = skip_labels(domain, depth ? depth : 1)) > domain) {
+			for (regdom = p - 1; regdom > domain && regdom[-1] != '.'; regdom--)
+				;
+			domain = regdom;
+		}
+
+		/* a TLD that is not listed or has no deeper rules is the public suffix itself */
+		if (depth <= 1 && !(type & PSL_TYPE_NO_STAR_RULE))
+			return regdom;
+	}
+
+	/* the rules of all suffixes from a single traversal, the registrable domain has one more label */
+	if ((p = longest_public_suffix(psl, domain, type))) {
+		if (p > domain) {
+			for (regdom = p - 1; regdom > domain && regdom[-1] != '.'; regdom--)
+				;
+		}
+
+		return regdom;
+	}
+
+	/*
+	 *  We check from left to right to catch special PSL entries like 'forgot.his.name':
+	 *   'forgot.his.name' and 'name' are in the PSL while 'his.name' is not.
+	 */
+
+	while (!is_public_suffix(psl, domain, type)) {
+		if ((p = strchr(domain, '.'))) {
+			regdom = domain;
+			domain = p + 1;
+		} else
+			break; /* prevent endless loop if is_public_suffix() is broken. */
+	}
+
+	return regdom;
+}
+
+/**
+ * psl_unregistrable_domain_unicode:
+ * @psl: PSL context
+ * @domain: Domain string
+ * @buf: Buffer for the result
+ * @bufsize: Size of @buf in bytes
+ *
+ * This function works like psl_unregistrable_domain(), but the result is copied into @buf
+ * with all ACE labels (punycode, 'xn--' prefix) decoded into UTF-8 (U-labels).
+ * Other labels are copied unchanged.
+ *
+ * No IDNA library is needed for the decoding.
+ *
+ * Returns: @buf or %NULL if @domain does not contain a public suffix, if an ACE label is not
+ * valid punycode or if @buf is too small.
+ *
+ * Since: 0.22.0
+ */
+const char *psl_unregistrable_domain_unicode(const psl_ctx_t *psl, const char *domain, char *buf, size_t bufsize)
+{
+	if (!buf || !(domain = psl_unregistrable_domain(psl, domain)))
+		return NULL;
+
+	return domain_to_unicode(domain, buf, bufsize);
+}
+
+/**
+ * psl_registrable_domain_unicode:
+ * @psl: PSL context
+ * @domain: Domain string
+ * @buf: Buffer for the result
+ * @bufsize: Size of @buf in bytes
+ *
+ * This function works like psl_registrable_domain(), but the result is copied into @buf
+ * with all ACE labels (punycode, 'xn--' prefix) decoded into UTF-8 (U-labels).
+ * Other labels are copied unchanged.
+ *
+ * No IDNA library is needed for the decoding.
+ *
+ * Returns: @buf or %NULL if @domain does not contain a private suffix, if an ACE label is not
+ * valid punycode or if @buf is too small.
+ *
+ * Since: 0.22.0
+ */
+const char *psl_registrable_domain_unicode(const psl_ctx_t *psl, const char *domain, char *buf, size_t bufsize)
+{
+	if (!buf || !(domain = psl_registrable_domain(psl, domain)))
+		return NULL;
+
+	return domain_to_unicode(domain, buf, bufsize);
+}
+
+/* maps the rest of the file 'fp' read-only into memory, returns 0 on success */
+static int blob_map(psl_blob_t *blob, FILE *fp)
+{
+#ifdef HAVE_MMAP
+	struct stat st;
+	long offset;
+	void *m;
+	int fd;
+
+	/* the data starts behind the header line that has been read by fgets() */
+	if ((fd = fileno(fp)) < 0 || (offset = ftell(fp)) < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode))
+		return -1;
+
+	if (st.st_size <= offset || (off_t) (size_t) st.st_size != st.st_size)
+		return -1;
+
+	if ((m = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		return -1;
+
+	blob->mem = m;
+	blob->mem_size = (size_t) st.st_size;
+	blob->mapped = 1;
+	blob->data = (const unsigned char *) m + offset;
+	blob->size = blob->mem_size - offset;
+
+	return 0;
+#else
+	(void) blob;
+	(void) fp;
+	return -1;
+#endif
+}
+
+/* reads the rest of the file 'fp' into memory, returns 0 on success */
+static int blob_read(psl_blob_t *blob, FILE *fp)
+{
+	unsigned char *buf = NULL;
+	void *m;
+	size_t size = 65536, n, len = 0;
+
+	if (!(buf = malloc(size)))
+		return -1;
+
+	while ((n = fread(buf + len, 1, size - len, fp)) > 0) {
+		len += n;
+		if (len >= size) {
+			if (!(m = realloc(buf, size *= 2))) {
+				free(buf);
+				return -1;
+			}
+			buf = m;
+		}
+	}
+
+	/* release unused memory */
+	if ((m = realloc(buf, len)))
+		buf = m;
+	else if (!len)
+		buf = NULL; /* realloc() just free'd buf */
+
+	blob->mem = buf;
+	blob->data = buf;
+	blob->mem_size = blob->size = len;
+
+	return 0;
+}
+
+void psl_blob_free(psl_blob_t *blob)
+{
+#ifdef HAVE_MMAP
+	if (blob->mapped)
+		munmap(blob->mem, blob->mem_size);
+	else
+#endif
+		free(blob->mem);
+
+	memset(blob, 0, sizeof(*blob));
+}
+
+/* the input of load(), either a FILE pointer or 'len' bytes of 'data' */
+typedef struct {
+	FILE
+		*fp;
+	const char
+		*data;
+	size_t
+		len;
+} psl_reader_t;
+
+/* reads the next line like fgets() */
+static char *reader_gets(psl_reader_t *r, char *buf, size_t size)
+{
+	size_t n = 0;
+
+	if (r->fp)
+		return fgets(buf, (int) size, r->fp);
+
+	if (!r->len)
+		return NULL;
+
+	while (n < size - 1 && n < r->len) {
+		buf[n] = r->data[n];
+		if (buf[n++] == '\n')
+			break;
+	}
+
+	buf[n] = 0;
+	r->data += n;
+	r->len -= n;
+
+	return buf;
+}
+
+/*
+ * Replaces the engine of 'psl' by the one selected with 'engine', built from the rules of the current engine.
+ * The rule IDs of payloads are kept. Returns 0 on success, also if 'engine' is PSL_ENGINE_AUTO or 'current'
+ * or if the JIT engine is not supported.
+ */
+static int engine_convert(psl_ctx_t *psl, psl_load_engine_t engine, psl_load_engine_t current)
+{
+	const psl_engine_t *e;
+	void *data;
+
+	if (engine == PSL_ENGINE_AUTO || engine == current)
+		return 0;
+
+	switch (engine) {
+	case PSL_ENGINE_VECTOR: e = &vector_engine; break;
+	case PSL_ENGINE_MPH: e = &psl_mph_engine; break;
+	case PSL_ENGINE_DARRAY: e = &psl_darray_engine; break;
+	case PSL_ENGINE_JIT: e = &psl_jit_engine; break;
+	default: return -1; /* a DAFSA or LOUDS trie is generated by psl-make-dafsa */
+	}
+
+	/* without JIT support, the interpreting engine is kept */
+	if (!(data = e->build(psl->engine, psl->engine_data)))
+		return engine == PSL_ENGINE_JIT ? 0 : -1;
+
+	psl->engine->free(psl->engine_data);
+	psl->engine = e;
+	psl->engine_data = data;
+
+	return 0;
+}
+
+/* the binary file formats of psl-make-dafsa that are opened by an engine, by the prefix of their header line */
+static const struct {
+	const char
+		*header;
+	const psl_engine_t
+		*engine;
+	psl_load_engine_t
+		id;
+} engine_files[] = {
+	{ ".MPH@PSL_", &psl_mph_engine, PSL_ENGINE_MPH },
+	{ ".LOUDS@PSL_", &psl_louds_engine, PSL_ENGINE_LOUDS },
+};
+
+/*
+ * Loads a PSL file or DAFSA file from 'reader', a DAFSA just from a FILE pointer.
+ * With 'base_psl', the rules of a PSL file are an overlay to 'base_psl'.
+ */
+static psl_ctx_t *load(psl_reader_t *reader, const psl_ctx_t *base_psl, const psl_load_options_t *options)
+{
+	psl_ctx_t *psl;
+	psl_entry_t suffix, *suffixp;
+	psl_vector_t *suffixes;
+	char buf[256], *linep, *p;
+	int type = 0, is_dafsa, nrules = 0, rules_failed = 0;
+	size_t it;
+	psl_idna_t *idna;
+
+	if (!(psl = calloc(1, sizeof(psl_ctx_t))))
+		return NULL;
+
+	if ((options->sections & PSL_TYPE_ANY) != PSL_TYPE_ANY) {
+		if (options->sections & PSL_TYPE_ICANN)
+			psl->sections = PRIV_PSL_FLAG_ICANN;
+		else if (options->sections & PSL_TYPE_PRIVATE)
+			psl->sections = PRIV_PSL_FLAG_PRIVATE;
+	}
+
+	/* read first line to allow ASCII / DAFSA detection */
+	if (!(linep = reader_gets(reader, buf, sizeof(buf) - 1)))
+		goto fail;
+
+	is_dafsa = strlen(buf) == 16 && !strncmp(buf, ".DAFSA@PSL_", 11);
+
+	for (it = 0; strlen(buf) == 16 && it < countof(engine_files); it++) {
+		const psl_engine_t *e = engine_files[it].engine;
+		psl_engine_info_t info;
+		psl_blob_t blob;
+
+		if (strncmp(buf, engine_files[it].header, strlen(engine_files[it].header)))
+			continue;
+
+		/* these file formats (psl-make-dafsa --output-format=...) have version 0 */
+		if (atoi(buf + strlen(engine_files[it].header)) != 0 || !reader->fp || base_psl)
+			goto fail;
+
+		memset(&blob, 0, sizeof(blob));
+		if (!(options->memory == PSL_MEMORY_MMAP && blob_map(&blob, reader->fp) == 0) && blob_read(&blob, reader->fp))
+			goto fail;
+
+		if (!(psl->engine_data = e->open(&blob, &info))) {
+			psl_blob_free(&blob);
+			goto fail;
+		}
+
+		psl->engine = e;
+		psl->utf8 = !!info.utf8;
+		psl->max_nlabels = info.max_nlabels;
+		psl->nsuffixes = psl->nexceptions = psl->nwildcards = -1;
+
+		if (info.payload && engine_foreach(psl, rule_table_add_payload, psl))
+			rule_table_free(&psl->rules);
+
+		if (engine_convert(psl, options->engine, engine_files[it].id))
+			goto fail;
+
+		tld_table_init(psl);
+
+		return psl;
+	}
+
+	if (is_dafsa) {
+		psl_dafsa_t *d;
+		int version = atoi(buf + 11);
+
+		/*
+		 * version 1 may contain dense tables (psl-make-dafsa --dense-threshold),
+		 * version 2 has payloads (psl-make-dafsa --payload),
+		 * plus 4 if it may contain vector nodes (psl-make-dafsa --vector-threshold),
+		 * plus 8 if the labels of the strings are in reverse order (psl-make-dafsa --reverse-labels)
+		 */
+		if (version < 0 || version > 14 || (version & 3) == 3 || !reader->fp || base_psl)
+			goto fail;
+
+		if (!(d = calloc(1, sizeof(psl_dafsa_t))))
+			goto fail;
+
+		psl->engine = &dafsa_engine;
+		psl->engine_data = d;
+
+		if (!(options->memory == PSL_MEMORY_MMAP && blob_map(&d->blob, reader->fp) == 0) && blob_read(&d->blob, reader->fp))
+			goto fail;
+
+		psl->utf8 = !!GetUtfMode(d->blob.data, d->blob.size);
+		d->payload = !!(version & 2);
+		d->reversed = !!(version & 8);
+		d->valid = !!ValidateDafsa(d->blob.data, d->blob.size, d->payload ? PAYLOAD_SIZE : 0);
+		psl->max_nlabels = GetMaxLabels(d->blob.data, d->blob.size);
+		psl->nsuffixes = psl->nexceptions = psl->nwildcards = -1;
+
+		if (d->payload && engine_foreach(psl, rule_table_add_payload, psl))
+			rule_table_free(&psl->rules);
+
+		if (engine_convert(psl, options->engine, PSL_ENGINE_DAFSA))
+			goto fail;
+
+		tld_table_init(psl);
+
+		return psl;
+	}
+
+	/* a DAFSA or LOUDS trie is generated by psl-make-dafsa, not at runtime */
+	if (options->engine == PSL_ENGINE_DAFSA || options->engine == PSL_ENGINE_LOUDS)
+		goto fail;
+
+	/*
+	 *  as of 02.11.2012, the list at https://publicsuffix.org/list/ contains ~6000 rules and 40 exceptions.
+	 *  as of 19.02.2014, the list at https://publicsuffix.org/list/ contains ~6500 rules and 19 exceptions.
+	 *  as of 07.10.2018, the list at https://publicsuffix.org/list/ contains ~8600 rules and 8 exceptions.
+	 */
+	if (!(suffixes = vector_alloc(8*1024, suffix_compare_array)))
+		goto fail;
+
+	psl->engine = &vector_engine;
+	psl->engine_data = suffixes;
+	psl->utf8 = 1; /* we put UTF-8 and punycode rules in the lookup vector */
+
+	idna = psl_idna_open();
+
+	do {
+		while (isspace_ascii(*linep)) linep++; /* ignore leading whitespace */
+		if (!*linep) continue; /* skip empty lines */
+
+		if (*linep == '/' && linep[1] == '/') {
+			if (!type) {
+				if (strstr(linep + 2, "===BEGIN ICANN DOMAINS==="))
+					type = PRIV_PSL_FLAG_ICANN;
+				else if (!type && strstr(linep + 2, "===BEGIN PRIVATE DOMAINS==="))
+					type = PRIV_PSL_FLAG_PRIVATE;
+			}
+			else if (type == PRIV_PSL_FLAG_ICANN && strstr(linep + 2, "===END ICANN DOMAINS==="))
+				type = 0;
+			else if (type == PRIV_PSL_FLAG_PRIVATE && strstr(linep + 2, "===END PRIVATE DOMAINS==="))
+				type = 0;
+
+			continue; /* skip comments */
+		}
+
+		/* parse suffix rule */
+		for (p = linep; *linep && !isspace_ascii(*linep);) linep++;
+		*linep = 0;
+
+		if (*p == '!') {
+			p++;
+			suffix.flags = PRIV_PSL_FLAG_EXCEPTION | type;
+		} else if (*p == '*') {
+			if (*++p != '.') {
+				/* fprintf(stderr, "Unsupported kind of rule (ignored): %s\n", p - 1); */
+				continue;
+			}
+			p++;
+			/* wildcard *.foo.bar implicitly make foo.bar a public suffix */
+			suffix.flags = PRIV_PSL_FLAG_WILDCARD | type;
+		} else {
+			suffix.flags = PRIV_PSL_FLAG_PLAIN | type;
+		}
+
+		/* the rules of the other sections keep their numbers as rule IDs */
+		if (psl->sections && !(type & psl->sections)) {
+			nrules++;
+			continue;
+		}
+
+		if (suffix.flags & PRIV_PSL_FLAG_EXCEPTION) {
+			psl->nexceptions++;
+		} else {
+			psl->nsuffixes++;
+			if (suffix.flags & PRIV_PSL_FLAG_WILDCARD)
+				psl->nwildcards++;
+		}
+
+		if (suffix_init(&suffix, p, linep - p) == 0) {
+			int index;
+
+			if ((index = vector_find(suffixes, &suffix)) >= 0) {
+				/* Found existing entry:
+				 * Combination of exception and plain rule is ambiguous
+				 * !foo.bar
+				 * foo.bar
+				 *
+				 * Allowed:
+				 * !foo.bar + *.foo.bar
+				 * foo.bar + *.foo.bar
+				 *
+				 * We do not check here, let's do it later.
+				 */
+
+				suffixp = vector_get(suffixes, index);
+				suffixp->flags |= suffix.flags;
+			} else {
+				/* New entry, the rule ID is the number of the rule in the file */
+				suffix.id = nrules;
+				if (rule_table_add(&psl->rules, (unsigned) nrules++, p, linep - p,
+					(suffix.flags & 0x0F) | (str_is_ascii(p) ? 0 : PSL_RULE_IDN)))
+				{
+					rules_failed = 1;
+				}
+
+				suffixp = vector_get(suffixes, vector_add(suffixes, &suffix));
+			}
+
+			if (suffixp) {
+				suffixp->label = suffixp->label_buf; /* set label to changed address */
+				add_punycode_if_needed(idna, suffixes, suffixp);
 			}
 		}
+	} while ((linep = reader_gets(reader, buf, sizeof(buf))));
+
+	vector_sort(suffixes);
+	tld_table_init(psl);
+
+	/* the rules are sorted by the number of labels, most labels first */
+	if ((suffixp = vector_get(suffixes, 0)))
+		psl->max_nlabels = suffixp->nlabels;
+
+	if (engine_convert(psl, options->engine, PSL_ENGINE_VECTOR)) {
+		psl_idna_close(idna);
+		goto fail;
+	}
+
+	if (base_psl) {
+		/* the overlay is looked up together with 'base_psl', see engine_lookup() and tld_depth() */
+		psl->base = base_psl;
+		psl->utf8 = base_psl->utf8;
+
+		if (!base_psl->max_nlabels || psl->max_nlabels < base_psl->max_nlabels)
+			psl->max_nlabels = base_psl->max_nlabels;
+
+		if (psl_suffix_count(base_psl) < 0) {
+			psl->nsuffixes = psl->nexceptions = psl->nwildcards = -1;
+		} else {
+			psl->nsuffixes += psl_suffix_count(base_psl);
+			psl->nexceptions += psl_suffix_exception_count(base_psl);
+			psl->nwildcards += psl_suffix_wildcard_count(base_psl);
+		}
+
+		/* the rule IDs of an overlay would clash with the ones of its base */
+		rules_failed = 1;
 	}
 
-suffix_no:
-	if (punycode)
-		free(punycode);
-	return 0;
+	if (rules_failed)
+		rule_table_free(&psl->rules);
 
-suffix_yes:
-	if (punycode)
-		free(punycode);
-	return 1;
+	psl_idna_close(idna);
+
+	return psl;
+
+fail:
+	psl_free(psl);
+	return NULL;
 }
 
 /**
- * psl_is_public_suffix:
- * @psl: PSL context
- * @domain: Domain string
- *
- * This function checks if @domain is a public suffix by the means of the
- * [Mozilla Public Suffix List](https://publicsuffix.org).
- *
- * For cookie domain checking see psl_is_cookie_domain_acceptable().
+ * psl_load_file:
+ * @fname: Name of PSL file
  *
- * International @domain names have to be either in UTF-8 (lowercase + NFKC) or in ASCII/ACE format (punycode).
- * Other encodings likely result in incorrect return values.
- * Use helper function psl_str_to_utf8lower() for normalization @domain.
+ * This function loads the public suffixes file named @fname.
+ * To free the allocated resources, call psl_free().
  *
- * @psl is a context returned by either psl_load_file(), psl_load_fp() or
- * psl_builtin().
+ * The suffixes are expected to be UTF-8 encoded (lowercase + NFKC) if they are international.
  *
- * Returns: 1 if domain is a public suffix, 0 if not.
+ * Returns: Pointer to a PSL context or %NULL on failure.
  *
  * Since: 0.1
  */
-int psl_is_public_suffix(const psl_ctx_t *psl, const char *domain)
+psl_ctx_t *psl_load_file(const char *fname)
 {
-	if (!psl || !domain)
-		return 1;
-
-	return is_public_suffix(psl, domain, PSL_TYPE_ANY);
+	return psl_load_ex(fname, NULL);
 }
 
 /**
- * psl_is_public_suffix2:
- * @psl: PSL context
- * @domain: Domain string
- * @type: Domain type
- *
- * This function checks if @domain is a public suffix by the means of the
- * [Mozilla Public Suffix List](https://publicsuffix.org).
- *
- * @type specifies the PSL section where to perform the lookup. Valid values are
- * %PSL_TYPE_PRIVATE, %PSL_TYPE_ICANN, %PSL_TYPE_NO_STAR_RULE, and %PSL_TYPE_ANY.
- *
- * %PSL_TYPE_NO_STAR_RULE switches of the 'prevailing star rule' (see
- * [List](https://publicsuffix.org/list) under 'Algorithm' 2.).
- * Applying the flag means that TLDs not explicitly listed in the PSL are *not* treated as public suffixes.
+ * psl_load_fp:
+ * @fp: %FILE pointer
  *
- * International @domain names have to be either in UTF-8 (lowercase + NFKC) or in ASCII/ACE format (punycode).
- * Other encodings likely result in incorrect return values.
- * Use helper function psl_str_to_utf8lower() for normalization @domain.
+ * This function loads the public suffixes from a %FILE pointer.
+ * To free the allocated resources, call psl_free().
  *
- * @psl is a context returned by either psl_load_file(), psl_load_fp() or
- * psl_builtin().
+ * The suffixes are expected to be UTF-8 encoded (lowercase + NFKC) if they are international.
  *
- * Returns: 1 if domain is a public suffix, 0 if not.
+ * Returns: Pointer to a PSL context or %NULL on failure.
  *
  * Since: 0.1
  */
-int psl_is_public_suffix2(const psl_ctx_t *psl, const char *domain, int type)
+psl_ctx_t *psl_load_fp(FILE *fp)
 {
-	if (!psl || !domain)
-		return 1;
+	static const psl_load_options_t options;
+	psl_reader_t reader = { NULL, NULL, 0 };
 
-	return is_public_suffix(psl, domain, type);
+	if (!fp)
+		return NULL;
+
+	reader.fp = fp;
+
+	return load(&reader, NULL, &options);
 }
 
 /**
- * psl_unregistrable_domain:
- * @psl: PSL context
- * @domain: Domain string
+ * psl_load_ex:
+ * @fname: Name of PSL file, DAFSA file, MPH file or LOUDS file
+ * @options: Load options or %NULL for the defaults
  *
- * This function finds the longest public suffix part of @domain by the means
- * of the [Mozilla Public Suffix List](https://publicsuffix.org).
+ * This function works like psl_load_file(), but lets you choose how the rules are kept in memory.
+ * To free the allocated resources, call psl_free().
  *
- * International @domain names have to be either in UTF-8 (lowercase + NFKC) or in ASCII/ACE format (punycode).
- * Other encodings likely result in incorrect return values.
- * Use helper function psl_str_to_utf8lower() for normalization @domain.
+ * @options.size has to be set to sizeof(psl_load_options_t).
  *
- * @psl is a context returned by either psl_load_file(), psl_load_fp() or
- * psl_builtin().
+ * @options.engine selects the lookup engine. The DAFSA engine needs a DAFSA file generated by psl-make-dafsa,
+ * the vector engine can also be set up from a DAFSA file (e.g. to compare the engines).
+ * The minimal perfect hash engine answers each probe with a single hash and two memory reads plus
+ * the final string comparison. It uses MPH files (psl-make-dafsa --output-format=mph) as they are
+ * and is built at load time from PSL and DAFSA files.
+ * The double-array trie engine is built at load time from any of these files. It takes about ten times
+ * the memory of the DAFSA, but each of its transitions is a single array lookup.
+ * The LOUDS trie engine needs a LOUDS file (psl-make-dafsa --output-format=louds --encoding=ascii),
+ * a succinct trie that takes less memory than the DAFSA at the cost of slower lookups.
+ * The JIT engine compiles the rules of any of these files into machine code at load time, for
+ * long-running processes with many lookups. It is only available if libpsl has been configured with
+ * -Djit=true (--enable-jit) and runs on x86-64, else (or if the system doesn't allow executable
+ * memory) the engine the file has been loaded with is kept, see psl_engine_name().
  *
- * Returns: Pointer to longest public suffix part of @domain or %NULL if @domain
- * does not contain a public suffix (or if @psl is %NULL).
+ * With @options.memory set to %PSL_MEMORY_MMAP, a DAFSA, MPH or LOUDS file is mapped read-only into memory
+ * instead of being copied, so processes loading the same file share its pages.
+ * Where mmap() is not available, the data is copied.
  *
- * Since: 0.1
+ * With @options.sections set to %PSL_TYPE_ICANN or %PSL_TYPE_PRIVATE, just the rules of that section
+ * of the PSL are used, e.g. to check cookie domains against the ICANN rules only.
+ *
+ * Returns: Pointer to a PSL context or %NULL on failure, also if @options.size is not known.
+ *
+ * Since: 0.22.0
  */
-const char *psl_unregistrable_domain(const psl_ctx_t *psl, const char *domain)
+psl_ctx_t *psl_load_ex(const char *fname, const psl_load_options_t *options)
 {
-	int nlabels = 0;
-	const char *p;
+	static const psl_load_options_t default_options;
+	psl_reader_t reader = { NULL, NULL, 0 };
+	psl_ctx_t *psl = NULL;
 
-	if (!psl || !domain)
+	if (!fname)
 		return NULL;
 
 	/*
-	 * In the main loop we introduce a O(N^2) behavior to avoid code duplication.
-	 * To avoid nasty CPU hogging, we limit the lookup to max. 8 domain labels to the right.
-	 */
-	for (p = domain + strlen(domain) - 1; p >= domain; p--) {
-		if (*p == '.' && ++nlabels > 8) {
-			domain = p + 1;
-			break;
-		}
-	}
-
-	/*
-	 *  We check from left to right to catch special PSL entries like 'forgot.his.name':
-	 *   'forgot.his.name' and 'name' are in the PSL while 'his.name' is not.
+	 * The size of the options the caller has been built with. Options added later go behind
+	 * the current ones and keep their defaults for callers that pass the size of today.
 	 */
+	if (options && options->size != sizeof(psl_load_options_t))
+		return NULL;
 
-	while (!is_public_suffix(psl, domain, 0)) {
-		if ((domain = strchr(domain, '.')))
-			domain++;
-		else
-			break; /* prevent endless loop if is_public_suffix() is broken. */
+	if ((reader.fp = fopen(fname, "rb"))) {
+		psl = load(&reader, NULL, options ? options : &default_options);
+		fclose(reader.fp);
 	}
 
-	return domain;
+	return psl;
 }
 
 /**
- * psl_registrable_domain:
- * @psl: PSL context
- * @domain: Domain string
+ * psl_overlay_load_file:
+ * @base_psl: PSL context the overlay adds its rules to
+ * @fname: Name of PSL file
  *
- * This function finds the shortest private suffix part of @domain by the means
- * of the [Mozilla Public Suffix List](https://publicsuffix.org).
+ * This function loads the rules of the PSL file named @fname as an overlay to @base_psl,
+ * e.g. a few internal suffixes on top of psl_builtin().
+ * To free the allocated resources, call psl_free().
  *
- * International @domain names have to be either in UTF-8 (lowercase + NFKC) or in ASCII/ACE format (punycode).
- * Other encodings likely result in incorrect return values.
- * Use helper function psl_str_to_utf8lower() for normalization @domain.
+ * The lookups of the returned context consult the overlay and @base_psl together, as if the rules
+ * of @fname had been appended to the rules of @base_psl. @base_psl is neither copied nor parsed again,
+ * it has to stay valid until the overlay has been free'd.
  *
- * @psl is a context returned by either psl_load_file(), psl_load_fp() or
- * psl_builtin().
+ * Rules outside of the ICANN and PRIVATE section markers (e.g. "// ===BEGIN PRIVATE DOMAINS===")
+ * belong to neither section, see psl_is_public_suffix2().
+ * The overlay has no rule IDs, see psl_rule_count().
  *
- * Returns: Pointer to shortest private suffix part of @domain or %NULL if @domain
- * does not contain a private suffix (or if @psl is %NULL).
+ * Returns: Pointer to a PSL context or %NULL on failure.
  *
- * Since: 0.1
+ * Since: 0.22.0
  */
-const char *psl_registrable_domain(const psl_ctx_t *psl, const char *domain)
+psl_ctx_t *psl_overlay_load_file(const psl_ctx_t *base_psl, const char *fname)
 {
-	const char *p, *regdom = NULL;
-	int nlabels = 0;
+	FILE *fp;
+	psl_ctx_t *psl = NULL;
 
-	if (!psl || !domain || *domain == '.')
+	if (!fname)
 		return NULL;
 
-	/*
-	 * In the main loop we introduce a O(N^2) behavior to avoid code duplication.
-	 * To avoid nasty CPU hogging, we limit the lookup to max. 8 domain labels to the right.
-	 */
-	for (p = domain + strlen(domain) - 1; p >= domain; p--) {
-		if (*p == '.' && ++nlabels > 8) {
-			domain = p + 1;
-			break;
-		}
+	if ((fp = fopen(fname, "rb"))) {
+		psl = psl_overlay_load_fp(base_psl, fp);
+		fclose(fp);
 	}
 
-	/*
-	 *  We check from left to right to catch special PSL entries like 'forgot.his.name':
-	 *   'forgot.his.name' and 'name' are in the PSL while 'his.name' is not.
-	 */
+	return psl;
+}
 
-	while (!is_public_suffix(psl, domain, 0)) {
-		if ((p = strchr(domain, '.'))) {
-			regdom = domain;
-			domain = p + 1;
-		} else
-			break; /* prevent endless loop if is_public_suffix() is broken. */
-	}
+/**
+ * psl_overlay_load_fp:
+ * @base_psl: PSL context the overlay adds its rules to
+ * @fp: %FILE pointer
+ *
+ * This function works like psl_overlay_load_file(), but reads the rules from a %FILE pointer.
+ *
+ * Returns: Pointer to a PSL context or %NULL on failure.
+ *
+ * Since: 0.22.0
+ */
+psl_ctx_t *psl_overlay_load_fp(const psl_ctx_t *base_psl, FILE *fp)
+{
+	static const psl_load_options_t options;
+	psl_reader_t reader = { NULL, NULL, 0 };
 
-	return regdom;
+	if (!base_psl || !fp)
+		return NULL;
+
+	reader.fp = fp;
+
+	return load(&reader, base_psl, &options);
 }
 
 /**
- * psl_load_file:
- * @fname: Name of PSL file
+ * psl_overlay_load_data:
+ * @base_psl: PSL context the overlay adds its rules to
+ * @data: Rules in PSL file format
+ * @len: Length of @data in bytes
  *
- * This function loads the public suffixes file named @fname.
- * To free the allocated resources, call psl_free().
- *
- * The suffixes are expected to be UTF-8 encoded (lowercase + NFKC) if they are international.
+ * This function works like psl_overlay_load_file(), but reads the rules from memory.
  *
  * Returns: Pointer to a PSL context or %NULL on failure.
  *
- * Since: 0.1
+ * Since: 0.22.0
  */
-psl_ctx_t *psl_load_file(const char *fname)
+psl_ctx_t *psl_overlay_load_data(const psl_ctx_t *base_psl, const char *data, size_t len)
 {
-	FILE *fp;
-	psl_ctx_t *psl = NULL;
+	static const psl_load_options_t options;
+	psl_reader_t reader = { NULL, NULL, 0 };
+
+	if (!base_psl || !data)
+		return NULL;
+
+	reader.data = data;
+	reader.len = len;
+
+	return load(&reader, base_psl, &options);
+}
+
+/* the changes of psl_apply_diff() to the rules with the key 'suffix' */
+typedef struct {
+	psl_entry_t
+		suffix;
+	int
+		add, /* PRIV_PSL_FLAG_* of the added rules */
+		remove, /* PRIV_PSL_FLAG_PLAIN, _WILDCARD and _EXCEPTION of the removed rules */
+		variant; /* 1: the punycode variant of an international rule, not counted */
+} psl_change_t;
+
+static int change_compare(const void *c1, const void *c2)
+{
+	return suffix_compare(&((const psl_change_t *) c1)->suffix, &((const psl_change_t *) c2)->suffix);
+}
+
+/* sets 'c' to the change 'rc' of the rules with the key 'key', returns 0 if 'key' is ignored */
+static int change_init(psl_change_t *c, const char *key, const psl_rule_change_t *rc, int flags, int variant)
+{
+	if (suffix_init(&c->suffix, key, strlen(key)))
+		return 0;
+
+	c->suffix.label = NULL; /* the changes are moved around by qsort() */
+	c->add = rc->remove ? 0 : flags;
+	c->remove = rc->remove ? flags & (PRIV_PSL_FLAG_PLAIN | PRIV_PSL_FLAG_WILDCARD | PRIV_PSL_FLAG_EXCEPTION) : 0;
+	c->variant = variant;
+
+	return 1;
+}
+
+/* appends the change 'rc' to the 'n' changes in 'c', with the punycode variant of an international rule */
+static void change_add(psl_change_t *c, size_t *n, psl_idna_t *idna, const psl_ctx_t *psl, const psl_rule_change_t *rc)
+{
+	const char *p = rc->rule;
+	char *lookupname;
+	int flags = rc->flags & (PRIV_PSL_FLAG_ICANN | PRIV_PSL_FLAG_PRIVATE);
+
+	/* the rules of the other sections are skipped like by psl_load_ex() */
+	if (!p || (psl->sections && !(flags & psl->sections)))
+		return;
+
+	if (*p == '!') {
+		p++;
+		flags |= PRIV_PSL_FLAG_EXCEPTION;
+	} else if (*p == '*') {
+		if (*++p != '.')
+			return; /* unsupported kind of rule */
+		p++;
+		flags |= PRIV_PSL_FLAG_WILDCARD;
+	} else {
+		flags |= PRIV_PSL_FLAG_PLAIN;
+	}
+
+	if (!*p)
+		return;
+
+	/* a context in ASCII mode just has the punycode variant */
+	if (psl->utf8 || str_is_ascii(p))
+		*n += change_init(&c[*n], p, rc, flags, 0);
+
+	if (!str_is_ascii(p) && psl_idna_toASCII(idna, p, &lookupname) == 0) {
+		if (strcmp(p, lookupname))
+			*n += change_init(&c[*n], lookupname, rc, flags, psl->utf8);
+		free(lookupname);
+	}
+}
+
+/* sorts the 'n' changes in 'c' and combines the ones with the same key, returns the new number of changes */
+static size_t change_sort(psl_change_t *c, size_t n)
+{
+	size_t it, out = 0;
+
+	qsort(c, n, sizeof(psl_change_t), change_compare);
+
+	for (it = 0; it < n; it++) {
+		if (out && !change_compare(&c[out - 1], &c[it])) {
+			c[out - 1].add |= c[it].add;
+			c[out - 1].remove |= c[it].remove;
+			c[out - 1].variant &= c[it].variant;
+		} else if (out++ != it) {
+			c[out - 1] = c[it];
+		}
+	}
+
+	return out;
+}
+
+/*
+ * Returns the flags of the rules with the key of 'c' after the change, 0 if there are none left.
+ * Without PRIV_PSL_FLAG_PLAIN (the rules of engines other than the vector), foo.bar is a rule if *.foo.bar isn't.
+ */
+static int change_apply(const psl_change_t *c, int flags)
+{
+	if (flags && !(flags & (PRIV_PSL_FLAG_WILDCARD | PRIV_PSL_FLAG_EXCEPTION)))
+		flags |= PRIV_PSL_FLAG_PLAIN;
+
+	flags = (flags & ~c->remove) | c->add;
+
+	if (!(flags & (PRIV_PSL_FLAG_PLAIN | PRIV_PSL_FLAG_WILDCARD | PRIV_PSL_FLAG_EXCEPTION)))
+		return 0;
+
+	return flags;
+}
+
+/* updates the rule counts of 'psl' by the rules with 'flags' that the change has turned into 'new_flags' */
+static void change_count(psl_ctx_t *psl, int flags, int new_flags)
+{
+	int plain = PRIV_PSL_FLAG_PLAIN, wildcard = PRIV_PSL_FLAG_WILDCARD, exception = PRIV_PSL_FLAG_EXCEPTION;
+
+	if (flags && !(flags & (wildcard | exception)))
+		flags |= plain;
+
+	psl->nsuffixes += !!(new_flags & plain) - !!(flags & plain) + !!(new_flags & wildcard) - !!(flags & wildcard);
+	psl->nwildcards += !!(new_flags & wildcard) - !!(flags & wildcard);
+	psl->nexceptions += !!(new_flags & exception) - !!(flags & exception);
+}
+
+/*
+ * Merges the 'n' sorted changes in 'c' into the sorted rules of 'old', the result shares the unchanged entries.
+ * Returns the merged rules or NULL on failure.
+ */
+static psl_vector_t *change_merge(psl_ctx_t *psl, const psl_vector_t *old, const psl_change_t *c, size_t n)
+{
+	psl_vector_t *v;
+	psl_entry_t *e;
+	int it = 0, flags, new_flags, cmp;
+	size_t ic = 0;
+
+	/* each change adds one entry at most */
+	if (!(v = vector_alloc(old->cur + (int) n + 1, suffix_compare_array)))
+		return NULL;
+
+	while (it < old->cur || ic < n) {
+		if (ic == n)
+			cmp = -1;
+		else if (it == old->cur)
+			cmp = 1;
+		else
+			cmp = suffix_compare(old->entry[it], &c[ic].suffix);
+
+		if (cmp < 0) {
+			/* unchanged rule */
+			entry_ref(old->entry[it]);
+			v->entry[v->cur++] = old->entry[it++];
+			continue;
+		}
+
+		flags = cmp > 0 ? 0 : old->entry[it]->flags;
+		new_flags = change_apply(&c[ic], flags);
+
+		if (!c[ic].variant && psl->nsuffixes >= 0)
+			change_count(psl, flags, new_flags);
+
+		if (cmp > 0) {
+			/* new rule, without a rule ID */
+			if (new_flags) {
+				if (!(e = malloc(sizeof(psl_entry_t))))
+					goto fail;
 
-	if (!fname)
-		return NULL;
+				*e = c[ic].suffix;
+				e->label = e->label_buf;
+				e->id = -1;
+				e->flags = (unsigned char) new_flags;
+				e->refs = 1;
+				v->entry[v->cur++] = e;
+			}
+			ic++;
+			continue;
+		}
 
-	if ((fp = fopen(fname, "rb"))) {
-		psl = psl_load_fp(fp);
-		fclose(fp);
+		/* changed rule, all entries with this key (the vector of a PSL file may have duplicates) */
+		for (; it < old->cur && !suffix_compare(old->entry[it], &c[ic].suffix); it++) {
+			if (!new_flags)
+				continue;
+
+			if (new_flags == old->entry[it]->flags) {
+				entry_ref(old->entry[it]);
+				v->entry[v->cur++] = old->entry[it];
+				continue;
+			}
+
+			/* the entries are shared, the changed ones are copied */
+			if (!(e = malloc(sizeof(psl_entry_t))))
+				goto fail;
+
+			*e = *old->entry[it];
+			e->label = e->label_buf;
+			e->flags = (unsigned char) new_flags;
+			e->refs = 1;
+			v->entry[v->cur++] = e;
+		}
+		ic++;
 	}
 
-	return psl;
+	return v;
+
+fail:
+	vector_free(&v);
+	return NULL;
 }
 
 /**
- * psl_load_fp:
- * @fp: %FILE pointer
+ * psl_apply_diff:
+ * @psl: PSL context pointer
+ * @changes: Array of the rules to add or to remove
+ * @nchanges: Number of elements in @changes
  *
- * This function loads the public suffixes from a %FILE pointer.
+ * This function applies the rules added to and removed from a PSL (e.g. from one version of
+ * the upstream list to the next) to the rules of @psl, instead of loading the whole new list.
  * To free the allocated resources, call psl_free().
  *
- * The suffixes are expected to be UTF-8 encoded (lowercase + NFKC) if they are international.
+ * The returned context looks up the rules of @psl with @changes applied, it is a new context
+ * and @psl is not modified. A context loaded from a PSL file and the returned context share
+ * the rules that haven't changed, each of them can be free'd independently of the other.
+ * A context with the %PSL_ENGINE_MPH, %PSL_ENGINE_DARRAY or %PSL_ENGINE_JIT engine is rebuilt with
+ * its engine from the merged rules. A DAFSA or LOUDS trie can't be built at runtime, so the returned
+ * context of such a context (e.g. psl_builtin()) has the rules in a sorted vector, like a context
+ * loaded from a PSL file.
+ *
+ * A removed wildcard rule *.foo.bar keeps foo.bar if foo.bar is a rule of its own. Just the vector
+ * engine tells, with the other engines foo.bar is only kept if it is added by @changes again.
+ * Removing a rule that @psl doesn't have or adding one that it has is not an error.
+ * The sections of @psl (see psl_load_ex()) are kept, changes to the rules of other sections are skipped.
+ *
+ * Overlays (see psl_overlay_load_file()) are not supported. The returned context has no rule IDs,
+ * see psl_rule_count().
  *
  * Returns: Pointer to a PSL context or %NULL on failure.
  *
- * Since: 0.1
+ * Since: 0.22.0
  */
-psl_ctx_t *psl_load_fp(FILE *fp)
+psl_ctx_t *psl_apply_diff(const psl_ctx_t *psl, const psl_rule_change_t *changes, size_t nchanges)
 {
-	psl_ctx_t *psl;
-	psl_entry_t suffix, *suffixp;
-	char buf[256], *linep, *p;
-	int type = 0, is_dafsa;
+	psl_ctx_t *new_psl = NULL;
+	psl_vector_t *old = NULL, *v;
+	psl_change_t *c;
 	psl_idna_t *idna;
+	psl_load_engine_t engine = PSL_ENGINE_VECTOR;
+	psl_entry_t *e;
+	size_t n = 0, it;
 
-	if (!fp)
+	if (!psl || psl->base || (!changes && nchanges) || nchanges > 1024 * 1024)
 		return NULL;
 
-	if (!(psl = calloc(1, sizeof(psl_ctx_t))))
+	/* an international rule comes with its punycode variant */
+	if (!(c = malloc((nchanges * 2 + 1) * sizeof(psl_change_t))))
 		return NULL;
 
-	/* read first line to allow ASCII / DAFSA detection */
-	if (!(linep = fgets(buf, sizeof(buf) - 1, fp)))
-		goto fail;
-
-	is_dafsa = strlen(buf) == 16 && !strncmp(buf, ".DAFSA@PSL_", 11);
-
-	if (is_dafsa) {
-		void *m;
-		size_t size = 65536, n, len = 0;
-		int version = atoi(buf + 11);
-
-		if (version != 0)
-			goto fail;
-
-		if (!(psl->dafsa = malloc(size)))
-			goto fail;
-
-		memcpy(psl->dafsa, buf, len);
-
-		while ((n = fread(psl->dafsa + len, 1, size - len, fp)) > 0) {
-			len += n;
-			if (len >= size) {
-				if (!(m = realloc(psl->dafsa, size *= 2)))
-					goto fail;
-				psl->dafsa = m;
-			}
-		}
-
-		/* release unused memory */
-		if ((m = realloc(psl->dafsa, len)))
-			psl->dafsa = m;
-		else if (!len)
-			psl->dafsa = NULL; /* realloc() just free'd psl->dafsa */
-
-		psl->dafsa_size = len;
-		psl->utf8 = !!GetUtfMode(psl->dafsa, len);
-
-		return psl;
-	}
-
 	idna = psl_idna_open();
+	for (it = 0; it < nchanges; it++)
+		change_add(c, &n, idna, psl, &changes[it]);
+	psl_idna_close(idna);
 
-	/*
-	 *  as of 02.11.2012, the list at https://publicsuffix.org/list/ contains ~6000 rules and 40 exceptions.
-	 *  as of 19.02.2014, the list at https://publicsuffix.org/list/ contains ~6500 rules and 19 exceptions.
-	 *  as of 07.10.2018, the list at https://publicsuffix.org/list/ contains ~8600 rules and 8 exceptions.
-	 */
-	psl->suffixes = vector_alloc(8*1024, suffix_compare_array);
-	psl->utf8 = 1; /* we put UTF-8 and punycode rules in the lookup vector */
-
-	do {
-		while (isspace_ascii(*linep)) linep++; /* ignore leading whitespace */
-		if (!*linep) continue; /* skip empty lines */
-
-		if (*linep == '/' && linep[1] == '/') {
-			if (!type) {
-				if (strstr(linep + 2, "===BEGIN ICANN DOMAINS==="))
-					type = PRIV_PSL_FLAG_ICANN;
-				else if (!type && strstr(linep + 2, "===BEGIN PRIVATE DOMAINS==="))
-					type = PRIV_PSL_FLAG_PRIVATE;
-			}
-			else if (type == PRIV_PSL_FLAG_ICANN && strstr(linep + 2, "===END ICANN DOMAINS==="))
-				type = 0;
-			else if (type == PRIV_PSL_FLAG_PRIVATE && strstr(linep + 2, "===END PRIVATE DOMAINS==="))
-				type = 0;
+	n = change_sort(c, n);
 
-			continue; /* skip comments */
-		}
+	/* the rules of other engines are merged into a vector built with one walk */
+	if (psl->engine == &vector_engine) {
+		old = (psl_vector_t *) psl->engine_data;
+	} else {
+		if (!(old = vector_alloc(8*1024, suffix_compare_array)) || engine_foreach(psl, vector_engine_add, old))
+			goto out;
+		vector_sort(old);
+
+		if (psl->engine == &psl_mph_engine)
+			engine = PSL_ENGINE_MPH;
+		else if (psl->engine == &psl_darray_engine)
+			engine = PSL_ENGINE_DARRAY;
+		else if (psl->engine == &psl_jit_engine)
+			engine = PSL_ENGINE_JIT;
+	}
 
-		/* parse suffix rule */
-		for (p = linep; *linep && !isspace_ascii(*linep);) linep++;
-		*linep = 0;
+	if (!(new_psl = calloc(1, sizeof(psl_ctx_t))))
+		goto out;
 
-		if (*p == '!') {
-			p++;
-			suffix.flags = PRIV_PSL_FLAG_EXCEPTION | type;
-			psl->nexceptions++;
-		} else if (*p == '*') {
-			if (*++p != '.') {
-				/* fprintf(stderr, "Unsupported kind of rule (ignored): %s\n", p - 1); */
-				continue;
-			}
-			p++;
-			/* wildcard *.foo.bar implicitly make foo.bar a public suffix */
-			suffix.flags = PRIV_PSL_FLAG_WILDCARD | PRIV_PSL_FLAG_PLAIN | type;
-			psl->nwildcards++;
-			psl->nsuffixes++;
-		} else {
-			suffix.flags = PRIV_PSL_FLAG_PLAIN | type;
-			psl->nsuffixes++;
-		}
+	new_psl->utf8 = psl->utf8;
+	new_psl->sections = psl->sections;
+	new_psl->nsuffixes = psl_suffix_count(psl);
+	new_psl->nexceptions = psl_suffix_exception_count(psl);
+	new_psl->nwildcards = psl_suffix_wildcard_count(psl);
 
-		if (suffix_init(&suffix, p, linep - p) == 0) {
-			int index;
+	if (!(v = change_merge(new_psl, old, c, n))) {
+		free(new_psl);
+		new_psl = NULL;
+		goto out;
+	}
 
-			if ((index = vector_find(psl->suffixes, &suffix)) >= 0) {
-				/* Found existing entry:
-				 * Combination of exception and plain rule is ambiguous
-				 * !foo.bar
-				 * foo.bar
-				 *
-				 * Allowed:
-				 * !foo.bar + *.foo.bar
-				 * foo.bar + *.foo.bar
-				 *
-				 * We do not check here, let's do it later.
-				 */
+	new_psl->engine = &vector_engine;
+	new_psl->engine_data = v;
 
-				suffixp = vector_get(psl->suffixes, index);
-				suffixp->flags |= suffix.flags;
-			} else {
-				/* New entry */
-				suffixp = vector_get(psl->suffixes, vector_add(psl->suffixes, &suffix));
-			}
+	if (new_psl->nsuffixes < 0 || new_psl->nexceptions < 0 || new_psl->nwildcards < 0)
+		new_psl->nsuffixes = new_psl->nexceptions = new_psl->nwildcards = -1;
 
-			if (suffixp) {
-				suffixp->label = suffixp->label_buf; /* set label to changed address */
-				add_punycode_if_needed(idna, psl->suffixes, suffixp);
-			}
-		}
-	} while ((linep = fgets(buf, sizeof(buf), fp)));
+	/* the rules are sorted by the number of labels, most labels first */
+	if ((e = vector_get(v, 0)))
+		new_psl->max_nlabels = e->nlabels;
 
-	vector_sort(psl->suffixes);
+	if (engine_convert(new_psl, engine, PSL_ENGINE_VECTOR)) {
+		psl_free(new_psl);
+		new_psl = NULL;
+		goto out;
+	}
 
-	psl_idna_close(idna);
+	tld_table_init(new_psl);
 
-	return psl;
+out:
+	if (old && old != psl->engine_data)
+		vector_free(&old);
+	free(c);
 
-fail:
-	psl_free(psl);
-	return NULL;
+	return new_psl;
 }
 
 /**
@@ -1342,17 +3815,65 @@ fail:
  * This function frees the the PSL context that has been retrieved via
  * psl_load_fp() or psl_load_file().
  *
+ * The base context of an overlay (see psl_overlay_load_file()) is not free'd.
+ *
  * Since: 0.1
  */
 void psl_free(psl_ctx_t *psl)
 {
 	if (psl && psl != &builtin_psl) {
-		vector_free(&psl->suffixes);
-		free(psl->dafsa);
+		if (psl->engine_data)
+			psl->engine->free(psl->engine_data);
+		tld_table_free(&psl->tlds);
+		rule_table_free(&psl->rules);
 		free(psl);
 	}
 }
 
+#if defined ENABLE_BUILTIN && defined ENABLE_BUILTIN_COMPRESSED
+/*
+ * Inflates kDafsaCompressed (psl-make-dafsa --compress) into the TLD slots, the DAFSA and the TLD pool.
+ * Called once by psl_builtin(), the memory is kept until the process exits.
+ */
+static void builtin_inflate(void)
+{
+	size_t size = _psl_tld_nslots * 4 + _psl_dafsa_size + _psl_tld_pool_size, it;
+	unsigned char *data, *p;
+	unsigned *slots;
+
+	if (!(data = malloc(size)))
+		return;
+
+	if (psl_inflate(data, size, kDafsaCompressed, sizeof(kDafsaCompressed))) {
+		free(data);
+		return;
+	}
+
+	/* the slots come first, so they are aligned as malloc() aligns for any type */
+	slots = (unsigned *) data;
+	for (it = 0, p = data; it < _psl_tld_nslots; it++, p += 4)
+		slots[it] = p[0] | (p[1] << 8) | ((unsigned) p[2] << 16) | ((unsigned) p[3] << 24);
+
+	_psl_tld_slots = slots;
+	_psl_tld_pool = data + _psl_tld_nslots * 4 + _psl_dafsa_size;
+	builtin_dafsa.blob.size = _psl_dafsa_size;
+	builtin_dafsa.blob.data = data + _psl_tld_nslots * 4;
+}
+
+#ifdef _WIN32
+static INIT_ONCE builtin_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK builtin_inflate_once(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+	(void) once; (void) param; (void) context;
+	builtin_inflate();
+	return TRUE;
+}
+#else
+static pthread_once_t builtin_once = PTHREAD_ONCE_INIT;
+#endif
+#endif /* ENABLE_BUILTIN_COMPRESSED */
+
 /**
  * psl_builtin:
  *
@@ -1365,13 +3886,24 @@ void psl_free(psl_ctx_t *psl)
  * When using the builtin psl context, you can provide UTF-8 (lowercase + NFKC) or ASCII/ACE (punycode)
  * representations of domains to functions like psl_is_public_suffix().
  *
+ * If libpsl has been configured to store the built-in data compressed (-Dbuiltin_compressed=true),
+ * the first call inflates it into about 100 KB of memory, which takes around a millisecond. This is done
+ * once, also with concurrent calls from several threads. %NULL is returned if that fails for lack of memory.
+ *
  * Returns: Pointer to the built in PSL data or %NULL if this data is not available.
  *
  * Since: 0.1
  */
 const psl_ctx_t *psl_builtin(void)
 {
-#ifdef ENABLE_BUILTIN
+#if defined ENABLE_BUILTIN && defined ENABLE_BUILTIN_COMPRESSED
+#ifdef _WIN32
+	InitOnceExecuteOnce(&builtin_once, builtin_inflate_once, NULL, NULL);
+#else
+	pthread_once(&builtin_once, builtin_inflate);
+#endif
+	return builtin_dafsa.blob.data ? &builtin_psl : NULL;
+#elif defined ENABLE_BUILTIN
 	return &builtin_psl;
 #else
 	return NULL;
@@ -1397,7 +3929,7 @@ int psl_suffix_count(const psl_ctx_t *psl)
 	if (psl == &builtin_psl)
 		return _psl_nsuffixes;
 	else if (psl)
-		return psl->dafsa ? -1 : psl->nsuffixes;
+		return psl->nsuffixes;
 	else
 		return -1;
 }
@@ -1420,7 +3952,7 @@ int psl_suffix_exception_count(const psl_ctx_t *psl)
 	if (psl == &builtin_psl)
 		return _psl_nexceptions;
 	else if (psl)
-		return psl->dafsa ? -1 : psl->nexceptions;
+		return psl->nexceptions;
 	else
 		return -1;
 }
@@ -1443,11 +3975,170 @@ int psl_suffix_wildcard_count(const psl_ctx_t *psl)
 	if (psl == &builtin_psl)
 		return _psl_nwildcards;
 	else if (psl)
-		return psl->dafsa ? -1 : psl->nwildcards;
+		return psl->nwildcards;
+	else
+		return -1;
+}
+
+/**
+ * psl_rule_count:
+ * @psl: PSL context pointer
+ *
+ * This function returns the number of rule IDs of @psl, the IDs are in the range
+ * 0 to the return value - 1. See psl_suffix_rule_id() and psl_rule_by_id().
+ *
+ * Rule IDs are available for PSL files loaded with psl_load_file() or psl_load_fp()
+ * and for DAFSA blobs generated with 'psl-make-dafsa --payload'.
+ *
+ * Returns: Number of rule IDs or -1 if @psl has no rule IDs (or if @psl is %NULL).
+ *
+ * Since: 0.22.0
+ */
+int psl_rule_count(const psl_ctx_t *psl)
+{
+	if (psl && psl->rules.entry)
+		return (int) psl->rules.nrules;
 	else
 		return -1;
 }
 
+/**
+ * psl_suffix_rule_id:
+ * @psl: PSL context pointer
+ * @domain: Domain string
+ * @flags: Pointer to return the rule flags or %NULL
+ *
+ * This function returns the ID of the rule that makes the public suffix of @domain,
+ * e.g. the ID of '*.kawasaki.jp' for 'www.example.kawasaki.jp' and the ID of
+ * '!city.kawasaki.jp' for 'www.city.kawasaki.jp'.
+ *
+ * The ID is the number of the rule in the order of the PSL file, starting with 0.
+ * It is the same for a PSL file and for a DAFSA generated from it, so the IDs can be used
+ * to index arrays of psl_rule_count() elements.
+ *
+ * If @flags is not %NULL, it is set to the %PSL_RULE_EXCEPTION, %PSL_RULE_WILDCARD,
+ * %PSL_RULE_ICANN, %PSL_RULE_PRIVATE and %PSL_RULE_IDN flags of the rule.
+ *
+ * @domain has to be lowercase, international domain names either in UTF-8 or punycode.
+ *
+ * Returns: The rule ID or -1 if no rule matches (just the prevailing '*' rule) or if @psl has no rule IDs.
+ *
+ * Since: 0.22.0
+ */
+int psl_suffix_rule_id(const psl_ctx_t *psl, const char *domain, int *flags)
+{
+	const char *p, *next;
+	char *punycode = NULL;
+	int id = -1, rule_flags = 0;
+
+	if (!psl || !domain || !psl->rules.entry)
+		return -1;
+
+	if (*domain == '.')
+		domain++;
+
+	/* a DAFSA in ASCII mode just contains the punycode of international rules */
+	if (!psl->utf8 && !str_is_ascii(domain)) {
+		psl_idna_t *idna = psl_idna_open();
+		int rc = psl_idna_labels_toASCII(idna, domain, &punycode);
+
+		psl_idna_close(idna);
+		if (rc)
+			return -1;
+		domain = punycode;
+	}
+
+	/* the longest matching rule prevails, a matching exception rule is always the longest */
+	for (p = domain; p && *p; p = next) {
+		if ((next = strchr(p, '.')))
+			next++;
+
+		if ((id = rule_lookup(psl, p, &rule_flags)) >= 0)
+			break;
+
+		if (next && (id = rule_lookup(psl, next, &rule_flags)) >= 0 && (rule_flags & PSL_RULE_WILDCARD))
+			break;
+
+		id = -1;
+	}
+
+	free(punycode);
+
+	if (id >= 0 && flags)
+		*flags = rule_flags;
+
+	return id;
+}
+
+/**
+ * psl_rule_by_id:
+ * @psl: PSL context pointer
+ * @id: Rule ID
+ * @flags: Pointer to return the rule flags or %NULL
+ *
+ * This function returns the rule with @id as written in the PSL, e.g. 'co.uk', '*.kawasaki.jp'
+ * or '!city.kawasaki.jp'. International rules are UTF-8 encoded, except for DAFSA blobs
+ * generated in ASCII mode, which just contain the punycode.
+ *
+ * If @flags is not %NULL, it is set to the flags of the rule as described at psl_suffix_rule_id().
+ *
+ * Returns: The rule or %NULL if there is no rule with @id (or if @psl is %NULL).
+ *
+ * Since: 0.22.0
+ */
+const char *psl_rule_by_id(const psl_ctx_t *psl, int id, int *flags)
+{
+	unsigned entry;
+
+	if (!psl || !psl->rules.entry || id < 0 || (size_t) id >= psl->rules.nrules)
+		return NULL;
+
+	if (!(entry = psl->rules.entry[id]))
+		return NULL;
+
+	if (flags)
+		*flags = entry & 0x7F;
+
+	return psl->rules.pool + (entry >> 8);
+}
+
+/**
+ * psl_engine_name:
+ * @psl: PSL context pointer
+ *
+ * This function returns the name of the lookup engine of @psl, e.g. "dafsa" or "vector".
+ * See psl_load_ex(). The built-in context has "dafsa", or "builtin-code" if libpsl has been
+ * configured to compile the built-in rules into code (-Dbuiltin_code=true, --enable-builtin-code).
+ *
+ * Returns: Name of the lookup engine or %NULL if @psl is %NULL.
+ *
+ * Since: 0.22.0
+ */
+const char *psl_engine_name(const psl_ctx_t *psl)
+{
+	return psl ? psl->engine->name : NULL;
+}
+
+/**
+ * psl_memory_usage:
+ * @psl: PSL context pointer
+ *
+ * This function returns the number of bytes used by the lookup data of @psl,
+ * including the size of a mapped DAFSA file (see psl_load_ex()).
+ * The base context of an overlay is not included (see psl_overlay_load_file()).
+ *
+ * Returns: Number of bytes or 0 if @psl is %NULL.
+ *
+ * Since: 0.22.0
+ */
+size_t psl_memory_usage(const psl_ctx_t *psl)
+{
+	if (!psl)
+		return 0;
+
+	return psl->engine->memory_usage(psl->engine_data);
+}
+
 /**
  * psl_builtin_file_time:
  *
@@ -1554,6 +4245,8 @@ const char *psl_get_version(void)
 	return PACKAGE_VERSION " (+libidn2/" IDN2_VERSION ")";
 #elif defined(WITH_LIBIDN)
 	return PACKAGE_VERSION " (+libidn/" STRINGPREP_VERSION ")";
+#elif defined(WITH_NATIVE_IDNA)
+	return PACKAGE_VERSION " (+native IDNA/Unicode " PSL_IDNA_UNICODE_VERSION ")";
 #else
 	return PACKAGE_VERSION " (no IDNA support)";
 #endif
@@ -1803,17 +4496,14 @@ psl_error_t psl_str_to_utf8lower(const char *str, const char *encoding, const ch
 	/* shortcut to avoid costly conversion */
 	if (str_is_ascii(str)) {
 		if (lower) {
-			char *p, *tmp;
+			char *tmp;
 
 			if (!(tmp = psl_strdup(str)))
 				return PSL_ERR_NO_MEM;
 
-			*lower = tmp;
-
 			/* convert ASCII string to lowercase */
-			for (p = *lower; *p; p++)
-				if (isupper(*p))
-					*p = tolower(*p);
+			psl_scan_tolower_ascii(tmp, strlen(tmp));
+			*lower = tmp;
 		}
 		return PSL_SUCCESS;
 	}
@@ -1975,6 +4665,23 @@ out:
 		}
 
 	} while (0);
+#elif defined(WITH_NATIVE_IDNA)
+	do {
+		/* find out local charset encoding */
+		if (!encoding) {
+#ifdef HAVE_NL_LANGINFO
+			encoding = nl_langinfo(CODESET);
+#elif defined _WIN32
+			static char buf[16];
+			snprintf(buf, sizeof(buf), "CP%u", GetACP());
+			encoding = buf;
+#endif
+			if (!encoding || !*encoding)
+				encoding = "ASCII";
+		}
+
+		ret = native_to_utf8lower(str, encoding, lower);
+	} while (0);
 #endif
 
 	return ret;
@@ -0,0 +1,444 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of libpsl.
+ *
+ * Input scanning: UTF-8 validation, non-ASCII check, label counting and ASCII lowercasing.
+ *
+ * Each routine has a portable scalar reference and SIMD variants. The variant is selected
+ * once at runtime from the CPU features, so distributions don't need -march=native.
+ *
+ * The SIMD variants use the range table algorithm of John Keiser and Daniel Lemire,
+ * "Validating UTF-8 In Less Than One Instruction Per Byte" (https://arxiv.org/abs/2010.03090):
+ * three 16 entry tables, indexed by the nibbles of each byte and its predecessor, are
+ * looked up with a byte shuffle. A bitwise AND of the three results is non-zero for
+ * each invalid two byte sequence. The remaining errors (missing or surplus 3rd/4th
+ * continuation bytes) are found by comparing with the bytes two and three positions back.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <string.h>
+
+#include "scan.h"
+
+#if !defined(ENABLE_SIMD)
+/* SIMD variants excluded (./configure --disable-simd, meson -Dsimd=false) */
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && (__GNUC__ >= 5 || defined(__clang__))
+#  define SCAN_X86 1
+#  define SCAN_TARGET(t) __attribute__((target(t)))
+#  include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define SCAN_X86 1
+#  define SCAN_TARGET(t)
+#  include <intrin.h>
+#  include <immintrin.h>
+#endif
+
+static void scan_scalar(const char *str, size_t len, psl_scan_t *scan)
+{
+	const unsigned char *s = (const unsigned char *) str, *e = s + len;
+	size_t ndots = 0;
+	int nonascii = 0, valid = 1;
+
+	while (s < e) {
+		unsigned char c = *s++, lo = 0x80, hi = 0xBF;
+		int n, it;
+
+		if (c < 0x80) {
+			ndots += c == '.';
+			continue;
+		}
+
+		nonascii = 1;
+
+		if (!valid)
+			continue; /* just count the dots */
+
+		if (c >= 0xC2 && c <= 0xDF)
+			n = 1;
+		else if (c == 0xE0)
+			n = 2, lo = 0xA0; /* overlong */
+		else if (c == 0xED)
+			n = 2, hi = 0x9F; /* surrogates */
+		else if (c >= 0xE1 && c <= 0xEF)
+			n = 2;
+		else if (c == 0xF0)
+			n = 3, lo = 0x90; /* overlong */
+		else if (c >= 0xF1 && c <= 0xF3)
+			n = 3;
+		else if (c == 0xF4)
+			n = 3, hi = 0x8F; /* > 0x10FFFF */
+		else {
+			valid = 0;
+			continue;
+		}
+
+		if (e - s < n || s[0] < lo || s[0] > hi) {
+			valid = 0;
+			continue;
+		}
+
+		for (it = 1; it < n; it++) {
+			if ((s[it] & 0xC0) != 0x80)
+				break;
+		}
+
+		if (it < n) {
+			valid = 0;
+			continue;
+		}
+
+		s += n;
+	}
+
+	scan->ndots = ndots;
+	scan->nonascii = nonascii;
+	scan->valid = valid;
+}
+
+static int is_ascii_scalar(const char *str, size_t len)
+{
+	const unsigned char *s = (const unsigned char *) str, *e = s + len;
+
+	while (s < e)
+		if (*s++ >= 0x80)
+			return 0;
+
+	return 1;
+}
+
+static void tolower_scalar(char *s, size_t len)
+{
+	char *e = s + len;
+
+	for (; s < e; s++)
+		if (*s >= 'A' && *s <= 'Z')
+			*s += 'a' - 'A';
+}
+
+#ifdef SCAN_X86
+/* error bits of the range tables */
+#define TOO_SHORT      0x01 /* 11______ 0_______, 11______ 11______ */
+#define TOO_LONG       0x02 /* 0_______ 10______ */
+#define OVERLONG_3     0x04 /* 11100000 100_____ */
+#define TOO_LARGE      0x08 /* 11110100 1001____, 11110100 101_____, 11110101 ..., 1111011_ ..., 11111___ ... */
+#define SURROGATE      0x10 /* 11101101 101_____ */
+#define OVERLONG_2     0x20 /* 1100000_ 10______ */
+#define TOO_LARGE_1000 0x40 /* 11110101 1000____, 1111011_ 1000____, 11111___ 1000____ */
+#define OVERLONG_4     0x40 /* 11110000 1000____ */
+#define TWO_CONTS      0x80 /* 10______ 10______ */
+#define CARRY          (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* indexed by the high nibble of the previous byte */
+#define BYTE_1_HIGH \
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+	(char) TWO_CONTS, (char) TWO_CONTS, (char) TWO_CONTS, (char) TWO_CONTS, \
+	TOO_SHORT | OVERLONG_2, \
+	TOO_SHORT, \
+	TOO_SHORT | OVERLONG_3 | SURROGATE, \
+	(char) (TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4)
+
+/* indexed by the low nibble of the previous byte */
+#define BYTE_1_LOW \
+	(char) (CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4), \
+	(char) (CARRY | OVERLONG_2), \
+	(char) CARRY, \
+	(char) CARRY, \
+	(char) (CARRY | TOO_LARGE), \
+	(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+	(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+	(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+	(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+	(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+	(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+	(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+	(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+	(char) (CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE), \
+	(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+	(char) (CARRY | TOO_LARGE | TOO_LARGE_1000)
+
+/* indexed by the high nibble of the current byte */
+#define BYTE_2_HIGH \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+	(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4), \
+	(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE), \
+	(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE), \
+	(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE), \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+
+static unsigned popcount32(unsigned x)
+{
+	unsigned n = 0;
+
+	for (; x; x &= x - 1)
+		n++;
+
+	return n;
+}
+
+static SCAN_TARGET("sse2") int is_ascii_sse2(const char *str, size_t len)
+{
+	size_t it;
+
+	for (it = 0; it + 16 <= len; it += 16)
+		if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (str + it))))
+			return 0;
+
+	return is_ascii_scalar(str + it, len - it);
+}
+
+static SCAN_TARGET("sse2") void tolower_sse2(char *s, size_t len)
+{
+	/* 'A'..'Z' are moved to the bottom of the signed range, so one compare selects them */
+	const __m128i shift = _mm_set1_epi8((char) (0x80 - 'A')), limit = _mm_set1_epi8(-128 + 26), diff = _mm_set1_epi8(0x20);
+	size_t it;
+
+	for (it = 0; it + 16 <= len; it += 16) {
+		__m128i in = _mm_loadu_si128((const __m128i *) (s + it));
+		__m128i upper = _mm_cmplt_epi8(_mm_add_epi8(in, shift), limit);
+
+		_mm_storeu_si128((__m128i *) (s + it), _mm_add_epi8(in, _mm_and_si128(upper, diff)));
+	}
+
+	tolower_scalar(s + it, len - it);
+}
+
+/* returns the error bits of 'in', 'prev' is the block before */
+static SCAN_TARGET("ssse3") __m128i utf8_errors_ssse3(__m128i in, __m128i prev)
+{
+	const __m128i nibble = _mm_set1_epi8(0x0F);
+	__m128i prev1 = _mm_alignr_epi8(in, prev, 15);
+	__m128i prev2 = _mm_alignr_epi8(in, prev, 14);
+	__m128i prev3 = _mm_alignr_epi8(in, prev, 13);
+	__m128i special, must23;
+
+	special = _mm_and_si128(_mm_and_si128(
+		_mm_shuffle_epi8(_mm_setr_epi8(BYTE_1_HIGH), _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+		_mm_shuffle_epi8(_mm_setr_epi8(BYTE_1_LOW), _mm_and_si128(prev1, nibble))),
+		_mm_shuffle_epi8(_mm_setr_epi8(BYTE_2_HIGH), _mm_and_si128(_mm_srli_epi16(in, 4), nibble)));
+
+	/* 3rd and 4th bytes of a sequence must be continuation bytes (they have TWO_CONTS set) */
+	must23 = _mm_or_si128(
+		_mm_subs_epu8(prev2, _mm_set1_epi8((char) (0xE0 - 0x80))),
+		_mm_subs_epu8(prev3, _mm_set1_epi8((char) (0xF0 - 0x80))));
+
+	return _mm_xor_si128(_mm_and_si128(must23, _mm_set1_epi8((char) 0x80)), special);
+}
+
+static SCAN_TARGET("ssse3") void scan_ssse3(const char *str, size_t len, psl_scan_t *scan)
+{
+	const __m128i dot = _mm_set1_epi8('.');
+	__m128i in, prev = _mm_setzero_si128(), errors = _mm_setzero_si128(), high = _mm_setzero_si128();
+	char tail[16];
+	size_t ndots = 0, it;
+
+	for (it = 0; it + 16 <= len; it += 16) {
+		in = _mm_loadu_si128((const __m128i *) (str + it));
+		errors = _mm_or_si128(errors, utf8_errors_ssse3(in, prev));
+		high = _mm_or_si128(high, in);
+		ndots += popcount32((unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(in, dot)));
+		prev = in;
+	}
+
+	/* the zero padding also reveals truncated sequences at the end */
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, str + it, len - it);
+	in = _mm_loadu_si128((const __m128i *) tail);
+	errors = _mm_or_si128(errors, utf8_errors_ssse3(in, prev));
+	high = _mm_or_si128(high, in);
+	ndots += popcount32((unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(in, dot)));
+	errors = _mm_or_si128(errors, utf8_errors_ssse3(_mm_setzero_si128(), in));
+
+	scan->ndots = ndots;
+	scan->nonascii = _mm_movemask_epi8(high) != 0;
+	scan->valid = _mm_movemask_epi8(_mm_cmpeq_epi8(errors, _mm_setzero_si128())) == 0xFFFF;
+}
+
+/* returns the error bits of 'in', 'prev' is the block before */
+static SCAN_TARGET("avx2") __m256i utf8_errors_avx2(__m256i in, __m256i prev)
+{
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	__m256i shifted = _mm256_permute2x128_si256(prev, in, 0x21); /* high lane of prev, low lane of in */
+	__m256i prev1 = _mm256_alignr_epi8(in, shifted, 15);
+	__m256i prev2 = _mm256_alignr_epi8(in, shifted, 14);
+	__m256i prev3 = _mm256_alignr_epi8(in, shifted, 13);
+	__m256i special, must23;
+
+	special = _mm256_and_si256(_mm256_and_si256(
+		_mm256_shuffle_epi8(_mm256_setr_epi8(BYTE_1_HIGH, BYTE_1_HIGH), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+		_mm256_shuffle_epi8(_mm256_setr_epi8(BYTE_1_LOW, BYTE_1_LOW), _mm256_and_si256(prev1, nibble))),
+		_mm256_shuffle_epi8(_mm256_setr_epi8(BYTE_2_HIGH, BYTE_2_HIGH), _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble)));
+
+	must23 = _mm256_or_si256(
+		_mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xE0 - 0x80))),
+		_mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xF0 - 0x80))));
+
+	return _mm256_xor_si256(_mm256_and_si256(must23, _mm256_set1_epi8((char) 0x80)), special);
+}
+
+static SCAN_TARGET("avx2") void scan_avx2(const char *str, size_t len, psl_scan_t *scan)
+{
+	const __m256i dot = _mm256_set1_epi8('.');
+	__m256i in, prev = _mm256_setzero_si256(), errors = _mm256_setzero_si256(), high = _mm256_setzero_si256();
+	char tail[32];
+	size_t ndots = 0, it;
+
+	for (it = 0; it + 32 <= len; it += 32) {
+		in = _mm256_loadu_si256((const __m256i *) (str + it));
+		errors = _mm256_or_si256(errors, utf8_errors_avx2(in, prev));
+		high = _mm256_or_si256(high, in);
+		ndots += popcount32((unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(in, dot)));
+		prev = in;
+	}
+
+	/* the zero padding also reveals truncated sequences at the end */
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, str + it, len - it);
+	in = _mm256_loadu_si256((const __m256i *) tail);
+	errors = _mm256_or_si256(errors, utf8_errors_avx2(in, prev));
+	high = _mm256_or_si256(high, in);
+	ndots += popcount32((unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(in, dot)));
+	errors = _mm256_or_si256(errors, utf8_errors_avx2(_mm256_setzero_si256(), in));
+
+	scan->ndots = ndots;
+	scan->nonascii = _mm256_movemask_epi8(high) != 0;
+	scan->valid = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(errors, _mm256_setzero_si256())) == 0xFFFFFFFFU;
+}
+
+static SCAN_TARGET("avx2") int is_ascii_avx2(const char *str, size_t len)
+{
+	size_t it;
+
+	for (it = 0; it + 32 <= len; it += 32)
+		if (_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) (str + it))))
+			return 0;
+
+	/* not calling the SSE2 variant avoids the AVX/SSE transition penalty */
+	for (; it + 16 <= len; it += 16)
+		if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (str + it))))
+			return 0;
+
+	return is_ascii_scalar(str + it, len - it);
+}
+
+static SCAN_TARGET("avx2") void tolower_avx2(char *s, size_t len)
+{
+	const __m256i shift = _mm256_set1_epi8((char) (0x80 - 'A')), limit = _mm256_set1_epi8(-128 + 26), diff = _mm256_set1_epi8(0x20);
+	size_t it;
+
+	for (it = 0; it + 32 <= len; it += 32) {
+		__m256i in = _mm256_loadu_si256((const __m256i *) (s + it));
+		__m256i upper = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(in, shift));
+
+		_mm256_storeu_si256((__m256i *) (s + it), _mm256_add_epi8(in, _mm256_and_si256(upper, diff)));
+	}
+
+	for (; it + 16 <= len; it += 16) {
+		__m128i in = _mm_loadu_si128((const __m128i *) (s + it));
+		__m128i upper = _mm_cmplt_epi8(_mm_add_epi8(in, _mm256_castsi256_si128(shift)), _mm256_castsi256_si128(limit));
+
+		_mm_storeu_si128((__m128i *) (s + it), _mm_add_epi8(in, _mm_and_si128(upper, _mm256_castsi256_si128(diff))));
+	}
+
+	tolower_scalar(s + it, len - it);
+}
+
+static int cpu_has_ssse3(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+static int cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+		return 0; /* the OS doesn't save the AVX registers */
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif /* SCAN_X86 */
+
+/* best first, the scalar reference must be the last entry */
+static const psl_scan_impl_t scan_variants[] = {
+#ifdef SCAN_X86
+	{ "avx2", cpu_has_avx2, scan_avx2, is_ascii_avx2, tolower_avx2 },
+	{ "ssse3", cpu_has_ssse3, scan_ssse3, is_ascii_sse2, tolower_sse2 },
+#endif
+	{ "scalar", NULL, scan_scalar, is_ascii_scalar, tolower_scalar },
+};
+
+/* set on first use to the best variant the CPU supports */
+static const psl_scan_impl_t *volatile scan_selected;
+
+static const psl_scan_impl_t *get_impl(void)
+{
+	const psl_scan_impl_t *p = PSL_LOAD_RELAXED(scan_selected);
+
+	if (!p) {
+		for (p = scan_variants; p->supported && !p->supported(); p++)
+			;
+
+		/* all threads store the same value */
+		PSL_STORE_RELAXED(scan_selected, p);
+	}
+
+	return p;
+}
+
+const psl_scan_impl_t *psl_scan_impls(size_t *n)
+{
+	*n = sizeof(scan_variants) / sizeof(scan_variants[0]);
+	return scan_variants;
+}
+
+void psl_scan_domain(const char *s, size_t len, psl_scan_t *scan)
+{
+	get_impl()->scan_domain(s, len, scan);
+}
+
+int psl_scan_is_ascii(const char *s, size_t len)
+{
+	return get_impl()->is_ascii(s, len);
+}
+
+void psl_scan_tolower_ascii(char *s, size_t len)
+{
+	get_impl()->tolower_ascii(s, len);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of libpsl.
+ *
+ * Internal input scanning routines
+ */
+
+#ifndef PSL_SCAN_H
+#define PSL_SCAN_H
+
+#include <stddef.h>
+
+/* result of psl_scan_domain() */
+typedef struct {
+	size_t
+		ndots; /* number of '.', the number of labels is ndots + 1 */
+	unsigned
+		nonascii : 1, /* 1: contains bytes >= 0x80 */
+		valid : 1; /* 1: valid UTF-8 (no overlongs, surrogates or code points > 0x10FFFF) */
+} psl_scan_t;
+
+/* a set of scan routines, all working on the same instruction set */
+typedef struct {
+	const char
+		*name; /* "scalar", "ssse3", "avx2" */
+	int
+		(*supported)(void); /* NULL: always supported */
+	void
+		(*scan_domain)(const char *s, size_t len, psl_scan_t *scan);
+	int
+		(*is_ascii)(const char *s, size_t len);
+	void
+		(*tolower_ascii)(char *s, size_t len);
+} psl_scan_impl_t;
+
+/*
+ * Scan 'len' bytes of 's' in a single pass: validate UTF-8, check for non-ASCII
+ * bytes and count the label separators.
+ */
+void psl_scan_domain(const char *s, size_t len, psl_scan_t *scan);
+
+/* Returns 1 if 'len' bytes of 's' are all < 0x80, else 0. */
+int psl_scan_is_ascii(const char *s, size_t len);
+
+/* Converts 'A'-'Z' into 'a'-'z' in place, other bytes are left untouched. */
+void psl_scan_tolower_ascii(char *s, size_t len);
+
+/*
+ * Returns the compiled in variants, best first, the scalar reference last.
+ * The above functions dispatch to the first variant supported by the CPU.
+ * For tests and benchmarks.
+ */
+const psl_scan_impl_t *psl_scan_impls(size_t *n);
+
+/*
+ * Relaxed atomic load and store of the variant selected on first use, as any thread may select it.
+ * Without the __atomic builtins (MSVC), the variable has to be declared volatile, which is atomic
+ * for aligned pointers there.
+ */
+#if (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))) || defined(__clang__)
+#  define PSL_LOAD_RELAXED(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#  define PSL_STORE_RELAXED(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELAXED)
+#else
+#  define PSL_LOAD_RELAXED(var) (var)
+#  define PSL_STORE_RELAXED(var, value) ((var) = (value))
+#endif
+
+#endif /* PSL_SCAN_H */
@@ -0,0 +1,1203 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of the test suite of libpsl.
+ *
+ * Benchmarks for libpsl.
+ *
+ * The results depend on the IDNA runtime libpsl has been built with.
+ * To compare the runtimes, build libpsl once per runtime, e.g.
+ *   meson setup -Druntime=native builddir-native
+ *   meson setup -Druntime=libicu builddir-icu
+ * and run 'meson test --benchmark' (or 'make -C tests run-benchmark') in each build directory.
+ *
+ * The *_dafsa, *_vector, *_mph and *_darray benchmarks compare the lookup engines of psl_load_ex() on the same rules.
+ * The LOUDS trie needs ASCII rules, *_louds compares best with is_public_suffix_dafsa_ascii.
+ * The *_jit benchmarks need libpsl configured with -Djit=true (--enable-jit) on x86-64,
+ * else they run the DAFSA engine.
+ *
+ * The *_builtin benchmarks use the compiled matcher instead of the DAFSA if libpsl has been configured
+ * with -Dbuiltin_code=true (--enable-builtin-code), compare them with a build without it.
+ *
+ * The scan_* micro benchmarks run each variant of the input scanning routines
+ * supported by the CPU, the scalar one being the reference.
+ *
+ * The fanout_* micro benchmarks look up the TLD of each domain directly in the DAFSA data, so most
+ * of the time is spent in the nodes with many children at the top of the graph. They compare
+ * the lists of offsets (psl_ascii.dafsa), the dense tables (psl.dafsa, nodes with 16 or more
+ * children) and the vector nodes (psl_vector.dafsa, nodes with 4 or more children, searched with
+ * SSE2/NEON unless configured with -Dsimd=false or --disable-simd).
+ *
+ * The lookup_batch_* benchmarks look up the rule strings in a double-array trie, 64 at once (see
+ * batch_impl_t), to compare with is_public_suffix_darray. Each variant is checked against single
+ * lookups before it is measured.
+ *
+ * The hosts_* benchmarks look up all suffixes of host names, like psl_registrable_domain(), in the
+ * DAFSA of psl.dafsa (nodes in the default order) and of psl_locality.dafsa (psl-make-dafsa --layout=locality,
+ * the nodes most lookups read first). The host names are a synthetic corpus with most of them under the
+ * popular TLDs, or the ones of the file given with --hosts (one per line, used over and over again).
+ *
+ * Where the kernel provides a hardware counter of cache misses (Linux perf events, not in most
+ * virtual machines), each benchmark also reports the cache misses per domain.
+ *
+ * Usage: benchmark [--hosts=FILE] [name...]
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#  include <linux/perf_event.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+#include <libpsl.h>
+
+/* the scan routines, the DAFSA lookups and the darray engine are hidden symbols of libpsl, so compile them in */
+#include "scan.c"
+#include "lookup_string_in_fixed_set.c"
+#include "darray.c"
+
+#define countof(a) (sizeof(a)/sizeof(*(a)))
+
+/*
+ * The batch lookups of the lookup_batch_* benchmarks, an experiment on the double-array trie
+ * that is not part of libpsl. With AVX-512, 16 keys are walked in lockstep, one byte of each
+ * key per step. The walks are independent, so their cache misses overlap instead of adding up,
+ * and the base and check values of all lanes are loaded by one gather each. A lane that is done
+ * takes the next key right away. It was not faster than single lookups on all key sets, lockstep
+ * walks with AVX2 gathers or scalar loads were slower than that.
+ */
+typedef struct {
+	const char
+		*name; /* "scalar", "avx512" */
+	int
+		(*supported)(void); /* NULL: always supported */
+	void
+		(*lookup_batch)(const void *data, const char * const *keys, const size_t *lens, size_t n, int nocase, int *results);
+} batch_impl_t;
+
+/* the reference batch lookup, one walk after the other */
+static void batch_lookup_scalar(const void *data, const char * const *keys, const size_t *lens, size_t n, int nocase, int *results)
+{
+	size_t it;
+
+	for (it = 0; it < n; it++)
+		results[it] = darray_engine_lookup(data, keys[it], lens[it], 1, nocase);
+}
+
+#ifdef SCAN_X86
+static int cpu_has_avx512(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 0xE6) != 0xE6)
+		return 0; /* the OS doesn't save the AVX-512 registers */
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 16)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512f");
+#endif
+}
+
+/*
+ * The keys of a batch are copied into chunks, so the bytes of all lanes are loaded
+ * by a gather, four bytes at a time of which the lowest one is used. The units are
+ * read as an array of int, base of unit t at index 2t and check at 2t + 1.
+ */
+#define BATCH_CHUNK_KEYS 256
+#define BATCH_CHUNK_SIZE 8192
+
+/* the keys of a batch lookup that need a walk, one after the other with their NUL */
+typedef struct {
+	unsigned char
+		buf[BATCH_CHUNK_SIZE + 3]; /* the gathers read 3 bytes behind the last NUL */
+	int
+		key[BATCH_CHUNK_KEYS], /* offset in 'buf' | length << 13 | index in the batch, from the first key of the chunk, << 21 */
+		nkeys,
+		result[BATCH_CHUNK_KEYS], /* index << 8 | lowest byte of the result */
+		nresults;
+} batch_chunk_t;
+
+/* fills 'chunk' with the keys from 'it' on, returns the first key that doesn't fit */
+static size_t batch_chunk_fill(const psl_darray_t *d, batch_chunk_t *chunk, const char * const *keys, const size_t *lens, size_t it, size_t n, int *results)
+{
+	size_t first = it, size = 0;
+
+	chunk->nkeys = chunk->nresults = 0;
+
+	for (; it < n && it - first < BATCH_CHUNK_KEYS; it++) {
+		if (!d->nunits || lens[it] > DARRAY_MAX_KEY) {
+			results[it] = -1;
+			continue;
+		}
+
+		if (size + lens[it] + 1 > BATCH_CHUNK_SIZE)
+			break;
+
+		memcpy(chunk->buf + size, keys[it], lens[it]);
+		chunk->buf[size + lens[it]] = 0;
+		chunk->key[chunk->nkeys++] = (int) (size | lens[it] << 13 | (it - first) << 21);
+		size += lens[it] + 1;
+	}
+
+	memset(chunk->buf + size, 0, 3);
+
+	return it;
+}
+
+/* copies the results of a chunk that starts at 'results' */
+static void batch_chunk_results(const batch_chunk_t *chunk, int *results)
+{
+	int it;
+
+	for (it = 0; it < chunk->nresults; it++)
+		results[chunk->result[it] >> 8] = (signed char) (chunk->result[it] & 0xFF);
+}
+
+/* branch-free, the lanes that are done differ in each step */
+static unsigned batch_popcount(unsigned x)
+{
+	x = x - ((x >> 1) & 0x5555);
+	x = (x & 0x3333) + ((x >> 2) & 0x3333);
+	x = (x + (x >> 4)) & 0x0F0F;
+	return (x + (x >> 8)) & 0x1F;
+}
+
+static SCAN_TARGET("avx512f") void batch_lookup_avx512(const void *data, const char * const *keys, const size_t *lens, size_t n, int nocase, int *results)
+{
+	const psl_darray_t *d = (const psl_darray_t *) data;
+	const int *units = (const int *) d->units;
+	const __m512i
+		zero = _mm512_setzero_si512(),
+		minus1 = _mm512_set1_epi32(-1),
+		one = _mm512_set1_epi32(1),
+		low_byte = _mm512_set1_epi32(0xFF),
+		low_nibble = _mm512_set1_epi32(0x0F),
+		offset_mask = _mm512_set1_epi32(0x1FFF),
+		nunits = _mm512_set1_epi32(d->nunits),
+		before_a = _mm512_set1_epi32('A' - 1),
+		after_z = _mm512_set1_epi32('Z' + 1),
+		case_bit = _mm512_set1_epi32(0x20);
+	batch_chunk_t chunk;
+	__m512i vs, vpos, vend, vkey, vt, vc, base, check;
+	__mmask16 active, failed, ended, done, refill, mask;
+	size_t it, next, first;
+
+	for (it = 0; it < n;) {
+		first = it;
+		it = batch_chunk_fill(d, &chunk, keys, lens, it, n, results);
+
+		active = chunk.nkeys < 16 ? (__mmask16) ((1U << chunk.nkeys) - 1) : (__mmask16) 0xFFFF;
+		next = chunk.nkeys < 16 ? chunk.nkeys : 16;
+		failed = ended = 0;
+		vs = zero;
+		vkey = _mm512_maskz_loadu_epi32(active, chunk.key);
+		vpos = _mm512_and_si512(vkey, offset_mask);
+		vend = _mm512_add_epi32(vpos, _mm512_and_si512(_mm512_srli_epi32(vkey, 13), low_byte));
+
+		while (active) {
+			vc = _mm512_and_si512(_mm512_mask_i32gather_epi32(zero, active, vpos, chunk.buf, 1), low_byte);
+			if (nocase) {
+				mask = _mm512_cmpgt_epi32_mask(vc, before_a) & _mm512_cmplt_epi32_mask(vc, after_z);
+				vc = _mm512_mask_or_epi32(vc, mask, vc, case_bit);
+			}
+
+			/* a failed lane walks on until it is replaced, the masks keep its gathers in range */
+			mask = _mm512_mask_cmplt_epu32_mask(active, vs, nunits);
+			base = _mm512_mask_i32gather_epi32(zero, mask, _mm512_slli_epi32(vs, 1), units, 4);
+			vt = _mm512_add_epi32(base, vc);
+
+			/*
+			 * The lanes that took the transition for the NUL in the previous step have the
+			 * value as base now. They are done, like the lanes that failed in a previous step.
+			 * So the next state doesn't wait for the check gather of this step.
+			 */
+			done = ended | (failed & active);
+			base = _mm512_mask_and_epi32(minus1, ended & (__mmask16) ~failed, _mm512_sub_epi32(minus1, base), low_nibble);
+			base = _mm512_or_si512(_mm512_slli_epi32(_mm512_srli_epi32(vkey, 21), 8), _mm512_and_si512(base, low_byte));
+			_mm512_mask_compressstoreu_epi32(chunk.result + chunk.nresults, done, base);
+			chunk.nresults += (int) batch_popcount(done);
+
+			mask = _mm512_mask_cmplt_epu32_mask(active, vt, nunits);
+			check = _mm512_mask_i32gather_epi32(minus1, mask, _mm512_add_epi32(_mm512_slli_epi32(vt, 1), one), units, 4);
+			failed |= active & (__mmask16) ~_mm512_mask_cmpeq_epi32_mask(mask, check, vs);
+			ended = _mm512_mask_cmpeq_epi32_mask(active & (__mmask16) ~done, vpos, vend);
+
+			/* the lanes take the next keys, in order, at the root */
+			refill = done;
+			if (next + batch_popcount(refill) > (size_t) chunk.nkeys) {
+				/* the last keys of the chunk */
+				for (refill = 0, mask = done; mask && next + batch_popcount(refill) < (size_t) chunk.nkeys; mask &= mask - 1)
+					refill |= mask & -mask;
+			}
+
+			vkey = _mm512_mask_expandloadu_epi32(vkey, refill, chunk.key + next);
+			vs = _mm512_mask_mov_epi32(vt, refill, zero);
+			vpos = _mm512_mask_and_epi32(_mm512_add_epi32(vpos, one), refill, vkey, offset_mask);
+			vend = _mm512_mask_add_epi32(vend, refill, vpos, _mm512_and_si512(_mm512_srli_epi32(vkey, 13), low_byte));
+			next += batch_popcount(refill);
+			failed &= (__mmask16) ~refill;
+			active &= (__mmask16) ~(done & ~refill);
+		}
+
+		batch_chunk_results(&chunk, results + first);
+	}
+}
+#endif /* SCAN_X86 */
+
+/* best first, the scalar variant must be the last entry */
+static const batch_impl_t batch_variants[] = {
+#ifdef SCAN_X86
+	{ "avx512", cpu_has_avx512, batch_lookup_avx512 },
+#endif
+	{ "scalar", NULL, batch_lookup_scalar },
+};
+
+/* the PSL entries, read from PSL_FILE */
+static char **domains;
+static int ndomains;
+
+/* the domains of the wildcard rules, e.g. 'www.kawasaki.jp' for '*.kawasaki.jp', pointers into domains */
+static char **wildcards;
+static int nwildcards;
+
+static const psl_ctx_t *psl_ascii;
+
+/* the same rules in each lookup engine, see psl_load_ex() */
+static const psl_ctx_t *psl_dafsa, *psl_vector, *psl_mph, *psl_darray, *psl_louds, *psl_jit;
+
+/* the same DAFSA with payloads, with the labels of the strings in forward and in reverse order */
+static const psl_ctx_t *psl_payload, *psl_reversed;
+
+/* the graphs of the fanout_* and hosts_* benchmarks, without the file header */
+static unsigned char *graph_offsets, *graph_dense, *graph_vector, *graph_locality;
+static size_t graph_offsets_size, graph_dense_size, graph_vector_size, graph_locality_size;
+
+/* the host names of the hosts_* benchmarks, as many as domains */
+static char **hosts;
+
+/* the hardware counter of cache misses, -1 if there is none */
+static int perf_fd = -1;
+
+/* the variant used by the scan_* benchmarks */
+static const psl_scan_impl_t *scan_impl;
+
+/* the rule strings of the PSL in a double-array trie and the variant used by the lookup_batch_* benchmarks */
+static void *darray;
+static const batch_impl_t *batch_impl;
+
+/* prevent the compiler from optimizing the benchmarked calls away */
+static volatile size_t sink;
+
+static double now_ns(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+#else
+	return clock() * (1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
+static int isspace_ascii(const char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int read_domains(const char *fname)
+{
+	FILE *fp;
+	char buf[256], *linep, *p;
+	int size = 0, wildcards_size = 0, wildcard;
+
+	if (!(fp = fopen(fname, "r"))) {
+		fprintf(stderr, "Failed to open %s\n", fname);
+		return -1;
+	}
+
+	while ((linep = fgets(buf, sizeof(buf), fp))) {
+		while (isspace_ascii(*linep)) linep++; /* ignore leading whitespace */
+		if (!*linep || (*linep == '/' && linep[1] == '/')) continue; /* skip empty lines and comments */
+
+		/* strip wildcard and exception markers, prepend a host label */
+		if ((wildcard = *linep == '*' && linep[1] == '.'))
+			linep += 2;
+		else if (*linep == '!')
+			linep++;
+
+		for (p = linep; *linep && !isspace_ascii(*linep);) linep++;
+		*linep = 0;
+
+		if (ndomains >= size) {
+			char **tmp = realloc(domains, (size = size ? size * 2 : 1024) * sizeof(char *));
+			if (!tmp)
+				break;
+			domains = tmp;
+		}
+
+		if (!(domains[ndomains] = malloc(strlen(p) + 5)))
+			break;
+
+		strcpy(domains[ndomains], "www.");
+		strcpy(domains[ndomains] + 4, p);
+
+		if (wildcard) {
+			if (nwildcards >= wildcards_size) {
+				char **tmp = realloc(wildcards, (wildcards_size = wildcards_size ? wildcards_size * 2 : 128) * sizeof(char *));
+				if (!tmp)
+					break;
+				wildcards = tmp;
+			}
+			wildcards[nwildcards++] = domains[ndomains];
+		}
+
+		ndomains++;
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+/* suffixes of popular host names and their share in percent, roughly as in web crawls, the other 10% are PSL entries */
+static const struct {
+	const char *suffix;
+	unsigned share;
+} popular_suffixes[] = {
+	{ "com", 48 }, { "net", 6 }, { "org", 6 }, { "de", 5 }, { "ru", 4 }, { "co.uk", 3 },
+	{ "jp", 2 }, { "com.br", 2 }, { "fr", 2 }, { "it", 2 }, { "nl", 2 }, { "pl", 2 },
+	{ "com.au", 1 }, { "in", 1 }, { "io", 1 }, { "info", 1 }, { "cn", 1 }, { "github.io", 1 },
+};
+
+/* fills 'hosts' with the host names of 'fname' or, if NULL, with the synthetic corpus */
+static int make_hosts(const char *fname)
+{
+	static const char *labels[] = { "www", "mail", "shop", "blog", "api", "cdn", "static", "m" };
+	char buf[256], *linep, *p;
+	unsigned seed = 1, share, n;
+	int it = 0;
+	FILE *fp;
+
+	if (!(hosts = calloc(ndomains, sizeof(char *))))
+		return -1;
+
+	if (fname) {
+		if (!(fp = fopen(fname, "r"))) {
+			fprintf(stderr, "Failed to open %s\n", fname);
+			return -1;
+		}
+
+		while (it < ndomains && (linep = fgets(buf, sizeof(buf), fp))) {
+			while (isspace_ascii(*linep)) linep++;
+			if (!*linep || *linep == '#') continue; /* skip empty lines and comments */
+
+			for (p = linep; *p && !isspace_ascii(*p);) p++;
+			*p = 0;
+
+			if (!(hosts[it++] = strdup(linep)))
+				break;
+		}
+
+		fclose(fp);
+
+		if (!it || !hosts[it - 1]) {
+			fprintf(stderr, "Failed to read host names from %s\n", fname);
+			return -1;
+		}
+
+		/* used over and over again */
+		for (n = it; it < ndomains; it++)
+			if (!(hosts[it] = strdup(hosts[it % n])))
+				return -1;
+
+		return 0;
+	}
+
+	for (it = 0; it < ndomains; it++) {
+		seed = seed * 1103515245 + 12345;
+		share = (seed >> 16) % 100;
+
+		for (n = 0; n < countof(popular_suffixes) && share >= popular_suffixes[n].share; n++)
+			share -= popular_suffixes[n].share;
+
+		if (n < countof(popular_suffixes)) {
+			snprintf(buf, sizeof(buf), "%s.site%d.%s", labels[it % countof(labels)], it, popular_suffixes[n].suffix);
+			hosts[it] = strdup(buf);
+		} else
+			hosts[it] = strdup(domains[(seed >> 8) % ndomains]);
+
+		if (!hosts[it])
+			return -1;
+	}
+
+	return 0;
+}
+
+/* opens the hardware counter of cache misses of this process, if any */
+static void cache_misses_open(void)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	perf_fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+/* returns the number of cache misses so far, 0 without a counter */
+static double cache_misses(void)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	__u64 count;
+
+	if (perf_fd >= 0 && read(perf_fd, &count, sizeof(count)) == sizeof(count))
+		return (double) count;
+#endif
+
+	return 0;
+}
+
+/* reads the DAFSA of a binary DAFSA file, returns NULL if it can't be read or doesn't pass ValidateDafsa() */
+static unsigned char *read_graph(const char *fname, size_t *size)
+{
+	unsigned char *graph = NULL;
+	long len;
+	FILE *fp;
+
+	if (!(fp = fopen(fname, "rb")))
+		return NULL;
+
+	if (!fseek(fp, 0, SEEK_END) && (len = ftell(fp)) > 16 && !fseek(fp, 16, SEEK_SET)
+		&& (graph = malloc(len - 16)) && fread(graph, 1, len - 16, fp) == (size_t) (len - 16)
+		&& ValidateDafsa(graph, len - 16, 0))
+	{
+		*size = len - 16;
+	} else {
+		free(graph);
+		graph = NULL;
+	}
+
+	fclose(fp);
+
+	return graph;
+}
+
+static size_t bench_load_file(void)
+{
+	psl_ctx_t *psl = psl_load_file(PSL_FILE); /* converts all IDN rules into punycode */
+	size_t n = psl_suffix_count(psl);
+
+	psl_free(psl);
+
+	return n;
+}
+
+static size_t load_dafsa(psl_load_memory_t memory)
+{
+	psl_load_options_t options = { sizeof(psl_load_options_t), PSL_ENGINE_DAFSA, PSL_MEMORY_COPY, 0 };
+	psl_ctx_t *psl;
+	size_t n;
+
+	options.memory = memory;
+	psl = psl_load_ex(PSL_DAFSA, &options);
+	n = psl_memory_usage(psl);
+	psl_free(psl);
+
+	return n;
+}
+
+static size_t bench_load_dafsa_copy(void)
+{
+	return load_dafsa(PSL_MEMORY_COPY);
+}
+
+static size_t bench_load_dafsa_mmap(void)
+{
+	return load_dafsa(PSL_MEMORY_MMAP);
+}
+
+static size_t bench_load_mph_mmap(void)
+{
+	psl_load_options_t options = { sizeof(psl_load_options_t), PSL_ENGINE_MPH, PSL_MEMORY_MMAP, 0 };
+	psl_ctx_t *psl;
+	size_t n;
+
+	psl = psl_load_ex(PSL_MPH, &options);
+	n = psl_memory_usage(psl);
+	psl_free(psl);
+
+	return n;
+}
+
+static size_t bench_load_darray(void)
+{
+	psl_load_options_t options = { sizeof(psl_load_options_t), PSL_ENGINE_DARRAY, PSL_MEMORY_COPY, 0 };
+	psl_ctx_t *psl;
+	size_t n;
+
+	psl = psl_load_ex(PSL_DAFSA, &options);
+	n = psl_memory_usage(psl);
+	psl_free(psl);
+
+	return n;
+}
+
+static size_t bench_load_louds_mmap(void)
+{
+	psl_load_options_t options = { sizeof(psl_load_options_t), PSL_ENGINE_LOUDS, PSL_MEMORY_MMAP, 0 };
+	psl_ctx_t *psl;
+	size_t n;
+
+	psl = psl_load_ex(PSL_ASCII_LOUDS, &options);
+	n = psl_memory_usage(psl);
+	psl_free(psl);
+
+	return n;
+}
+
+static size_t bench_load_jit(void)
+{
+	psl_load_options_t options = { sizeof(psl_load_options_t), PSL_ENGINE_JIT, PSL_MEMORY_COPY, 0 };
+	psl_ctx_t *psl;
+	size_t n;
+
+	psl = psl_load_ex(PSL_DAFSA, &options);
+	n = psl_memory_usage(psl);
+	psl_free(psl);
+
+	return n;
+}
+
+static size_t bench_str_to_utf8lower(void)
+{
+	size_t n = 0;
+	char *lower;
+	int it;
+
+	for (it = 0; it < ndomains; it++) {
+		if (psl_str_to_utf8lower(domains[it], "utf-8", NULL, &lower) == PSL_SUCCESS) {
+			n += strlen(lower);
+			psl_free_string(lower);
+		}
+	}
+
+	return n;
+}
+
+static size_t bench_registrable_domain_idn(void)
+{
+	size_t n = 0;
+	int it;
+
+	/* the ASCII DAFSA needs a toASCII conversion of each non-ASCII domain */
+	for (it = 0; it < ndomains; it++)
+		n += psl_registrable_domain(psl_ascii, domains[it]) != NULL;
+
+	return n;
+}
+
+static size_t bench_registrable_domain_builtin(void)
+{
+	const psl_ctx_t *psl = psl_builtin();
+	size_t n = 0;
+	int it;
+
+	for (it = 0; it < ndomains; it++)
+		n += psl_registrable_domain(psl, domains[it]) != NULL;
+
+	return n;
+}
+
+static size_t bench_registrable_domain_deep(void)
+{
+	const psl_ctx_t *psl = psl_builtin();
+	char buf[256];
+	size_t n = 0, len;
+	int it;
+
+	/* host names with more labels than most rules, bounded by the max. rule depth per TLD */
+	memcpy(buf, "a.b.c.d.e.", 10);
+
+	for (it = 0; it < ndomains; it++) {
+		if ((len = strlen(domains[it])) < sizeof(buf) - 10) {
+			memcpy(buf + 10, domains[it], len + 1);
+			n += psl_registrable_domain(psl, buf) != NULL;
+		}
+	}
+
+	return n;
+}
+
+static size_t bench_registrable_domain_unlisted(void)
+{
+	const psl_ctx_t *psl = psl_builtin();
+	char buf[256];
+	size_t n = 0, len;
+	int it;
+
+	/* internal host names, the TLD is not in the PSL */
+	for (it = 0; it < ndomains; it++) {
+		if ((len = strlen(domains[it])) < sizeof(buf) - 10) {
+			memcpy(buf, domains[it], len);
+			memcpy(buf + len, ".internal", 10);
+			n += psl_registrable_domain(psl, buf) != NULL;
+		}
+	}
+
+	return n;
+}
+
+static size_t bench_is_public_suffix_builtin(void)
+{
+	const psl_ctx_t *psl = psl_builtin();
+	size_t n = 0;
+	int it;
+
+	/* the domains are public suffixes with a 'www.' label, so each call needs two lookups */
+	for (it = 0; it < ndomains; it++)
+		n += psl_is_public_suffix(psl, domains[it]);
+
+	return n;
+}
+
+static size_t is_public_suffix(const psl_ctx_t *psl)
+{
+	size_t n = 0;
+	int it;
+
+	for (it = 0; it < ndomains; it++)
+		n += psl_is_public_suffix(psl, domains[it]);
+
+	return n;
+}
+
+static size_t bench_is_public_suffix_dafsa(void)
+{
+	return is_public_suffix(psl_dafsa);
+}
+
+static size_t bench_is_public_suffix_dafsa_ascii(void)
+{
+	return is_public_suffix(psl_ascii);
+}
+
+static size_t bench_is_public_suffix_vector(void)
+{
+	return is_public_suffix(psl_vector);
+}
+
+static size_t bench_is_public_suffix_mph(void)
+{
+	return is_public_suffix(psl_mph);
+}
+
+static size_t bench_is_public_suffix_darray(void)
+{
+	return is_public_suffix(psl_darray);
+}
+
+static size_t bench_is_public_suffix_louds(void)
+{
+	return is_public_suffix(psl_louds);
+}
+
+static size_t bench_is_public_suffix_jit(void)
+{
+	return is_public_suffix(psl_jit);
+}
+
+static size_t bench_is_public_suffix_payload(void)
+{
+	return is_public_suffix(psl_payload);
+}
+
+static size_t bench_is_public_suffix_reversed(void)
+{
+	return is_public_suffix(psl_reversed);
+}
+
+static size_t is_public_suffix_wildcard(const psl_ctx_t *psl)
+{
+	size_t n = 0;
+	int it;
+
+	/* ndomains lookups, each needs the rules of the domain and of its parent */
+	for (it = 0; it < ndomains && nwildcards; it++)
+		n += psl_is_public_suffix(psl, wildcards[it % nwildcards]);
+
+	return n;
+}
+
+static size_t bench_wildcard_payload(void)
+{
+	return is_public_suffix_wildcard(psl_payload);
+}
+
+static size_t bench_wildcard_reversed(void)
+{
+	return is_public_suffix_wildcard(psl_reversed);
+}
+
+static size_t registrable_domain_hosts(const psl_ctx_t *psl)
+{
+	size_t n = 0;
+	int it;
+
+	/* each call checks the suffixes of the host from left to right */
+	for (it = 0; it < ndomains; it++)
+		n += psl_registrable_domain(psl, hosts[it]) != NULL;
+
+	return n;
+}
+
+static size_t bench_registrable_domain_payload(void)
+{
+	return registrable_domain_hosts(psl_payload);
+}
+
+static size_t bench_registrable_domain_reversed(void)
+{
+	return registrable_domain_hosts(psl_reversed);
+}
+
+static size_t fanout(const unsigned char *graph, size_t size)
+{
+	const char *tld;
+	size_t n = 0;
+	int it;
+
+	if (!graph)
+		return 0;
+
+	for (it = 0; it < ndomains; it++) {
+		tld = strrchr(domains[it], '.') + 1;
+		n += LookupStringInValidFixedSet(graph, size, tld, strlen(tld)) + 1;
+	}
+
+	return n;
+}
+
+static size_t bench_fanout_offsets(void)
+{
+	return fanout(graph_offsets, graph_offsets_size);
+}
+
+static size_t bench_fanout_dense(void)
+{
+	return fanout(graph_dense, graph_dense_size);
+}
+
+static size_t bench_fanout_vector(void)
+{
+	return fanout(graph_vector, graph_vector_size);
+}
+
+/* all suffixes of each host name, like psl_registrable_domain() */
+static size_t lookup_hosts(const unsigned char *graph, size_t size)
+{
+	const char *p;
+	size_t n = 0;
+	int it;
+
+	if (!graph)
+		return 0;
+
+	for (it = 0; it < ndomains; it++) {
+		for (p = hosts[it]; p; p = strchr(p, '.')) {
+			if (*p == '.')
+				p++;
+			n += LookupStringInValidFixedSet(graph, size, p, strlen(p)) + 1;
+		}
+	}
+
+	return n;
+}
+
+static size_t bench_hosts_compact(void)
+{
+	return lookup_hosts(graph_dense, graph_dense_size);
+}
+
+static size_t bench_hosts_locality(void)
+{
+	return lookup_hosts(graph_locality, graph_locality_size);
+}
+
+/* the foreach function of an engine with the rule strings of the domains, the flags from the DAFSA */
+static int domains_foreach(const void *data, psl_rule_callback_t callback, void *user_data)
+{
+	const char *rule;
+	int it, flags, rc;
+
+	(void) data;
+
+	for (it = 0; it < ndomains; it++) {
+		rule = domains[it] + 4;
+		if ((flags = LookupStringInValidFixedSet(graph_dense, graph_dense_size, rule, strlen(rule))) >= 0
+			&& (rc = callback(rule, strlen(rule), flags, NULL, user_data)))
+		{
+			return rc;
+		}
+	}
+
+	return 0;
+}
+
+/* the rule strings without the 'www.' label, 64 at once */
+static size_t bench_lookup_batch(void)
+{
+	const char *keys[64];
+	size_t lens[64], n = 0, nkeys, k;
+	int results[64], it;
+
+	for (it = 0; it < ndomains;) {
+		for (nkeys = 0; nkeys < 64 && it < ndomains; nkeys++, it++) {
+			keys[nkeys] = domains[it] + 4;
+			lens[nkeys] = strlen(keys[nkeys]);
+		}
+
+		batch_impl->lookup_batch(darray, keys, lens, nkeys, 0, results);
+
+		for (k = 0; k < nkeys; k++)
+			n += results[k] + 1;
+	}
+
+	return n;
+}
+
+static size_t bench_scan_domain(void)
+{
+	psl_scan_t scan;
+	size_t n = 0;
+	int it;
+
+	for (it = 0; it < ndomains; it++) {
+		scan_impl->scan_domain(domains[it], strlen(domains[it]), &scan);
+		n += scan.ndots + scan.valid;
+	}
+
+	return n;
+}
+
+static size_t bench_scan_is_ascii(void)
+{
+	size_t n = 0;
+	int it;
+
+	for (it = 0; it < ndomains; it++)
+		n += scan_impl->is_ascii(domains[it], strlen(domains[it]));
+
+	return n;
+}
+
+static size_t bench_scan_tolower_ascii(void)
+{
+	char buf[256];
+	size_t n = 0, len;
+	int it;
+
+	for (it = 0; it < ndomains; it++) {
+		if ((len = strlen(domains[it])) < sizeof(buf)) {
+			memcpy(buf, domains[it], len);
+			scan_impl->tolower_ascii(buf, len);
+			n += (unsigned char) buf[0];
+		}
+	}
+
+	return n;
+}
+
+static const struct benchmark {
+	const char *name;
+	size_t (*func)(void);
+	int loops;
+	const char *variant; /* of the scan routines or the batch lookup */
+} benchmarks[] = {
+	{ "load_file", bench_load_file, 5, NULL },
+	{ "load_dafsa_copy", bench_load_dafsa_copy, 50, NULL },
+	{ "load_dafsa_mmap", bench_load_dafsa_mmap, 50, NULL },
+	{ "load_mph_mmap", bench_load_mph_mmap, 50, NULL },
+	{ "load_darray", bench_load_darray, 20, NULL },
+	{ "load_louds_mmap", bench_load_louds_mmap, 50, NULL },
+	{ "load_jit", bench_load_jit, 5, NULL },
+	{ "str_to_utf8lower", bench_str_to_utf8lower, 20, NULL },
+	{ "registrable_domain_idn", bench_registrable_domain_idn, 20, NULL },
+	{ "registrable_domain_builtin", bench_registrable_domain_builtin, 20, NULL },
+	{ "registrable_domain_deep", bench_registrable_domain_deep, 20, NULL },
+	{ "registrable_domain_unlisted", bench_registrable_domain_unlisted, 20, NULL },
+	{ "is_public_suffix_builtin", bench_is_public_suffix_builtin, 50, NULL },
+	{ "is_public_suffix_dafsa", bench_is_public_suffix_dafsa, 50, NULL },
+	{ "is_public_suffix_vector", bench_is_public_suffix_vector, 50, NULL },
+	{ "is_public_suffix_mph", bench_is_public_suffix_mph, 50, NULL },
+	{ "is_public_suffix_darray", bench_is_public_suffix_darray, 50, NULL },
+	{ "is_public_suffix_dafsa_ascii", bench_is_public_suffix_dafsa_ascii, 50, NULL },
+	{ "is_public_suffix_louds", bench_is_public_suffix_louds, 50, NULL },
+	{ "is_public_suffix_jit", bench_is_public_suffix_jit, 50, NULL },
+	{ "is_public_suffix_payload", bench_is_public_suffix_payload, 50, NULL },
+	{ "is_public_suffix_reversed", bench_is_public_suffix_reversed, 50, NULL },
+	{ "wildcard_payload", bench_wildcard_payload, 50, NULL },
+	{ "wildcard_reversed", bench_wildcard_reversed, 50, NULL },
+	{ "registrable_domain_payload", bench_registrable_domain_payload, 20, NULL },
+	{ "registrable_domain_reversed", bench_registrable_domain_reversed, 20, NULL },
+	{ "lookup_batch_scalar", bench_lookup_batch, 200, "scalar" },
+	{ "lookup_batch_avx512", bench_lookup_batch, 200, "avx512" },
+	{ "fanout_offsets", bench_fanout_offsets, 200, NULL },
+	{ "fanout_dense", bench_fanout_dense, 200, NULL },
+	{ "fanout_vector", bench_fanout_vector, 200, NULL },
+	{ "hosts_compact", bench_hosts_compact, 50, NULL },
+	{ "hosts_locality", bench_hosts_locality, 50, NULL },
+	{ "scan_domain_scalar", bench_scan_domain, 200, "scalar" },
+	{ "scan_domain_ssse3", bench_scan_domain, 200, "ssse3" },
+	{ "scan_domain_avx2", bench_scan_domain, 200, "avx2" },
+	{ "scan_is_ascii_scalar", bench_scan_is_ascii, 200, "scalar" },
+	{ "scan_is_ascii_ssse3", bench_scan_is_ascii, 200, "ssse3" },
+	{ "scan_is_ascii_avx2", bench_scan_is_ascii, 200, "avx2" },
+	{ "scan_tolower_ascii_scalar", bench_scan_tolower_ascii, 200, "scalar" },
+	{ "scan_tolower_ascii_ssse3", bench_scan_tolower_ascii, 200, "ssse3" },
+	{ "scan_tolower_ascii_avx2", bench_scan_tolower_ascii, 200, "avx2" },
+};
+
+/* returns the scan variant 'name' if compiled in and supported by the CPU */
+static const psl_scan_impl_t *find_scan_impl(const char *name)
+{
+	const psl_scan_impl_t *impls;
+	size_t n, it;
+
+	impls = psl_scan_impls(&n);
+
+	for (it = 0; it < n; it++)
+		if (!strcmp(impls[it].name, name))
+			return !impls[it].supported || impls[it].supported() ? &impls[it] : NULL;
+
+	return NULL;
+}
+
+/* returns the batch lookup variant 'name' if compiled in and supported by the CPU */
+static const batch_impl_t *find_batch_impl(const char *name)
+{
+	unsigned it;
+
+	for (it = 0; it < countof(batch_variants); it++)
+		if (!strcmp(batch_variants[it].name, name))
+			return !batch_variants[it].supported || batch_variants[it].supported() ? &batch_variants[it] : NULL;
+
+	return NULL;
+}
+
+/* returns 0 if 'impl' returns the results of single lookups for the domains and the rule strings */
+static int check_batch_impl(const batch_impl_t *impl)
+{
+	static const size_t batch_sizes[] = { 1, 15, 16, 17, 64 };
+	static char upper[64][256];
+	const char *keys[64];
+	size_t lens[64], nkeys, k, bs, len;
+	int results[64], expected, nocase, it;
+
+	for (nocase = 0; nocase <= 1; nocase++) {
+		for (bs = 0; bs < countof(batch_sizes); bs++) {
+			for (it = 0; it < 3 * ndomains;) {
+				/* the rule strings, with the 'www.' label (mostly not in the trie) and in uppercase */
+				for (nkeys = 0; nkeys < batch_sizes[bs] && it < 3 * ndomains; nkeys++, it++) {
+					keys[nkeys] = domains[it % ndomains] + (it < ndomains ? 4 : 0);
+					lens[nkeys] = strlen(keys[nkeys]);
+
+					if (it >= 2 * ndomains && lens[nkeys] < sizeof(upper[0])) {
+						for (len = 0; len < lens[nkeys]; len++)
+							upper[nkeys][len] = keys[nkeys][len] >= 'a' && keys[nkeys][len] <= 'z' ? keys[nkeys][len] - 32 : keys[nkeys][len];
+						keys[nkeys] = upper[nkeys];
+					}
+				}
+
+				impl->lookup_batch(darray, keys, lens, nkeys, nocase, results);
+
+				for (k = 0; k < nkeys; k++) {
+					if ((expected = darray_engine_lookup(darray, keys[k], lens[k], 1, nocase)) != results[k]) {
+						printf("lookup_batch_%s: %.*s = %d (expected %d, nocase %d)\n", impl->name,
+							(int) lens[k], keys[k], results[k], expected, nocase);
+						return -1;
+					}
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* all benchmarks if there are no names besides the options */
+static int selected(int argc, const char * const *argv, const char *name)
+{
+	int it, names = 0;
+
+	for (it = 1; it < argc; it++) {
+		if (!strncmp(argv[it], "--", 2))
+			continue;
+
+		if (!strcmp(argv[it], name))
+			return 1;
+
+		names++;
+	}
+
+	return !names;
+}
+
+int main(int argc, const char * const *argv)
+{
+	const char *hosts_file = NULL;
+	unsigned it;
+	int loop;
+
+	for (loop = 1; loop < argc; loop++)
+		if (!strncmp(argv[loop], "--hosts=", 8))
+			hosts_file = argv[loop] + 8;
+
+	if (read_domains(PSL_FILE) || !ndomains || make_hosts(hosts_file))
+		return 1;
+
+	psl_ascii = psl_load_file(PSL_ASCII_DAFSA);
+
+	{
+		psl_load_options_t options = { sizeof(psl_load_options_t), PSL_ENGINE_DAFSA, PSL_MEMORY_COPY, 0 };
+
+		psl_dafsa = psl_load_ex(PSL_DAFSA, &options);
+		options.engine = PSL_ENGINE_VECTOR;
+		psl_vector = psl_load_ex(PSL_DAFSA, &options);
+		options.engine = PSL_ENGINE_MPH;
+		psl_mph = psl_load_ex(PSL_MPH, &options);
+		options.engine = PSL_ENGINE_DARRAY;
+		psl_darray = psl_load_ex(PSL_DAFSA, &options);
+		options.engine = PSL_ENGINE_LOUDS;
+		psl_louds = psl_load_ex(PSL_ASCII_LOUDS, &options);
+		options.engine = PSL_ENGINE_JIT;
+		psl_jit = psl_load_ex(PSL_DAFSA, &options);
+		options.engine = PSL_ENGINE_DAFSA;
+		psl_payload = psl_load_ex(PSL_PAYLOAD_DAFSA, &options);
+		psl_reversed = psl_load_ex(PSL_REVERSED_DAFSA, &options);
+	}
+
+	graph_offsets = read_graph(PSL_ASCII_DAFSA, &graph_offsets_size);
+	graph_dense = read_graph(PSL_DAFSA, &graph_dense_size);
+	graph_vector = read_graph(PSL_VECTOR_DAFSA, &graph_vector_size);
+	graph_locality = read_graph(PSL_LOCALITY_DAFSA, &graph_locality_size);
+
+	if (graph_dense) {
+		static const psl_engine_t domains_engine = { "domains", NULL, NULL, domains_foreach, NULL, NULL, NULL, NULL, NULL };
+
+		darray = psl_darray_engine.build(&domains_engine, NULL);
+	}
+
+	printf("libpsl %s, %d domains, builtin engine %s\n", psl_get_version(), ndomains, psl_engine_name(psl_builtin()));
+	printf("engine dafsa %lu bytes, engine vector %lu bytes, engine mph %lu bytes, engine darray %lu bytes\n",
+		(unsigned long) psl_memory_usage(psl_dafsa), (unsigned long) psl_memory_usage(psl_vector),
+		(unsigned long) psl_memory_usage(psl_mph), (unsigned long) psl_memory_usage(psl_darray));
+	printf("engine louds %lu bytes, engine dafsa (ascii) %lu bytes, engine %s %lu bytes\n",
+		(unsigned long) psl_memory_usage(psl_louds), (unsigned long) psl_memory_usage(psl_ascii),
+		psl_engine_name(psl_jit), (unsigned long) psl_memory_usage(psl_jit));
+	printf("dafsa payload %lu bytes, dafsa payload reversed %lu bytes, %d wildcard rules\n",
+		(unsigned long) psl_memory_usage(psl_payload), (unsigned long) psl_memory_usage(psl_reversed), nwildcards);
+	printf("dafsa offsets %lu bytes, dafsa dense %lu bytes, dafsa vector %lu bytes, dafsa locality %lu bytes\n",
+		(unsigned long) graph_offsets_size, (unsigned long) graph_dense_size, (unsigned long) graph_vector_size,
+		(unsigned long) graph_locality_size);
+
+	cache_misses_open();
+	printf("hosts %s, cache miss counter %s\n", hosts_file ? hosts_file : "synthetic",
+		perf_fd >= 0 ? "available" : "not available");
+
+	for (it = 0; it < countof(benchmarks); it++) {
+		const struct benchmark *b = &benchmarks[it];
+		double start, ns, misses;
+
+		if (!selected(argc, argv, b->name))
+			continue;
+
+		if (b->func == bench_lookup_batch) {
+			if (!darray || !(batch_impl = find_batch_impl(b->variant)) || check_batch_impl(batch_impl))
+				continue;
+		} else if (b->variant && !(scan_impl = find_scan_impl(b->variant)))
+			continue;
+
+		sink += b->func(); /* warm up */
+
+		misses = cache_misses();
+		start = now_ns();
+		for (loop = 0; loop < b->loops; loop++)
+			sink += b->func();
+		ns = (now_ns() - start) / b->loops;
+		misses = (cache_misses() - misses) / b->loops;
+
+		if (perf_fd >= 0)
+			printf("%-32s %12.3f ms/loop %10.1f ns/domain %8.2f misses/domain\n", b->name, ns / 1e6, ns / ndomains, misses / ndomains);
+		else
+			printf("%-32s %12.3f ms/loop %10.1f ns/domain\n", b->name, ns / 1e6, ns / ndomains);
+	}
+
+	psl_free((psl_ctx_t *) psl_ascii);
+	psl_free((psl_ctx_t *) psl_dafsa);
+	psl_free((psl_ctx_t *) psl_vector);
+	psl_free((psl_ctx_t *) psl_mph);
+	psl_free((psl_ctx_t *) psl_darray);
+	psl_free((psl_ctx_t *) psl_louds);
+	psl_free((psl_ctx_t *) psl_jit);
+	psl_free((psl_ctx_t *) psl_payload);
+	psl_free((psl_ctx_t *) psl_reversed);
+	free(graph_offsets);
+	free(graph_dense);
+	free(graph_vector);
+	free(graph_locality);
+	if (darray)
+		psl_darray_engine.free(darray);
+
+	for (loop = 0; loop < ndomains; loop++) {
+		free(domains[loop]);
+		free(hosts[loop]);
+	}
+	free(domains);
+	free(wildcards);
+	free(hosts);
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	if (perf_fd >= 0)
+		close(perf_fd);
+#endif
+
+	return 0;
+}
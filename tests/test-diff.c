@@ -0,0 +1,298 @@
+/*
+ * Copyright(c) 2026 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of the test suite of libpsl.
+ *
+ * Test case for psl_apply_diff() with the PSL file, the DAFSA and MPH blobs
+ * and the builtin data as the context the diffs are applied to.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libpsl.h>
+#include "common.h"
+
+#define countof(a) (sizeof(a)/sizeof(*(a)))
+
+static int
+	ok,
+	failed;
+
+/* an update of the PSL */
+static const psl_rule_change_t diff1[] = {
+	{ "customers.example.com", PSL_RULE_PRIVATE, 0 },
+	{ "apps.example.net", PSL_RULE_PRIVATE, 0 },
+	{ "*.apps.example.net", PSL_RULE_PRIVATE, 0 },
+	{ "!www.apps.example.net", PSL_RULE_PRIVATE, 0 },
+	{ "*.cloud.example.net", PSL_RULE_PRIVATE, 0 },
+	{ "b\303\274cher.example", PSL_RULE_PRIVATE, 0 },
+	{ "internal", 0, 0 },
+	{ "co.uk", PSL_RULE_ICANN, 1 },
+	{ "!www.ck", PSL_RULE_ICANN, 1 },
+	{ "no-such-rule.example", PSL_RULE_ICANN, 1 },
+};
+
+/* the next update, applied to the result of diff1 */
+static const psl_rule_change_t diff2[] = {
+	{ "*.apps.example.net", PSL_RULE_PRIVATE, 1 },
+	{ "*.cloud.example.net", PSL_RULE_PRIVATE, 1 },
+	{ "b\303\274cher.example", PSL_RULE_PRIVATE, 1 },
+	{ "co.uk", PSL_RULE_ICANN, 0 },
+};
+
+static void test_diff(const psl_ctx_t *base, const char *name, const char *engine)
+{
+	static const struct test_data {
+		const char
+			*domain;
+		int
+			type,
+			base_result,
+			result1,
+			result2;
+	} test_data[] = {
+		{ "customers.example.com", PSL_TYPE_ANY, 0, 1, 1 },
+		{ "customers.example.com", PSL_TYPE_PRIVATE, 0, 1, 1 },
+		{ "customers.example.com", PSL_TYPE_ICANN, 0, 0, 0 },
+		{ "CUSTOMERS.Example.COM", PSL_TYPE_ANY|PSL_TYPE_IGNORE_CASE, 0, 1, 1 },
+		{ "x.apps.example.net", PSL_TYPE_ANY, 0, 1, 0 },
+		{ "apps.example.net", PSL_TYPE_ANY, 0, 1, -1 }, /* a rule of its own, just the vector engine knows */
+		{ "www.apps.example.net", PSL_TYPE_ANY, 0, 0, 0 },
+		{ "x.cloud.example.net", PSL_TYPE_ANY, 0, 1, 0 },
+		{ "cloud.example.net", PSL_TYPE_ANY|PSL_TYPE_NO_STAR_RULE, 0, 1, 0 }, /* just implied by *.cloud.example.net */
+		{ "b\303\274cher.example", PSL_TYPE_ANY, 0, 1, 0 },
+		{ "xn--bcher-kva.example", PSL_TYPE_ANY, 0, 1, 0 },
+		{ "internal", PSL_TYPE_ANY|PSL_TYPE_NO_STAR_RULE, 0, 1, 1 },
+		{ "co.uk", PSL_TYPE_ANY, 1, 0, 1 },
+		{ "www.ck", PSL_TYPE_ANY, 0, 1, 1 },
+		/* unchanged rules */
+		{ "foo.ck", PSL_TYPE_ANY, 1, 1, 1 },
+		{ "www.example.com", PSL_TYPE_ANY, 0, 0, 0 },
+		{ "\345\225\206\346\240\207", PSL_TYPE_ANY|PSL_TYPE_NO_STAR_RULE, 1, 1, 1 },
+		{ "www.\345\225\206\346\240\207", PSL_TYPE_ANY, 0, 0, 0 },
+		{ "adfhoweirh", PSL_TYPE_ANY|PSL_TYPE_NO_STAR_RULE, 0, 0, 0 },
+	};
+	psl_ctx_t *psl1, *psl2;
+	unsigned it;
+	int result, count = psl_suffix_count(base);
+
+	if (!(psl1 = psl_apply_diff(base, diff1, countof(diff1)))) {
+		failed++;
+		printf("%s: psl_apply_diff() failed\n", name);
+		return;
+	}
+
+	if (!(psl2 = psl_apply_diff(psl1, diff2, countof(diff2)))) {
+		failed++;
+		printf("%s: psl_apply_diff() of the result failed\n", name);
+		psl_free(psl1);
+		return;
+	}
+
+	if (count < 0 ? psl_suffix_count(psl1) == -1 : psl_suffix_count(psl1) == count + 5
+		&& psl_suffix_wildcard_count(psl1) == psl_suffix_wildcard_count(base) + 2
+		&& psl_suffix_exception_count(psl1) == psl_suffix_exception_count(base))
+	{
+		ok++;
+	} else {
+		failed++;
+		printf("%s: psl_suffix_count()=%d (base %d)\n", name, psl_suffix_count(psl1), count);
+	}
+
+	if (psl_rule_count(psl1) == -1 && !strcmp(psl_engine_name(psl1), engine) && !strcmp(psl_engine_name(psl2), engine)) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: psl_engine_name()=%s (expected %s)\n", name, psl_engine_name(psl1), engine);
+	}
+
+	/* the result of the next update doesn't depend on the context it has been applied to */
+	psl_free(psl1);
+
+	for (it = 0; it < countof(test_data); it++) {
+		const struct test_data *t = &test_data[it];
+		int result2 = t->result2 < 0 ? !strcmp(engine, "vector") : t->result2;
+
+		if ((result = psl_is_public_suffix2(base, t->domain, t->type)) == t->base_result) {
+			ok++;
+		} else {
+			failed++;
+			printf("%s: psl_is_public_suffix2(%s, %d)=%d (expected %d, base)\n", name, t->domain, t->type, result, t->base_result);
+		}
+
+		if ((result = psl_is_public_suffix2(psl2, t->domain, t->type)) == result2) {
+			ok++;
+		} else {
+			failed++;
+			printf("%s: psl_is_public_suffix2(%s, %d)=%d (expected %d)\n", name, t->domain, t->type, result, result2);
+		}
+	}
+
+	if (count < 0 ? psl_suffix_count(psl2) == -1 : psl_suffix_count(psl2) == count + 3
+		&& psl_suffix_wildcard_count(psl2) == psl_suffix_wildcard_count(base))
+	{
+		ok++;
+	} else {
+		failed++;
+		printf("%s: psl_suffix_count()=%d (base %d, next update)\n", name, psl_suffix_count(psl2), count);
+	}
+
+	psl_free(psl2);
+
+	if ((psl1 = psl_apply_diff(base, diff1, countof(diff1)))) {
+		for (it = 0; it < countof(test_data); it++) {
+			const struct test_data *t = &test_data[it];
+
+			if ((result = psl_is_public_suffix2(psl1, t->domain, t->type)) == t->result1) {
+				ok++;
+			} else {
+				failed++;
+				printf("%s: psl_is_public_suffix2(%s, %d)=%d (expected %d)\n", name, t->domain, t->type, result, t->result1);
+			}
+		}
+
+		psl_free(psl1);
+	} else {
+		failed++;
+		printf("%s: psl_apply_diff() failed\n", name);
+	}
+}
+
+static void test_load(const char *fname, psl_load_engine_t engine, const char *name, const char *diff_engine)
+{
+	psl_load_options_t options;
+	psl_ctx_t *psl;
+
+	memset(&options, 0, sizeof(options));
+	options.size = sizeof(options);
+	options.engine = engine;
+
+	if ((psl = psl_load_ex(fname, &options))) {
+		test_diff(psl, name, diff_engine);
+		psl_free(psl);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", fname);
+	}
+}
+
+static void test_psl(void)
+{
+	psl_load_options_t options;
+	psl_ctx_t *psl, *psl2, *overlay;
+
+	test_load(PSL_FILE, PSL_ENGINE_AUTO, "file", "vector");
+	test_load(PSL_FILE, PSL_ENGINE_MPH, "file-mph", "mph");
+	test_load(PSL_FILE, PSL_ENGINE_DARRAY, "file-darray", "darray");
+	test_load(PSL_DAFSA, PSL_ENGINE_AUTO, "dafsa", "vector");
+	test_load(PSL_ASCII_DAFSA, PSL_ENGINE_AUTO, "ascii-dafsa", "vector");
+	test_load(PSL_REVERSED_DAFSA, PSL_ENGINE_AUTO, "reversed-dafsa", "vector");
+	test_load(PSL_MPH, PSL_ENGINE_AUTO, "mph", "mph");
+
+	if (psl_builtin())
+		test_diff(psl_builtin(), "builtin", "vector");
+
+	if ((psl = psl_load_file(PSL_FILE))) {
+		/* without changes, the result has the rules of the context */
+		if ((psl2 = psl_apply_diff(psl, NULL, 0))) {
+			psl_suffix_count(psl2) == psl_suffix_count(psl) ? ok++ : failed++;
+			psl_suffix_exception_count(psl2) == psl_suffix_exception_count(psl) ? ok++ : failed++;
+			psl_suffix_wildcard_count(psl2) == psl_suffix_wildcard_count(psl) ? ok++ : failed++;
+			psl_is_public_suffix(psl2, "co.uk") == 1 ? ok++ : failed++;
+			psl_is_public_suffix(psl2, "www.ck") == 0 ? ok++ : failed++;
+			psl_is_public_suffix(psl2, "xn--55qx5d.cn") == 1 ? ok++ : failed++;
+			psl_free(psl2);
+		} else {
+			failed++;
+			printf("psl_apply_diff() without changes failed\n");
+		}
+
+		/* the result stays valid after the context it has been applied to is free'd */
+		psl2 = psl_apply_diff(psl, diff1, countof(diff1));
+		psl_free(psl);
+		psl_is_public_suffix(psl2, "customers.example.com") == 1 ? ok++ : failed++;
+		psl_is_public_suffix(psl2, "co.uk") == 0 ? ok++ : failed++;
+		psl_is_public_suffix(psl2, "co.jp") == 1 ? ok++ : failed++;
+		psl_free(psl2);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_FILE);
+	}
+
+	/* the changes to other sections than the ones of the context are skipped */
+	memset(&options, 0, sizeof(options));
+	options.size = sizeof(options);
+	options.sections = PSL_TYPE_ICANN;
+
+	if ((psl = psl_load_ex(PSL_FILE, &options))) {
+		if ((psl2 = psl_apply_diff(psl, diff1, countof(diff1)))) {
+			psl_is_public_suffix(psl2, "customers.example.com") == 0 ? ok++ : failed++;
+			psl_is_public_suffix(psl2, "co.uk") == 0 ? ok++ : failed++;
+			psl_suffix_count(psl2) == psl_suffix_count(psl) - 1 ? ok++ : failed++;
+			psl_free(psl2);
+		} else {
+			failed++;
+			printf("psl_apply_diff() with sections failed\n");
+		}
+
+		psl_apply_diff(NULL, diff1, countof(diff1)) == NULL ? ok++ : failed++;
+		psl_apply_diff(psl, NULL, 1) == NULL ? ok++ : failed++;
+
+		/* overlays are not supported */
+		if ((overlay = psl_overlay_load_data(psl, "example.org\n", 12))) {
+			psl_apply_diff(overlay, diff1, countof(diff1)) == NULL ? ok++ : failed++;
+			psl_free(overlay);
+		}
+
+		psl_free(psl);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_FILE);
+	}
+}
+
+int main(int argc, const char * const *argv)
+{
+	/* if VALGRIND testing is enabled, we have to call ourselves with valgrind checking */
+	if (argc == 1) {
+		const char *valgrind = getenv("TESTS_VALGRIND");
+
+		if (valgrind && *valgrind) {
+			return run_valgrind(valgrind, argv[0]);
+		}
+	}
+
+	test_psl();
+
+	if (failed) {
+		printf("Summary: %d out of %d tests failed\n", failed, ok + failed);
+		return 1;
+	}
+
+	printf("Summary: All %d tests passed\n", ok + failed);
+	return 0;
+}
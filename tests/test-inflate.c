@@ -0,0 +1,221 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of the test suite of libpsl.
+ *
+ * Test case for the DEFLATE decoder of the compressed built-in data:
+ * streams with each block type decode to the original text, truncated
+ * and corrupted streams fail without writing outside of the output buffer.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+/* the decoder is a hidden symbol of libpsl, so compile it in */
+#include "inflate.c"
+
+#define countof(a) (sizeof(a)/sizeof(*(a)))
+
+static int
+	ok,
+	failed;
+
+/* some PSL rules, compressed by Python's zlib (raw DEFLATE, wbits -15) */
+static const char text[] =
+	"com\n"
+	"co.uk\n"
+	"*.ck\n"
+	"!www.ck\n"
+	"kawasaki.jp\n"
+	"*.kawasaki.jp\n"
+	"!city.kawasaki.jp\n"
+	"blogspot.com\n"
+	"blogspot.co.uk\n"
+	"blogspot.jp\n"
+	"github.io\n"
+	"s3.amazonaws.com\n"
+	"*.compute.amazonaws.com\n";
+
+/* a stored block */
+static const unsigned char
+	stored[] = {
+		0x01, 0x9e, 0x00, 0x61, 0xff, 0x63, 0x6f, 0x6d, 0x0a, 0x63, 0x6f, 0x2e,
+		0x75, 0x6b, 0x0a, 0x2a, 0x2e, 0x63, 0x6b, 0x0a, 0x21, 0x77, 0x77, 0x77,
+		0x2e, 0x63, 0x6b, 0x0a, 0x6b, 0x61, 0x77, 0x61, 0x73, 0x61, 0x6b, 0x69,
+		0x2e, 0x6a, 0x70, 0x0a, 0x2a, 0x2e, 0x6b, 0x61, 0x77, 0x61, 0x73, 0x61,
+		0x6b, 0x69, 0x2e, 0x6a, 0x70, 0x0a, 0x21, 0x63, 0x69, 0x74, 0x79, 0x2e,
+		0x6b, 0x61, 0x77, 0x61, 0x73, 0x61, 0x6b, 0x69, 0x2e, 0x6a, 0x70, 0x0a,
+		0x62, 0x6c, 0x6f, 0x67, 0x73, 0x70, 0x6f, 0x74, 0x2e, 0x63, 0x6f, 0x6d,
+		0x0a, 0x62, 0x6c, 0x6f, 0x67, 0x73, 0x70, 0x6f, 0x74, 0x2e, 0x63, 0x6f,
+		0x2e, 0x75, 0x6b, 0x0a, 0x62, 0x6c, 0x6f, 0x67, 0x73, 0x70, 0x6f, 0x74,
+		0x2e, 0x6a, 0x70, 0x0a, 0x67, 0x69, 0x74, 0x68, 0x75, 0x62, 0x2e, 0x69,
+		0x6f, 0x0a, 0x73, 0x33, 0x2e, 0x61, 0x6d, 0x61, 0x7a, 0x6f, 0x6e, 0x61,
+		0x77, 0x73, 0x2e, 0x63, 0x6f, 0x6d, 0x0a, 0x2a, 0x2e, 0x63, 0x6f, 0x6d,
+		0x70, 0x75, 0x74, 0x65, 0x2e, 0x61, 0x6d, 0x61, 0x7a, 0x6f, 0x6e, 0x61,
+		0x77, 0x73, 0x2e, 0x63, 0x6f, 0x6d, 0x0a
+	};
+
+/* a block with the fixed codes */
+static const unsigned char
+	fixed[] = {
+		0x4b, 0xce, 0xcf, 0xe5, 0x4a, 0xce, 0xd7, 0x2b, 0xcd, 0xe6, 0xd2, 0xd2,
+		0x4b, 0xce, 0xe6, 0x52, 0x2c, 0x2f, 0x2f, 0x07, 0xd1, 0xd9, 0x89, 0xe5,
+		0x89, 0xc5, 0x89, 0xd9, 0x99, 0x7a, 0x59, 0x05, 0x40, 0x09, 0x64, 0x9e,
+		0x62, 0x72, 0x66, 0x49, 0x25, 0x8a, 0x48, 0x52, 0x4e, 0x7e, 0x7a, 0x71,
+		0x41, 0x7e, 0x89, 0x5e, 0x32, 0xd0, 0x2c, 0x24, 0x0e, 0xc8, 0x50, 0x38,
+		0x17, 0xa8, 0x2e, 0x3d, 0xb3, 0x24, 0xa3, 0x34, 0x49, 0x2f, 0x33, 0x9f,
+		0xab, 0xd8, 0x58, 0x2f, 0x31, 0x37, 0xb1, 0x2a, 0x3f, 0x2f, 0xb1, 0xbc,
+		0x18, 0xac, 0x4b, 0x0b, 0x44, 0x16, 0x94, 0x96, 0xa4, 0xa2, 0x89, 0x03,
+		0x00
+	};
+
+/* a block with dynamic codes */
+static const unsigned char
+	dynamic[] = {
+		0x5d, 0x8c, 0xb1, 0x0e, 0x80, 0x20, 0x0c, 0x44, 0x77, 0xfe, 0x82, 0x95,
+		0xa1, 0x8b, 0x5f, 0x54, 0x1b, 0x83, 0x58, 0xb1, 0x24, 0x40, 0x1a, 0xfd,
+		0x7a, 0xc1, 0xc1, 0xa0, 0x4b, 0x2f, 0xef, 0xee, 0x7a, 0x24, 0xd1, 0x90,
+		0x40, 0x65, 0xe3, 0x80, 0xd8, 0x58, 0x55, 0xed, 0xca, 0xa8, 0x98, 0x91,
+		0x03, 0x6c, 0xa9, 0x05, 0x23, 0x59, 0x0a, 0xe5, 0xfc, 0x38, 0xf3, 0x2e,
+		0x3e, 0x27, 0x29, 0x40, 0x6d, 0x6b, 0x80, 0x3e, 0xfa, 0x62, 0xeb, 0xf9,
+		0x50, 0xd6, 0x3a, 0x43, 0x10, 0x93, 0x27, 0xc0, 0x88, 0x97, 0x1c, 0xa8,
+		0xf9, 0xf9, 0x72, 0xfd, 0xa6, 0x5a, 0x96, 0x9f, 0x7f, 0x03
+	};
+
+/* a block with the fixed codes, an empty stored block (flush) and a block with matches into the first one */
+static const unsigned char
+	blocks[] = {
+		0x4a, 0xce, 0xcf, 0xe5, 0x4a, 0xce, 0xd7, 0x2b, 0xcd, 0xe6, 0xd2, 0xd2,
+		0x4b, 0xce, 0xe6, 0x52, 0x2c, 0x2f, 0x2f, 0x07, 0xd1, 0xd9, 0x89, 0xe5,
+		0x89, 0xc5, 0x89, 0xd9, 0x99, 0x7a, 0x59, 0x05, 0x40, 0x09, 0x64, 0x9e,
+		0x62, 0x72, 0x66, 0x49, 0x25, 0x8a, 0x48, 0x52, 0x4e, 0x7e, 0x7a, 0x71,
+		0x41, 0x7e, 0x89, 0x5e, 0x32, 0xd0, 0x2c, 0x00, 0x00, 0x00, 0x00, 0xff,
+		0xff, 0x43, 0xe2, 0x80, 0x0c, 0x85, 0x73, 0x81, 0xea, 0xd2, 0x33, 0x4b,
+		0x32, 0x4a, 0x93, 0xf4, 0x32, 0xf3, 0xb9, 0x8a, 0x8d, 0xf5, 0x12, 0x73,
+		0x13, 0xab, 0xf2, 0xf3, 0x12, 0xcb, 0x8b, 0xc1, 0xba, 0xb4, 0x40, 0x64,
+		0x41, 0x69, 0x49, 0x2a, 0x9a, 0x38, 0x00
+	};
+
+static const struct stream_data {
+	const char
+		*name;
+	const unsigned char
+		*data;
+	size_t
+		size;
+} streams[] = {
+	{ "stored", stored, sizeof(stored) },
+	{ "fixed", fixed, sizeof(fixed) },
+	{ "dynamic", dynamic, sizeof(dynamic) },
+	{ "blocks", blocks, sizeof(blocks) },
+};
+
+static void check(int cond, const char *name, const char *what, size_t arg)
+{
+	if (cond) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: %s (%lu)\n", name, what, (unsigned long) arg);
+	}
+}
+
+static void test_stream(const struct stream_data *s)
+{
+	/* the output buffer has a guard zone behind the expected size */
+	unsigned char out[sizeof(text) - 1 + 16], in[1024];
+	size_t len = sizeof(text) - 1, it, bit;
+	int rc;
+
+	memset(out, 0x55, sizeof(out));
+	rc = psl_inflate(out, len, s->data, s->size);
+	check(rc == 0 && !memcmp(out, text, len), s->name, "failed to decode", s->size);
+	check(out[len] == 0x55, s->name, "wrote behind the output", len);
+
+	/* the output size has to match exactly */
+	check(psl_inflate(out, len - 1, s->data, s->size) == -1, s->name, "decoded into a smaller buffer", len - 1);
+	check(psl_inflate(out, len + 1, s->data, s->size) == -1, s->name, "decoded into a larger buffer", len + 1);
+
+	for (it = 0; it < s->size; it++) {
+		memset(out, 0x55, sizeof(out));
+		rc = psl_inflate(out, len, s->data, it);
+		check(rc == -1 && out[len] == 0x55, s->name, "decoded a truncated stream", it);
+	}
+
+	/* a flipped bit may still give a valid stream, but the output must stay in its buffer */
+	memcpy(in, s->data, s->size);
+	for (bit = 0; bit < s->size * 8; bit++) {
+		in[bit / 8] ^= 1 << (bit % 8);
+		memset(out, 0x55, sizeof(out));
+		psl_inflate(out, len, in, s->size);
+		check(out[len] == 0x55, s->name, "wrote behind the output with a flipped bit", bit);
+		in[bit / 8] ^= 1 << (bit % 8);
+	}
+}
+
+/* invalid blocks: the reserved block type 3, a stored block with a wrong length check, an empty stream */
+static void test_invalid(void)
+{
+	static const unsigned char
+		reserved[] = { 0x07, 0x00 },
+		stored_len[] = { 0x01, 0x03, 0x00, 0xfc, 0xfe, 'a', 'b', 'c' },
+		stored_ok[] = { 0x01, 0x03, 0x00, 0xfc, 0xff, 'a', 'b', 'c' };
+	unsigned char out[3];
+
+	check(psl_inflate(out, 0, reserved, sizeof(reserved)) == -1, "invalid", "decoded block type 3", 0);
+	check(psl_inflate(out, 3, stored_len, sizeof(stored_len)) == -1, "invalid", "decoded a wrong stored length", 3);
+	check(psl_inflate(out, 3, stored_ok, sizeof(stored_ok)) == 0 && !memcmp(out, "abc", 3), "invalid", "failed to decode a stored block", 3);
+	check(psl_inflate(out, 0, stored_ok, 0) == -1, "invalid", "decoded an empty stream", 0);
+}
+
+int main(int argc, const char * const *argv)
+{
+	size_t it;
+
+	/* if VALGRIND testing is enabled, we have to call ourselves with valgrind checking */
+	if (argc == 1) {
+		const char *valgrind = getenv("TESTS_VALGRIND");
+
+		if (valgrind && *valgrind) {
+			return run_valgrind(valgrind, argv[0]);
+		}
+	}
+
+	for (it = 0; it < countof(streams); it++)
+		test_stream(&streams[it]);
+
+	test_invalid();
+
+	if (failed) {
+		printf("Summary: %d out of %d tests failed\n", failed, ok + failed);
+		return 1;
+	}
+
+	printf("Summary: All %d tests passed\n", ok + failed);
+	return 0;
+}
@@ -45,7 +45,7 @@ static int
 	ok,
 	failed;
 
-static void test_psl(void)
+static void test_psl(const psl_ctx_t *psl, const char *name)
 {
 	static const struct test_data {
 		const char
@@ -69,6 +69,13 @@ static void test_psl(void)
 		{ "www.example.com", "example.org", 0 },
 		{ "www.sa.gov.au", "sa.gov.au", 0 }, /* not accepted by normalization  (PSL rule '*.ar') */
 		{ "www.educ.ar", "educ.ar", 1 }, /* PSL exception rule '!educ.ar' */
+		/* a trailing dot makes an empty last label, no rule matches it (see NEWS for V0.22.0) */
+		{ "www.example.com.", "www.example.com.", 1 },
+		{ "www.example.com.", "example.com.", 1 },
+		{ "www.example.com.", "com.", 1 },
+		{ "www.example.co.uk.", "co.uk.", 1 },
+		{ "www.example.com", "com.", 0 },
+		{ "www.example.com.", "example.com", 0 },
 		/* RFC6265 5.1.3: Having IP addresses, request and domain IP must be identical */
 		{ "192.1.123.2", ".1.123.2", 0 }, /* IPv4 address, partial match */
 		{ "192.1.123.2", "192.1.123.2", 1 }, /* IPv4 address, full match */
@@ -80,11 +87,8 @@ static void test_psl(void)
 		{ "hiho", NULL, 0 },
 	};
 	unsigned it;
-	psl_ctx_t *psl;
-
-	psl = psl_load_file(PSL_FILE);
 
-	printf("loaded %d suffixes and %d exceptions\n", psl_suffix_count(psl), psl_suffix_exception_count(psl));
+	printf("loaded %d suffixes and %d exceptions (%s)\n", psl_suffix_count(psl), psl_suffix_exception_count(psl), name);
 
 	for (it = 0; it < countof(test_data); it++) {
 		const struct test_data *t = &test_data[it];
@@ -94,19 +98,16 @@ static void test_psl(void)
 			ok++;
 		} else {
 			failed++;
-			printf("psl_is_cookie_domain_acceptable(%s, %s)=%d (expected %d)\n",
-				t->request_domain, t->cookie_domain, result, t->result);
+			printf("psl_is_cookie_domain_acceptable(%s, %s)=%d (expected %d, %s)\n",
+				t->request_domain, t->cookie_domain, result, t->result, name);
 		}
 	}
-
-	/* do checks to cover more code paths in libpsl */
-	psl_is_cookie_domain_acceptable(NULL, "example.com", "example.com");
-
-	psl_free(psl);
 }
 
 int main(int argc, const char * const *argv)
 {
+	psl_ctx_t *psl;
+
 	/* if VALGRIND testing is enabled, we have to call ourselves with valgrind checking */
 	if (argc == 1) {
 		const char *valgrind = getenv("TESTS_VALGRIND");
@@ -116,7 +117,28 @@ int main(int argc, const char * const *argv)
 		}
 	}
 
-	test_psl();
+	/* the PSL file and the DAFSA of the same list give the same results */
+	if ((psl = psl_load_file(PSL_FILE))) {
+		test_psl(psl, PSL_FILE);
+		psl_free(psl);
+	} else {
+		printf("Failed to load %s\n", PSL_FILE);
+		failed++;
+	}
+
+	if ((psl = psl_load_file(PSL_DAFSA))) {
+		test_psl(psl, PSL_DAFSA);
+		psl_free(psl);
+	} else {
+		printf("Failed to load %s\n", PSL_DAFSA);
+		failed++;
+	}
+
+	if (psl_builtin())
+		test_psl(psl_builtin(), "builtin");
+
+	/* do checks to cover more code paths in libpsl */
+	psl_is_cookie_domain_acceptable(NULL, "example.com", "example.com");
 
 	if (failed) {
 		printf("Summary: %d out of %d tests failed\n", failed, ok + failed);
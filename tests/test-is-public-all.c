@@ -137,7 +137,7 @@ static void test_psl_entry(const psl_ctx_t *psl, const char *domain, int type)
 static void test_psl(void)
 {
 	FILE *fp;
-	psl_ctx_t *psl, *psl3, *psl4, *psl5;
+	psl_ctx_t *psl, *psl3, *psl4, *psl5, *psl6, *psl7;
 	const psl_ctx_t *psl2;
 	int type = 0;
 	char buf[256], *linep, *p;
@@ -160,6 +160,16 @@ static void test_psl(void)
 
 	psl5 = psl_latest("psl.dafsa");
 
+	if (!(psl6 = psl_load_file(PSL_VECTOR_DAFSA))) {
+		fprintf(stderr, "Failed to load 'psl_vector.dafsa'\n");
+		failed++;
+	}
+
+	if (!(psl7 = psl_load_file(PSL_REVERSED_DAFSA))) {
+		fprintf(stderr, "Failed to load 'psl_reversed.dafsa'\n");
+		failed++;
+	}
+
 	if ((fp = fopen(PSL_FILE, "r"))) {
 #ifdef HAVE_CLOCK_GETTIME
 		clock_gettime(CLOCK_REALTIME, &ts1);
@@ -201,6 +211,12 @@ static void test_psl(void)
 
 			if (psl5)
 				test_psl_entry(psl5, p, type);
+
+			if (psl6)
+				test_psl_entry(psl6, p, type);
+
+			if (psl7)
+				test_psl_entry(psl7, p, type);
 		}
 
 #ifdef HAVE_CLOCK_GETTIME
@@ -212,6 +228,8 @@ static void test_psl(void)
 		failed++;
 	}
 
+	psl_free(psl7);
+	psl_free(psl6);
 	psl_free(psl5);
 	psl_free(psl4);
 	psl_free(psl3);
@@ -45,6 +45,25 @@ static int
 	ok,
 	failed;
 
+/* checks the uppercase variant of domain with PSL_TYPE_IGNORE_CASE */
+static void test_ignore_case(const psl_ctx_t *psl, const char *domain, int expected)
+{
+	char upper[128];
+	size_t it;
+	int result;
+
+	for (it = 0; domain[it] && it < sizeof(upper) - 1; it++)
+		upper[it] = domain[it] >= 'a' && domain[it] <= 'z' ? domain[it] - 'a' + 'A' : domain[it];
+	upper[it] = 0;
+
+	if ((result = psl_is_public_suffix2(psl, upper, PSL_TYPE_ANY|PSL_TYPE_IGNORE_CASE)) == expected) {
+		ok++;
+	} else {
+		failed++;
+		printf("psl_is_public_suffix2(%s, IGNORE_CASE)=%d (expected %d)\n", upper, result, expected);
+	}
+}
+
 static void test_psl(void)
 {
 	/* punycode generation: idn ?? */
@@ -69,6 +88,8 @@ static void test_psl(void)
 		{ "www.xxx.ck", 0, 0 },
 		{ "\345\225\206\346\240\207", 1, 1 }, /* xn--czr694b or ?? */
 		{ "www.\345\225\206\346\240\207", 0, 0 },
+		{ "b\303\274cher.shop.example.co.uk", 0, 0 }, /* non-ASCII label beyond the longest rule */
+		{ "www.b\303\274cher.\345\225\206\346\240\207", 0, 0 },
 		/* some special test follow ('name' and 'forgot.his.name' are public, but e.g. his.name is not) */
 		{ "name", 1, 1 },
 		{ ".name", 1, 1 },
@@ -82,13 +103,84 @@ static void test_psl(void)
 		{ "", 1, 0 },  /* special case */
 		{ NULL, 1, 1 },  /* special case */
 		{ "adfhoweirh", 1, 0 }, /* unknown TLD */
+		{ "example.adfhoweirh", 0, 0 }, /* unknown TLD, no lookup needed */
+		{ ".adfhoweirh", 1, 0 },
 		{ "compute.amazonaws.com", 1, 1 }, /* special rule *.compute.amazonaws.com */
 		{ "y.compute.amazonaws.com", 1, 1 },
 		{ "x.y.compute.amazonaws.com", 0, 0 },
+		/* a trailing dot makes an empty last label, no rule matches it (see NEWS for V0.22.0) */
+		{ "com.", 0, 0 },
+		{ "co.uk.", 0, 0 },
+		{ "www.example.com.", 0, 0 },
+		{ "foo.m", 0, 0 }, /* the end_char 0x9F (transcoding start) must not be taken as return value */
+	};
+	static const struct load_data {
+		const char
+			*fname;
+		psl_load_options_t
+			options;
+		const char
+			*engine;
+	} load_data[] = {
+		{ PSL_FILE, { sizeof(psl_load_options_t), PSL_ENGINE_VECTOR, PSL_MEMORY_MMAP, 0 }, "vector" },
+		{ PSL_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_AUTO, PSL_MEMORY_COPY, 0 }, "dafsa" },
+		{ PSL_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_DAFSA, PSL_MEMORY_MMAP, 0 }, "dafsa" },
+		{ PSL_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_VECTOR, PSL_MEMORY_COPY, 0 }, "vector" },
+		{ PSL_ASCII_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_AUTO, PSL_MEMORY_MMAP, 0 }, "dafsa" },
+		{ PSL_ASCII_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_VECTOR, PSL_MEMORY_MMAP, 0 }, "vector" },
+		{ PSL_VECTOR_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_AUTO, PSL_MEMORY_MMAP, 0 }, "dafsa" },
+		{ PSL_VECTOR_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_DARRAY, PSL_MEMORY_COPY, 0 }, "darray" },
+		{ PSL_LOCALITY_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_DAFSA, PSL_MEMORY_MMAP, 0 }, "dafsa" },
+		{ PSL_REVERSED_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_AUTO, PSL_MEMORY_MMAP, 0 }, "dafsa" },
+		{ PSL_REVERSED_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_DARRAY, PSL_MEMORY_COPY, 0 }, "darray" },
+		{ PSL_FILE, { sizeof(psl_load_options_t), PSL_ENGINE_MPH, PSL_MEMORY_COPY, 0 }, "mph" },
+		{ PSL_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_MPH, PSL_MEMORY_COPY, 0 }, "mph" },
+		{ PSL_ASCII_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_MPH, PSL_MEMORY_MMAP, 0 }, "mph" },
+		{ PSL_MPH, { sizeof(psl_load_options_t), PSL_ENGINE_AUTO, PSL_MEMORY_COPY, 0 }, "mph" },
+		{ PSL_MPH, { sizeof(psl_load_options_t), PSL_ENGINE_MPH, PSL_MEMORY_MMAP, 0 }, "mph" },
+		{ PSL_MPH, { sizeof(psl_load_options_t), PSL_ENGINE_VECTOR, PSL_MEMORY_COPY, 0 }, "vector" },
+		{ PSL_PAYLOAD_ASCII_MPH, { sizeof(psl_load_options_t), PSL_ENGINE_AUTO, PSL_MEMORY_MMAP, 0 }, "mph" },
+		{ PSL_FILE, { sizeof(psl_load_options_t), PSL_ENGINE_DARRAY, PSL_MEMORY_COPY, 0 }, "darray" },
+		{ PSL_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_DARRAY, PSL_MEMORY_MMAP, 0 }, "darray" },
+		{ PSL_ASCII_DAFSA, { sizeof(psl_load_options_t), PSL_ENGINE_DARRAY, PSL_MEMORY_COPY, 0 }, "darray" },
+		{ PSL_MPH, { sizeof(psl_load_options_t), PSL_ENGINE_DARRAY, PSL_MEMORY_COPY, 0 }, "darray" },
+		{ PSL_ASCII_LOUDS, { sizeof(psl_load_options_t), PSL_ENGINE_AUTO, PSL_MEMORY_COPY, 0 }, "louds" },
+		{ PSL_ASCII_LOUDS, { sizeof(psl_load_options_t), PSL_ENGINE_LOUDS, PSL_MEMORY_MMAP, 0 }, "louds" },
+		{ PSL_ASCII_LOUDS, { sizeof(psl_load_options_t), PSL_ENGINE_VECTOR, PSL_MEMORY_COPY, 0 }, "vector" },
+		{ PSL_ASCII_LOUDS, { sizeof(psl_load_options_t), PSL_ENGINE_DARRAY, PSL_MEMORY_MMAP, 0 }, "darray" },
+		{ PSL_PAYLOAD_ASCII_LOUDS, { sizeof(psl_load_options_t), PSL_ENGINE_AUTO, PSL_MEMORY_MMAP, 0 }, "louds" },
+	};
+	static const struct section_data {
+		const char
+			*fname,
+			*domain;
+		int
+			sections,
+			result;
+	} section_data[] = {
+		{ PSL_FILE, "co.uk", PSL_TYPE_ICANN, 1 },
+		{ PSL_FILE, "github.io", PSL_TYPE_ICANN, 0 },
+		{ PSL_FILE, "co.uk", PSL_TYPE_PRIVATE, 0 },
+		{ PSL_FILE, "github.io", PSL_TYPE_PRIVATE, 1 },
+		{ PSL_FILE, "github.io", PSL_TYPE_ANY, 1 },
+		{ PSL_DAFSA, "co.uk", PSL_TYPE_ICANN, 1 },
+		{ PSL_DAFSA, "github.io", PSL_TYPE_ICANN, 0 },
+		{ PSL_DAFSA, "co.uk", PSL_TYPE_PRIVATE, 0 },
+		{ PSL_DAFSA, "github.io", PSL_TYPE_PRIVATE, 1 },
+		{ PSL_REVERSED_DAFSA, "co.uk", PSL_TYPE_ICANN, 1 },
+		{ PSL_REVERSED_DAFSA, "github.io", PSL_TYPE_ICANN, 0 },
+		{ PSL_REVERSED_DAFSA, "x.compute.amazonaws.com", PSL_TYPE_PRIVATE, 1 },
+		{ PSL_REVERSED_DAFSA, "x.compute.amazonaws.com", PSL_TYPE_ICANN, 0 },
+		{ PSL_MPH, "co.uk", PSL_TYPE_ICANN, 1 },
+		{ PSL_MPH, "github.io", PSL_TYPE_PRIVATE, 1 },
+		{ PSL_MPH, "github.io", PSL_TYPE_ICANN, 0 },
+		{ PSL_ASCII_LOUDS, "co.uk", PSL_TYPE_ICANN, 1 },
+		{ PSL_ASCII_LOUDS, "github.io", PSL_TYPE_PRIVATE, 1 },
+		{ PSL_ASCII_LOUDS, "github.io", PSL_TYPE_ICANN, 0 },
 	};
 	unsigned it;
 	int result, ver;
-	psl_ctx_t *psl;
+	psl_ctx_t *psl, *psl_ascii;
 
 	psl = psl_load_file(PSL_FILE);
 
@@ -118,6 +210,167 @@ static void test_psl(void)
 		}
 	}
 
+	/* mixed-case domains, the vector works on a lowercase copy, the builtin DAFSA folds while walking */
+	for (it = 0; it < countof(test_data); it++) {
+		const struct test_data *t = &test_data[it];
+
+		if (t->domain) {
+			test_ignore_case(psl, t->domain, t->result);
+			if (psl_builtin())
+				test_ignore_case(psl_builtin(), t->domain, t->result);
+		}
+	}
+
+	/* the ASCII DAFSA needs a conversion of non-ASCII labels */
+	if ((psl_ascii = psl_load_file(PSL_ASCII_DAFSA))) {
+		const char *regdom;
+
+		for (it = 0; it < countof(test_data); it++) {
+			if (test_data[it].domain)
+				test_ignore_case(psl_ascii, test_data[it].domain, test_data[it].result);
+		}
+
+		for (it = 0; it < countof(test_data); it++) {
+			const struct test_data *t = &test_data[it];
+			result = psl_is_public_suffix(psl_ascii, t->domain);
+
+			if (result == t->result) {
+				ok++;
+			} else {
+				failed++;
+				printf("psl_is_public_suffix(%s)=%d (expected %d, ASCII DAFSA)\n", t->domain, result, t->result);
+			}
+		}
+
+		if ((regdom = psl_registrable_domain(psl_ascii, "b\303\274cher.shop.example.co.uk")) && !strcmp(regdom, "example.co.uk")) {
+			ok++;
+		} else {
+			failed++;
+			printf("psl_registrable_domain(b\303\274cher.shop.example.co.uk)=%s (expected example.co.uk, ASCII DAFSA)\n", regdom ? regdom : "NULL");
+		}
+
+		psl_free(psl_ascii);
+	} else {
+		printf("Failed to load %s\n", PSL_ASCII_DAFSA);
+		failed++;
+	}
+
+	/* the engines and memory modes of psl_load_ex() give the same results */
+	for (it = 0; it < countof(load_data); it++) {
+		const struct load_data *l = &load_data[it];
+		psl_ctx_t *psl_ex;
+		unsigned it2;
+
+		if (!(psl_ex = psl_load_ex(l->fname, &l->options))) {
+			failed++;
+			printf("Failed to load %s (%s)\n", l->fname, l->engine);
+			continue;
+		}
+
+		if (!strcmp(psl_engine_name(psl_ex), l->engine) && psl_memory_usage(psl_ex) > 0) {
+			ok++;
+		} else {
+			failed++;
+			printf("psl_engine_name()=%s (expected %s, %s)\n", psl_engine_name(psl_ex), l->engine, l->fname);
+		}
+
+		for (it2 = 0; it2 < countof(test_data); it2++) {
+			const struct test_data *t = &test_data[it2];
+			result = psl_is_public_suffix(psl_ex, t->domain);
+
+			if (result == t->result) {
+				ok++;
+			} else {
+				failed++;
+				printf("psl_is_public_suffix(%s)=%d (expected %d, %s %s)\n", t->domain, result, t->result, l->fname, l->engine);
+			}
+
+			if (t->domain)
+				test_ignore_case(psl_ex, t->domain, t->result);
+		}
+
+		psl_free(psl_ex);
+	}
+
+	/* just the rules of one section */
+	for (it = 0; it < countof(section_data); it++) {
+		const struct section_data *t = &section_data[it];
+		psl_load_options_t options = { sizeof(psl_load_options_t), PSL_ENGINE_AUTO, PSL_MEMORY_COPY, 0 };
+		psl_ctx_t *psl_ex;
+
+		options.sections = t->sections;
+
+		if ((psl_ex = psl_load_ex(t->fname, &options))) {
+			if ((result = psl_is_public_suffix(psl_ex, t->domain)) == t->result) {
+				ok++;
+			} else {
+				failed++;
+				printf("psl_is_public_suffix(%s)=%d (expected %d, %s sections %d)\n", t->domain, result, t->result, t->fname, t->sections);
+			}
+
+			psl_free(psl_ex);
+		} else {
+			failed++;
+			printf("Failed to load %s (sections %d)\n", t->fname, t->sections);
+		}
+	}
+
+	/* a DAFSA or LOUDS trie can't be built at runtime, a MPH file not converted into a DAFSA */
+	{
+		psl_load_options_t options = { sizeof(psl_load_options_t), PSL_ENGINE_DAFSA, PSL_MEMORY_COPY, 0 };
+		psl_ctx_t *psl_ex;
+
+		if (!(psl_ex = psl_load_ex(PSL_FILE, &options))) {
+			ok++;
+		} else {
+			failed++;
+			printf("psl_load_ex(%s, PSL_ENGINE_DAFSA) succeeded\n", PSL_FILE);
+			psl_free(psl_ex);
+		}
+
+		if (!(psl_ex = psl_load_ex(PSL_MPH, &options))) {
+			ok++;
+		} else {
+			failed++;
+			printf("psl_load_ex(%s, PSL_ENGINE_DAFSA) succeeded\n", PSL_MPH);
+			psl_free(psl_ex);
+		}
+
+		options.engine = PSL_ENGINE_LOUDS;
+
+		if (!(psl_ex = psl_load_ex(PSL_DAFSA, &options))) {
+			ok++;
+		} else {
+			failed++;
+			printf("psl_load_ex(%s, PSL_ENGINE_LOUDS) succeeded\n", PSL_DAFSA);
+			psl_free(psl_ex);
+		}
+	}
+
+	/* options of an unknown size are rejected */
+	{
+		psl_load_options_t options = { 0, PSL_ENGINE_AUTO, PSL_MEMORY_COPY, 0 };
+		psl_ctx_t *psl_ex;
+
+		if (!(psl_ex = psl_load_ex(PSL_FILE, &options))) {
+			ok++;
+		} else {
+			failed++;
+			printf("psl_load_ex(%s) with options size 0 succeeded\n", PSL_FILE);
+			psl_free(psl_ex);
+		}
+
+		options.size = sizeof(options) + 1;
+
+		if (!(psl_ex = psl_load_ex(PSL_FILE, &options))) {
+			ok++;
+		} else {
+			failed++;
+			printf("psl_load_ex(%s) with options size %u succeeded\n", PSL_FILE, (unsigned) options.size);
+			psl_free(psl_ex);
+		}
+	}
+
 	/* do some checks to cover more code paths in libpsl */
 	psl_is_public_suffix(NULL, "xxx");
 
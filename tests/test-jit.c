@@ -0,0 +1,195 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of the test suite of libpsl.
+ *
+ * Differential test of the JIT engine (psl_load_ex() with PSL_ENGINE_JIT) against the
+ * interpreting engines, with the rules of the PSL file and variants of them as domains.
+ * Without JIT support, psl_load_ex() keeps the interpreting engine and the results are the same anyway.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libpsl.h>
+#include "common.h"
+
+#define countof(a) (sizeof(a)/sizeof(*(a)))
+
+static int
+	ok,
+	failed;
+
+static void compare(const psl_ctx_t *psl, const psl_ctx_t *jit, const char *name, const char *domain)
+{
+	static const int types[] = {
+		PSL_TYPE_ANY,
+		PSL_TYPE_ICANN,
+		PSL_TYPE_PRIVATE,
+		PSL_TYPE_ANY|PSL_TYPE_NO_STAR_RULE,
+		PSL_TYPE_ANY|PSL_TYPE_IGNORE_CASE,
+	};
+	const char *regdom, *regdom_jit;
+	unsigned it;
+	int result, result_jit;
+
+	for (it = 0; it < countof(types); it++) {
+		result = psl_is_public_suffix2(psl, domain, types[it]);
+		result_jit = psl_is_public_suffix2(jit, domain, types[it]);
+
+		if (result == result_jit) {
+			ok++;
+		} else {
+			failed++;
+			printf("%s: psl_is_public_suffix2(%s, %d)=%d (interpreter %d)\n", name, domain, types[it], result_jit, result);
+		}
+	}
+
+	regdom = psl_registrable_domain(psl, domain);
+	regdom_jit = psl_registrable_domain(jit, domain);
+
+	if (regdom == regdom_jit || (regdom && regdom_jit && !strcmp(regdom, regdom_jit))) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: psl_registrable_domain(%s)=%s (interpreter %s)\n", name, domain,
+			regdom_jit ? regdom_jit : "NULL", regdom ? regdom : "NULL");
+	}
+
+	if (psl_suffix_rule_id(psl, domain, NULL) == psl_suffix_rule_id(jit, domain, NULL)) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: psl_suffix_rule_id(%s) differs\n", name, domain);
+	}
+}
+
+/* compares the contexts with each rule of the PSL file, each with a few variants */
+static void test_jit(const char *fname, psl_load_engine_t engine, const char *name)
+{
+	psl_load_options_t options = { sizeof(psl_load_options_t), PSL_ENGINE_JIT, PSL_MEMORY_COPY, 0 };
+	psl_ctx_t *psl, *jit;
+	char buf[256], domain[300], *linep, *p;
+	size_t len, it;
+	FILE *fp;
+
+	jit = psl_load_ex(fname, &options);
+	options.engine = engine;
+	psl = psl_load_ex(fname, &options);
+
+	if (!psl || !jit) {
+		failed++;
+		printf("%s: failed to load %s\n", name, fname);
+		psl_free(jit);
+		psl_free(psl);
+		return;
+	}
+
+	printf("%s: engine %s, memory %lu bytes (interpreter %s, %lu bytes)\n", name,
+		psl_engine_name(jit), (unsigned long) psl_memory_usage(jit),
+		psl_engine_name(psl), (unsigned long) psl_memory_usage(psl));
+
+	psl_suffix_count(psl) == psl_suffix_count(jit) ? ok++ : failed++;
+	psl_rule_count(psl) == psl_rule_count(jit) ? ok++ : failed++;
+
+	if (!(fp = fopen(PSL_FILE, "r"))) {
+		failed++;
+		printf("Failed to open %s\n", PSL_FILE);
+		psl_free(jit);
+		psl_free(psl);
+		return;
+	}
+
+	while ((linep = fgets(buf, sizeof(buf), fp))) {
+		while (*linep == ' ' || *linep == '\t') linep++;
+		if (!*linep || *linep == '\n' || (*linep == '/' && linep[1] == '/'))
+			continue;
+
+		if (*linep == '!')
+			linep++;
+		else if (*linep == '*' && linep[1] == '.')
+			linep += 2;
+
+		for (p = linep; *p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'; p++);
+		*p = 0;
+
+		if ((len = strlen(linep)) > 200)
+			continue;
+
+		/* the rule, with a host label, uppercase and each of its suffixes */
+		compare(psl, jit, name, linep);
+		snprintf(domain, sizeof(domain), "www.%s", linep);
+		compare(psl, jit, name, domain);
+		snprintf(domain, sizeof(domain), "%s.", linep);
+		compare(psl, jit, name, domain);
+
+		for (it = 0; it < len; it++)
+			domain[it] = linep[it] >= 'a' && linep[it] <= 'z' ? linep[it] - 32 : linep[it];
+		domain[len] = 0;
+		compare(psl, jit, name, domain);
+
+		for (p = linep + 1; *p; p++)
+			if (p[-1] == '.' || p[-1] == 'a')
+				compare(psl, jit, name, p);
+
+		/* a missing or changed first byte */
+		if (len > 1) {
+			memcpy(domain, linep, len + 1);
+			domain[0] = domain[0] == 'x' ? 'y' : 'x';
+			compare(psl, jit, name, domain);
+		}
+	}
+
+	fclose(fp);
+
+	psl_free(jit);
+	psl_free(psl);
+}
+
+int main(int argc, const char * const *argv)
+{
+	/* if VALGRIND testing is enabled, we have to call ourselves with valgrind checking */
+	if (argc == 1) {
+		const char *valgrind = getenv("TESTS_VALGRIND");
+
+		if (valgrind && *valgrind) {
+			return run_valgrind(valgrind, argv[0]);
+		}
+	}
+
+	test_jit(PSL_FILE, PSL_ENGINE_VECTOR, "file");
+	test_jit(PSL_DAFSA, PSL_ENGINE_DAFSA, "dafsa");
+	test_jit(PSL_ASCII_DAFSA, PSL_ENGINE_DAFSA, "ascii-dafsa");
+	test_jit(PSL_PAYLOAD_DAFSA, PSL_ENGINE_DAFSA, "payload-dafsa");
+
+	if (failed) {
+		printf("Summary: %d out of %d tests failed\n", failed, ok + failed);
+		return 1;
+	}
+
+	printf("Summary: All %d tests passed\n", ok + failed);
+	return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of the test suite of libpsl.
+ *
+ * Test case for psl_overlay_load_file(), psl_overlay_load_fp() and psl_overlay_load_data()
+ * with the PSL file, the DAFSA blobs and the builtin data as base.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libpsl.h>
+#include "common.h"
+
+#define countof(a) (sizeof(a)/sizeof(*(a)))
+
+static int
+	ok,
+	failed;
+
+static const char overlay_rules[] =
+	"// internal suffixes\n"
+	"// ===BEGIN PRIVATE DOMAINS===\n"
+	"customers.example.com\n"
+	"*.apps.example.net\n"
+	"!www.apps.example.net\n"
+	"a.b.c.d.e.f.example.com\n"
+	"!foo.ck\n"
+	"internal\n"
+	"b\303\274cher.example\n"
+	"// ===END PRIVATE DOMAINS===\n";
+
+static void test_overlay(const psl_ctx_t *base, const char *name)
+{
+	static const struct test_data {
+		const char
+			*domain;
+		int
+			type,
+			result,
+			base_result;
+	} test_data[] = {
+		{ "customers.example.com", PSL_TYPE_ANY, 1, 0 },
+		{ "customers.example.com", PSL_TYPE_PRIVATE, 1, 0 },
+		{ "customers.example.com", PSL_TYPE_ICANN, 0, 0 },
+		{ "www.customers.example.com", PSL_TYPE_ANY, 0, 0 },
+		{ "x.apps.example.net", PSL_TYPE_ANY, 1, 0 },
+		{ "apps.example.net", PSL_TYPE_ANY, 1, 0 },
+		{ "www.apps.example.net", PSL_TYPE_ANY, 0, 0 },
+		{ "a.b.c.d.e.f.example.com", PSL_TYPE_ANY, 1, 0 }, /* deeper than any rule of the base below .com */
+		{ "foo.ck", PSL_TYPE_ANY, 0, 1 }, /* the overlay exception wins over *.ck of the base */
+		{ "bar.ck", PSL_TYPE_ANY, 1, 1 },
+		{ "www.ck", PSL_TYPE_ANY, 0, 0 },
+		{ "internal", PSL_TYPE_ANY|PSL_TYPE_NO_STAR_RULE, 1, 0 }, /* TLD just listed in the overlay */
+		{ "foo.internal", PSL_TYPE_ANY|PSL_TYPE_NO_STAR_RULE, 0, 0 },
+		{ "b\303\274cher.example", PSL_TYPE_ANY, 1, 0 },
+		{ "xn--bcher-kva.example", PSL_TYPE_ANY, 1, 0 },
+		{ "CUSTOMERS.Example.COM", PSL_TYPE_ANY|PSL_TYPE_IGNORE_CASE, 1, 0 },
+		/* the rules of the base */
+		{ "co.uk", PSL_TYPE_ANY, 1, 1 },
+		{ "www.example.com", PSL_TYPE_ANY, 0, 0 },
+		{ "\345\225\206\346\240\207", PSL_TYPE_ANY|PSL_TYPE_NO_STAR_RULE, 1, 1 },
+		{ "www.\345\225\206\346\240\207", PSL_TYPE_ANY, 0, 0 },
+		{ "adfhoweirh", PSL_TYPE_ANY|PSL_TYPE_NO_STAR_RULE, 0, 0 },
+	};
+	psl_ctx_t *psl, *psl2;
+	const char *regdom;
+	unsigned it;
+	int result;
+
+	if (!(psl = psl_overlay_load_data(base, overlay_rules, sizeof(overlay_rules) - 1))) {
+		failed++;
+		printf("%s: psl_overlay_load_data() failed\n", name);
+		return;
+	}
+
+	for (it = 0; it < countof(test_data); it++) {
+		const struct test_data *t = &test_data[it];
+
+		if ((result = psl_is_public_suffix2(psl, t->domain, t->type)) == t->result) {
+			ok++;
+		} else {
+			failed++;
+			printf("%s: psl_is_public_suffix2(%s, %d)=%d (expected %d)\n", name, t->domain, t->type, result, t->result);
+		}
+
+		if ((result = psl_is_public_suffix2(base, t->domain, t->type)) == t->base_result) {
+			ok++;
+		} else {
+			failed++;
+			printf("%s: psl_is_public_suffix2(%s, %d)=%d (expected %d, base)\n", name, t->domain, t->type, result, t->base_result);
+		}
+	}
+
+	if ((regdom = psl_registrable_domain(psl, "www.shop.customers.example.com")) && !strcmp(regdom, "shop.customers.example.com")) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: psl_registrable_domain(www.shop.customers.example.com)=%s (expected shop.customers.example.com)\n", name, regdom ? regdom : "NULL");
+	}
+
+	if (psl_rule_count(psl) == -1 && psl_suffix_rule_id(psl, "customers.example.com", NULL) == -1) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: the overlay has rule IDs\n", name);
+	}
+
+	if (psl_suffix_count(base) < 0 ? psl_suffix_count(psl) == -1 : psl_suffix_count(psl) == psl_suffix_count(base) + 5) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: psl_suffix_count()=%d (base %d)\n", name, psl_suffix_count(psl), psl_suffix_count(base));
+	}
+
+	/* an overlay of an overlay */
+	if ((psl2 = psl_overlay_load_data(psl, "example.org\n", 12))) {
+		psl_is_public_suffix(psl2, "example.org") == 1 ? ok++ : failed++;
+		psl_is_public_suffix(psl2, "customers.example.com") == 1 ? ok++ : failed++;
+		psl_is_public_suffix(psl2, "co.uk") == 1 ? ok++ : failed++;
+		psl_is_public_suffix(psl, "example.org") == 0 ? ok++ : failed++;
+		psl_free(psl2);
+	} else {
+		failed++;
+		printf("%s: psl_overlay_load_data() of an overlay failed\n", name);
+	}
+
+	psl_free(psl);
+}
+
+static void test_psl(void)
+{
+	psl_ctx_t *psl;
+	FILE *fp;
+
+	if ((psl = psl_load_file(PSL_FILE))) {
+		test_overlay(psl, "file");
+
+		/* a DAFSA can't be an overlay */
+		psl_overlay_load_file(psl, PSL_DAFSA) == NULL ? ok++ : failed++;
+		psl_overlay_load_file(psl, NULL) == NULL ? ok++ : failed++;
+		psl_overlay_load_fp(psl, NULL) == NULL ? ok++ : failed++;
+		psl_overlay_load_data(NULL, "com\n", 4) == NULL ? ok++ : failed++;
+
+		/* the PSL file as overlay to itself */
+		if ((fp = fopen(PSL_FILE, "rb"))) {
+			psl_ctx_t *psl2 = psl_overlay_load_fp(psl, fp);
+
+			psl_is_public_suffix(psl2, "co.uk") == 1 ? ok++ : failed++;
+			psl_free(psl2);
+			fclose(fp);
+		}
+
+		psl_free(psl);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_FILE);
+	}
+
+	if ((psl = psl_load_file(PSL_DAFSA))) {
+		test_overlay(psl, "dafsa");
+		psl_free(psl);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_DAFSA);
+	}
+
+	if ((psl = psl_load_file(PSL_ASCII_DAFSA))) {
+		test_overlay(psl, "ascii-dafsa");
+		psl_free(psl);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_ASCII_DAFSA);
+	}
+
+	if (psl_builtin())
+		test_overlay(psl_builtin(), "builtin");
+}
+
+int main(int argc, const char * const *argv)
+{
+	/* if VALGRIND testing is enabled, we have to call ourselves with valgrind checking */
+	if (argc == 1) {
+		const char *valgrind = getenv("TESTS_VALGRIND");
+
+		if (valgrind && *valgrind) {
+			return run_valgrind(valgrind, argv[0]);
+		}
+	}
+
+	test_psl();
+
+	if (failed) {
+		printf("Summary: %d out of %d tests failed\n", failed, ok + failed);
+		return 1;
+	}
+
+	printf("Summary: All %d tests passed\n", ok + failed);
+	return 0;
+}
@@ -55,7 +55,7 @@ static void testx(const psl_ctx_t *psl, const char *domain, const char *encoding
 	if ((rc = psl_str_to_utf8lower(domain, encoding, lang, &lower)) == PSL_SUCCESS)
 		domain = lower;
 	/* non-ASCII domains fail here if no runtime IDN library is configured, so skip it */
-#if defined(WITH_LIBIDN) || defined(WITH_LIBIDN2) || defined(WITH_LIBICU)
+#if defined(WITH_LIBIDN) || defined(WITH_LIBIDN2) || defined(WITH_LIBICU) || defined(WITH_NATIVE_IDNA)
 	else if (domain) {
 		/* if we do not runtime support, test failure have to be skipped */
 		failed++;
@@ -87,10 +87,139 @@ static void test_iso(const psl_ctx_t *psl, const char *domain, const char *expec
 	testx(psl, domain, "iso-8859-15", "de", expected_result);
 }
 
+static void test_unicode(const psl_ctx_t *psl, const char *domain, size_t bufsize, const char *expected_result)
+{
+	char buf[128];
+	const char *result;
+
+	result = psl_registrable_domain_unicode(psl, domain, buf, bufsize);
+
+	if ((result && expected_result && !strcmp(result, expected_result)) || (!result && !expected_result)) {
+		ok++;
+	} else {
+		failed++;
+		printf("psl_registrable_domain_unicode(%s,%u)=%s (expected %s)\n",
+			   domain ? domain : "NULL", (unsigned) bufsize, result ? result : "NULL", expected_result ? expected_result : "NULL");
+	}
+}
+
+static void test_unicode_unregistrable(const psl_ctx_t *psl, const char *domain, const char *expected_result)
+{
+	char buf[128];
+	const char *result;
+
+	result = psl_unregistrable_domain_unicode(psl, domain, buf, sizeof(buf));
+
+	if ((result && expected_result && !strcmp(result, expected_result)) || (!result && !expected_result)) {
+		ok++;
+	} else {
+		failed++;
+		printf("psl_unregistrable_domain_unicode(%s)=%s (expected %s)\n",
+			   domain ? domain : "NULL", result ? result : "NULL", expected_result ? expected_result : "NULL");
+	}
+}
+
+static void test_ignore_case(const psl_ctx_t *psl, const char *domain, const char *expected_result)
+{
+	const char *result = psl_registrable_domain2(psl, domain, PSL_TYPE_IGNORE_CASE);
+
+	if ((result && expected_result && !strcmp(result, expected_result)) || (!result && !expected_result)) {
+		ok++;
+	} else {
+		failed++;
+		printf("psl_registrable_domain2(%s, IGNORE_CASE)=%s (expected %s)\n",
+			   domain, result ? result : "NULL", expected_result ? expected_result : "NULL");
+	}
+}
+
+/* more labels than the deepest rule below the TLD, the lookup skips the surplus labels */
+static void test_deep(const psl_ctx_t *psl)
+{
+	test(psl, "a.b.c.d.e.f.www.example.com", "example.com");
+	test(psl, "a.b.c.d.e.f.www.city.kawasaki.jp", "city.kawasaki.jp");
+	test(psl, "a.b.c.d.e.f.www.example.kawasaki.jp", "www.example.kawasaki.jp");
+	test(psl, "a.b.c.d.e.f.www.example.corp", "example.corp");
+	test(psl, "a..com", "a..com");
+	test(psl, "a..example.com", "example.com");
+
+	/* mixed-case ASCII, the result points into the domain */
+	test_ignore_case(psl, "A.B.C.D.E.F.WWW.Example.COM", "Example.COM");
+	test_ignore_case(psl, "WWW.City.Kawasaki.JP", "City.Kawasaki.JP");
+	test_ignore_case(psl, "www.example.Kawasaki.JP", "www.example.Kawasaki.JP");
+	test_ignore_case(psl, "www.Example.CORP", "Example.CORP");
+	test_ignore_case(psl, "COM", NULL);
+	test_ignore_case(psl, "www.\303\270yer.NO", "www.\303\270yer.NO");
+}
+
+#if defined(WITH_LIBIDN2) || defined(WITH_LIBICU) || defined(WITH_NATIVE_IDNA)
+/*
+ * Deviation characters are kept by the nontransitional UTS#46 processing of the IDNA runtimes,
+ * not mapped to "ss" (U+00DF), U+03C3 (U+03C2) or removed (U+200D ZWJ after a virama).
+ * UTF-8 rules are converted to punycode when loaded, UTF-8 domains when looked up in ASCII mode.
+ */
+static void test_deviation(const psl_ctx_t *psl, const psl_ctx_t *ascii_psl)
+{
+	static const char rules[] =
+		"fa\303\237.de\n"
+		"\316\262\317\214\316\273\316\277\317\202.gr\n"
+		"\340\244\225\340\245\215\342\200\215\340\244\267.in\n";
+	static const char ascii_rules[] =
+		"xn--fa-hia.de\n"
+		"xn--nxasmm1c.gr\n"
+		"xn--11b2ezcw70k.in\n";
+	psl_ctx_t *psl2;
+
+	if ((psl2 = psl_overlay_load_data(psl, rules, sizeof(rules) - 1))) {
+		test(psl2, "www.xn--fa-hia.de", "www.xn--fa-hia.de");
+		test(psl2, "www.fass.de", "fass.de");
+		test(psl2, "www.xn--nxasmm1c.gr", "www.xn--nxasmm1c.gr");
+		test(psl2, "www.xn--nxasmq6b.gr", "xn--nxasmq6b.gr");
+		test(psl2, "www.xn--11b2ezcw70k.in", "www.xn--11b2ezcw70k.in");
+		test(psl2, "www.xn--11b2ezc.in", "xn--11b2ezc.in");
+		psl_free(psl2);
+	} else {
+		failed++;
+		printf("psl_overlay_load_data() failed\n");
+	}
+
+	if ((psl2 = psl_overlay_load_data(ascii_psl, ascii_rules, sizeof(ascii_rules) - 1))) {
+		test(psl2, "www.fa\303\237.de", "www.fa\303\237.de");
+		test(psl2, "www.fass.de", "fass.de");
+		test(psl2, "www.\316\262\317\214\316\273\316\277\317\202.gr", "www.\316\262\317\214\316\273\316\277\317\202.gr");
+		test(psl2, "www.\316\262\317\214\316\273\316\277\317\203.gr", "\316\262\317\214\316\273\316\277\317\203.gr");
+		test(psl2, "www.\340\244\225\340\245\215\342\200\215\340\244\267.in", "www.\340\244\225\340\245\215\342\200\215\340\244\267.in");
+		test(psl2, "www.\340\244\225\340\245\215\340\244\267.in", "\340\244\225\340\245\215\340\244\267.in");
+		psl_free(psl2);
+	} else {
+		failed++;
+		printf("psl_overlay_load_data() failed\n");
+	}
+}
+
+/* decomposed rules are composed (NFC) before the conversion into punycode, like by toASCII of the lookups */
+static void test_decomposed(const psl_ctx_t *psl)
+{
+	static const char rules[] =
+		"cafe\314\201.fr\n"
+		"o\314\201\314\233.vn\n";
+	psl_ctx_t *psl2;
+
+	if ((psl2 = psl_overlay_load_data(psl, rules, sizeof(rules) - 1))) {
+		test(psl2, "www.xn--caf-dma.fr", "www.xn--caf-dma.fr");
+		test(psl2, "www.xn--bmg.vn", "www.xn--bmg.vn");
+		psl_free(psl2);
+	} else {
+		failed++;
+		printf("psl_overlay_load_data() failed\n");
+	}
+}
+#endif
+
 static void test_psl(void)
 {
 	FILE *fp;
 	const psl_ctx_t *psl;
+	psl_ctx_t *psl2;
 	const char *p;
 	char buf[256], domain[128], expected_regdom[128], semicolon[2];
 	char lbuf[258];
@@ -111,7 +240,7 @@ static void test_psl(void)
 	test(NULL, "com", NULL);
 
 	/* Norwegian with uppercase oe */
-#ifdef WITH_LIBICU
+#if defined(WITH_LIBICU) || defined(WITH_NATIVE_IDNA)
 	test(psl, "www.\303\230yer.no", "www.\303\270yer.no");
 #endif
 
@@ -120,10 +249,30 @@ static void test_psl(void)
 
 	/* Norwegian with lowercase oe, encoded as ISO-8859-15 */
         /* makes only sense with a runtime IDN library configured */
-#if defined(WITH_LIBIDN) || defined(WITH_LIBIDN2) || defined(WITH_LIBICU)
+#if defined(WITH_LIBIDN) || defined(WITH_LIBIDN2) || defined(WITH_LIBICU) || defined(WITH_NATIVE_IDNA)
 	test_iso(psl, "www.\370yer.no", "www.\303\270yer.no");
 #endif
 
+	/* libidn does IDNA2003, which maps the deviation characters like transitional processing */
+#if defined(WITH_LIBIDN2) || defined(WITH_LIBICU) || defined(WITH_NATIVE_IDNA)
+	if ((psl2 = psl_load_file(PSL_ASCII_DAFSA))) {
+		test_deviation(psl, psl2);
+		psl_free(psl2);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_ASCII_DAFSA);
+	}
+
+	test_decomposed(psl);
+#endif
+
+	/* decomposed domains are composed (NFKC), also out of canonical order (ICU just converts to lowercase) */
+#if defined(WITH_LIBIDN) || defined(WITH_LIBIDN2) || defined(WITH_NATIVE_IDNA)
+	test(psl, "www.CAFE\314\201.fr", "caf\303\251.fr");
+	test(psl, "www.A\314\212lesund.no", "www.\303\245lesund.no");
+	test(psl, "www.o\314\201\314\233.vn", "\341\273\233.vn");
+#endif
+
 	/* Testing special code paths of psl_str_to_utf8lower() */
 	for (it = 254; it <= 257; it++) {
 		memset(lbuf, 'a', it);
@@ -146,6 +295,46 @@ static void test_psl(void)
 	/* special check with NULL psl context and TLD */
 	test(psl, "his.name", "his.name");
 
+	test_deep(psl);
+
+	if ((psl2 = psl_load_file(PSL_FILE))) {
+		test_deep(psl2);
+		psl_free(psl2);
+	}
+
+	if ((psl2 = psl_load_file(PSL_DAFSA))) {
+		test_deep(psl2);
+		psl_free(psl2);
+	}
+
+	/* the DAFSA with reversed labels looks up all suffixes with a single traversal */
+	if ((psl2 = psl_load_file(PSL_REVERSED_DAFSA))) {
+		test_deep(psl2);
+		test(psl2, "whoever.forgot.his.name", "whoever.forgot.his.name");
+		test(psl2, "forgot.his.name", NULL);
+		test(psl2, "his.name", "his.name");
+		psl_free(psl2);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_REVERSED_DAFSA);
+	}
+
+	/* ACE labels decoded into UTF-8 */
+	test_unicode(psl, NULL, 128, NULL);
+	test_unicode(NULL, "www.xn--bb-eka.at", 128, NULL);
+	test_unicode(psl, "www.xn--bb-eka.at", 128, "\303\266bb.at");
+	test_unicode(psl, "www.xn--mnchen-3ya.de", 128, "m\303\274nchen.de");
+	test_unicode(psl, "www.example.xn--p1ai", 128, "example.\321\200\321\204");
+	test_unicode(psl, "www.example.com", 128, "example.com");
+	test_unicode(psl, "www.\303\266bb.at", 128, "\303\266bb.at");
+	test_unicode(psl, "com", 128, NULL);
+	test_unicode(psl, "www.xn--0.com", 128, NULL); /* invalid punycode */
+	test_unicode(psl, "www.xn--bb-eka.at", 8, "\303\266bb.at");
+	test_unicode(psl, "www.xn--bb-eka.at", 7, NULL); /* buffer too small */
+	test_unicode(psl, "www.example.com", 0, NULL);
+	test_unicode_unregistrable(psl, "www.example.xn--p1ai", "\321\200\321\204");
+	test_unicode_unregistrable(psl, "www.example.com", "com");
+
 	if ((fp = fopen(PSL_TESTFILE, "r"))) {
 		while ((fgets(buf, sizeof(buf), fp))) {
 			/* advance over ASCII white space */
@@ -0,0 +1,286 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of the test suite of libpsl.
+ *
+ * Test case for psl_suffix_rule_id(), psl_rule_by_id() and psl_rule_count()
+ * with the PSL file and DAFSA, MPH and LOUDS blobs with payloads, also loaded into the vector, MPH and darray engines.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libpsl.h>
+#include "common.h"
+
+#define countof(a) (sizeof(a)/sizeof(*(a)))
+
+static int
+	ok,
+	failed;
+
+static void test(const psl_ctx_t *psl, const char *name, const char *domain, const char *rule, int flags)
+{
+	const char *result = NULL;
+	int id, result_flags = 0;
+
+	if ((id = psl_suffix_rule_id(psl, domain, &result_flags)) >= 0)
+		result = psl_rule_by_id(psl, id, NULL);
+
+	if ((result && rule && !strcmp(result, rule) && result_flags == flags) || (!result && !rule)) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: psl_suffix_rule_id(%s)=%d (%s/%d, expected %s/%d)\n", name, domain, id,
+			result ? result : "NULL", result_flags, rule ? rule : "NULL", flags);
+	}
+}
+
+static void test_rules(const psl_ctx_t *psl, const char *name, int utf8)
+{
+	static const struct test_data {
+		const char
+			*domain,
+			*rule,
+			*ascii_rule; /* in DAFSA blobs in ASCII mode */
+		int
+			flags;
+	} test_data[] = {
+		{ "www.example.com", "com", "com", PSL_RULE_ICANN },
+		{ "com", "com", "com", PSL_RULE_ICANN },
+		{ "www.example.co.uk", "co.uk", "co.uk", PSL_RULE_ICANN },
+		{ "www.example.kawasaki.jp", "*.kawasaki.jp", "*.kawasaki.jp", PSL_RULE_ICANN | PSL_RULE_WILDCARD },
+		{ "example.kawasaki.jp", "*.kawasaki.jp", "*.kawasaki.jp", PSL_RULE_ICANN | PSL_RULE_WILDCARD },
+		{ "www.city.kawasaki.jp", "!city.kawasaki.jp", "!city.kawasaki.jp", PSL_RULE_ICANN | PSL_RULE_EXCEPTION },
+		{ "city.kawasaki.jp", "!city.kawasaki.jp", "!city.kawasaki.jp", PSL_RULE_ICANN | PSL_RULE_EXCEPTION },
+		{ "www.example.\345\205\254\345\217\270.cn", "\345\205\254\345\217\270.cn", "xn--55qx5d.cn", PSL_RULE_ICANN | PSL_RULE_IDN },
+		{ "www.example.xn--55qx5d.cn", "\345\205\254\345\217\270.cn", "xn--55qx5d.cn", PSL_RULE_ICANN | PSL_RULE_IDN },
+		{ "www.example.adfhoweirh", NULL, NULL, 0 },
+		{ "", NULL, NULL, 0 },
+	};
+	unsigned it;
+
+	for (it = 0; it < countof(test_data); it++) {
+		const struct test_data *t = &test_data[it];
+
+		test(psl, name, t->domain, utf8 ? t->rule : t->ascii_rule, t->flags);
+	}
+}
+
+/* each rule of 'ref' has the same ID in 'psl', the rule itself is its public suffix */
+static void test_ids(const psl_ctx_t *psl, const char *name, const psl_ctx_t *ref, int utf8)
+{
+	const char *rule, *ref_rule;
+	int id, n, flags, ref_flags;
+
+	if (psl_rule_count(psl) == psl_rule_count(ref)) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: psl_rule_count()=%d (expected %d)\n", name, psl_rule_count(psl), psl_rule_count(ref));
+	}
+
+	for (n = psl_rule_count(ref), id = 0; id < n; id++) {
+		if (!(ref_rule = psl_rule_by_id(ref, id, &ref_flags)))
+			continue;
+
+		rule = psl_rule_by_id(psl, id, &flags);
+
+		if (rule && flags == ref_flags && (!strcmp(rule, ref_rule) || (!utf8 && (flags & PSL_RULE_IDN)))) {
+			ok++;
+		} else {
+			failed++;
+			printf("%s: psl_rule_by_id(%d)=%s/%d (expected %s/%d)\n", name, id, rule ? rule : "NULL", flags, ref_rule, ref_flags);
+		}
+
+		if (*ref_rule == '!')
+			ref_rule++;
+		else if (*ref_rule == '*')
+			ref_rule += 2;
+
+		if (psl_suffix_rule_id(psl, ref_rule, NULL) == id) {
+			ok++;
+		} else {
+			failed++;
+			printf("%s: psl_suffix_rule_id(%s)=%d (expected %d)\n", name, ref_rule, psl_suffix_rule_id(psl, ref_rule, NULL), id);
+		}
+	}
+}
+
+static void test_psl(void)
+{
+	psl_ctx_t *psl, *dafsa;
+
+	if (!(psl = psl_load_file(PSL_FILE))) {
+		failed++;
+		printf("Failed to load %s\n", PSL_FILE);
+		return;
+	}
+
+	test_rules(psl, "file", 1);
+
+	if ((dafsa = psl_load_file(PSL_PAYLOAD_DAFSA))) {
+		test_rules(dafsa, "payload", 1);
+		test_ids(dafsa, "payload", psl, 1);
+		psl_free(dafsa);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_PAYLOAD_DAFSA);
+	}
+
+	if ((dafsa = psl_load_file(PSL_PAYLOAD_ASCII_DAFSA))) {
+		test_rules(dafsa, "payload-ascii", 0);
+		test_ids(dafsa, "payload-ascii", psl, 0);
+		psl_free(dafsa);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_PAYLOAD_ASCII_DAFSA);
+	}
+
+	if ((dafsa = psl_load_file(PSL_REVERSED_DAFSA))) {
+		test_rules(dafsa, "reversed", 1);
+		test_ids(dafsa, "reversed", psl, 1);
+		psl_free(dafsa);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_REVERSED_DAFSA);
+	}
+
+	if ((dafsa = psl_load_file(PSL_PAYLOAD_ASCII_MPH))) {
+		test_rules(dafsa, "mph-payload-ascii", 0);
+		test_ids(dafsa, "mph-payload-ascii", psl, 0);
+		psl_free(dafsa);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_PAYLOAD_ASCII_MPH);
+	}
+
+	if ((dafsa = psl_load_file(PSL_PAYLOAD_ASCII_LOUDS))) {
+		test_rules(dafsa, "louds-payload-ascii", 0);
+		test_ids(dafsa, "louds-payload-ascii", psl, 0);
+		psl_free(dafsa);
+	} else {
+		failed++;
+		printf("Failed to load %s\n", PSL_PAYLOAD_ASCII_LOUDS);
+	}
+
+	/* the vector, MPH and darray engines keep the rule IDs of the payloads */
+	{
+		psl_load_options_t options = { sizeof(psl_load_options_t), PSL_ENGINE_VECTOR, PSL_MEMORY_COPY, 0 };
+
+		if ((dafsa = psl_load_ex(PSL_PAYLOAD_DAFSA, &options))) {
+			test_rules(dafsa, "payload-vector", 1);
+			test_ids(dafsa, "payload-vector", psl, 1);
+			psl_free(dafsa);
+		} else {
+			failed++;
+			printf("Failed to load %s\n", PSL_PAYLOAD_DAFSA);
+		}
+
+		options.engine = PSL_ENGINE_MPH;
+
+		if ((dafsa = psl_load_ex(PSL_PAYLOAD_DAFSA, &options))) {
+			test_rules(dafsa, "payload-mph", 1);
+			test_ids(dafsa, "payload-mph", psl, 1);
+			psl_free(dafsa);
+		} else {
+			failed++;
+			printf("Failed to load %s\n", PSL_PAYLOAD_DAFSA);
+		}
+
+		if ((dafsa = psl_load_ex(PSL_FILE, &options))) {
+			test_rules(dafsa, "file-mph", 1);
+			test_ids(dafsa, "file-mph", psl, 1);
+			psl_free(dafsa);
+		} else {
+			failed++;
+			printf("Failed to load %s\n", PSL_FILE);
+		}
+
+		options.engine = PSL_ENGINE_DARRAY;
+
+		if ((dafsa = psl_load_ex(PSL_PAYLOAD_DAFSA, &options))) {
+			test_rules(dafsa, "payload-darray", 1);
+			test_ids(dafsa, "payload-darray", psl, 1);
+			psl_free(dafsa);
+		} else {
+			failed++;
+			printf("Failed to load %s\n", PSL_PAYLOAD_DAFSA);
+		}
+
+		if ((dafsa = psl_load_ex(PSL_FILE, &options))) {
+			test_rules(dafsa, "file-darray", 1);
+			test_ids(dafsa, "file-darray", psl, 1);
+			psl_free(dafsa);
+		} else {
+			failed++;
+			printf("Failed to load %s\n", PSL_FILE);
+		}
+	}
+
+	/* no payloads, no rule IDs */
+	if ((dafsa = psl_load_file(PSL_DAFSA))) {
+		psl_rule_count(dafsa) == -1 ? ok++ : failed++;
+		psl_suffix_rule_id(dafsa, "www.example.com", NULL) == -1 ? ok++ : failed++;
+		psl_free(dafsa);
+	}
+
+	if (psl_builtin()) {
+		psl_rule_count(psl_builtin()) == -1 ? ok++ : failed++;
+		psl_rule_by_id(psl_builtin(), 0, NULL) == NULL ? ok++ : failed++;
+	}
+
+	/* out of range or NULL */
+	psl_rule_by_id(psl, -1, NULL) == NULL ? ok++ : failed++;
+	psl_rule_by_id(psl, psl_rule_count(psl), NULL) == NULL ? ok++ : failed++;
+	psl_rule_by_id(NULL, 0, NULL) == NULL ? ok++ : failed++;
+	psl_suffix_rule_id(psl, NULL, NULL) == -1 ? ok++ : failed++;
+	psl_suffix_rule_id(NULL, "com", NULL) == -1 ? ok++ : failed++;
+
+	psl_free(psl);
+}
+
+int main(int argc, const char * const *argv)
+{
+	/* if VALGRIND testing is enabled, we have to call ourselves with valgrind checking */
+	if (argc == 1) {
+		const char *valgrind = getenv("TESTS_VALGRIND");
+
+		if (valgrind && *valgrind) {
+			return run_valgrind(valgrind, argv[0]);
+		}
+	}
+
+	test_psl();
+
+	if (failed) {
+		printf("Summary: %d out of %d tests failed\n", failed, ok + failed);
+		return 1;
+	}
+
+	printf("Summary: All %d tests passed\n", ok + failed);
+	return 0;
+}
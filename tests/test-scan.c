@@ -0,0 +1,238 @@
+/*
+ * Copyright(c) 2024 Tim Ruehsen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * This file is part of the test suite of libpsl.
+ *
+ * Test case for the input scanning routines: each SIMD variant supported by
+ * the CPU is checked against the scalar reference.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+/* the scan routines are hidden symbols of libpsl, so compile them in */
+#include "scan.c"
+
+#define countof(a) (sizeof(a)/sizeof(*(a)))
+
+static int
+	ok,
+	failed;
+
+/* compares one variant against the scalar reference */
+static void check(const psl_scan_impl_t *impl, const psl_scan_impl_t *ref, const unsigned char *s, size_t len)
+{
+	psl_scan_t scan, ref_scan;
+	char buf[256], ref_buf[256];
+
+	impl->scan_domain((const char *) s, len, &scan);
+	ref->scan_domain((const char *) s, len, &ref_scan);
+
+	if (scan.ndots == ref_scan.ndots && scan.nonascii == ref_scan.nonascii && scan.valid == ref_scan.valid) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: scan_domain(len %u) = %u/%d/%d (expected %u/%d/%d)\n", impl->name, (unsigned) len,
+			(unsigned) scan.ndots, scan.nonascii, scan.valid,
+			(unsigned) ref_scan.ndots, ref_scan.nonascii, ref_scan.valid);
+	}
+
+	if (impl->is_ascii((const char *) s, len) == ref->is_ascii((const char *) s, len)) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: is_ascii(len %u) differs\n", impl->name, (unsigned) len);
+	}
+
+	memcpy(buf, s, len);
+	memcpy(ref_buf, s, len);
+	impl->tolower_ascii(buf, len);
+	ref->tolower_ascii(ref_buf, len);
+
+	if (!memcmp(buf, ref_buf, len)) {
+		ok++;
+	} else {
+		failed++;
+		printf("%s: tolower_ascii(len %u) differs\n", impl->name, (unsigned) len);
+	}
+}
+
+static void test_scalar(const psl_scan_impl_t *ref)
+{
+	static const struct test_data {
+		const char
+			*s;
+		size_t
+			ndots;
+		int
+			nonascii,
+			valid;
+	} test_data[] = {
+		{ "", 0, 0, 1 },
+		{ "www.example.com", 2, 0, 1 },
+		{ "..", 2, 0, 1 },
+		{ "b\303\274cher.de", 1, 1, 1 }, /* U+00FC */
+		{ "\345\225\206\346\240\207", 0, 1, 1 }, /* U+5546 U+6807 */
+		{ "\360\237\230\200.com", 1, 1, 1 }, /* U+1F600 */
+		{ "\303", 0, 1, 0 }, /* truncated */
+		{ "\303.", 1, 1, 0 }, /* truncated */
+		{ "\200", 0, 1, 0 }, /* lone continuation byte */
+		{ "\300\257", 0, 1, 0 }, /* overlong */
+		{ "\340\237\277", 0, 1, 0 }, /* overlong */
+		{ "\360\217\277\277", 0, 1, 0 }, /* overlong */
+		{ "\355\240\200", 0, 1, 0 }, /* surrogate U+D800 */
+		{ "\364\220\200\200", 0, 1, 0 }, /* U+110000 */
+		{ "\370\210\200\200\200", 0, 1, 0 }, /* 5 byte sequence */
+		{ "\377.\376.", 2, 1, 0 },
+	};
+	unsigned it;
+
+	for (it = 0; it < countof(test_data); it++) {
+		const struct test_data *t = &test_data[it];
+		psl_scan_t scan;
+
+		ref->scan_domain(t->s, strlen(t->s), &scan);
+
+		if (scan.ndots == t->ndots && scan.nonascii == t->nonascii && scan.valid == t->valid
+			&& ref->is_ascii(t->s, strlen(t->s)) == !t->nonascii)
+		{
+			ok++;
+		} else {
+			failed++;
+			printf("scalar: scan_domain(%s) = %u/%d/%d (expected %u/%d/%d)\n", t->s,
+				(unsigned) scan.ndots, scan.nonascii, scan.valid,
+				(unsigned) t->ndots, t->nonascii, t->valid);
+		}
+	}
+}
+
+static void test_variant(const psl_scan_impl_t *impl, const psl_scan_impl_t *ref)
+{
+	/* bytes that matter for the UTF-8 range tables */
+	static const unsigned char special[] = {
+		0x00, '.', 'A', 'Z', 'a', '@', '[', 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC1, 0xC2, 0xDF,
+		0xE0, 0xE1, 0xEC, 0xED, 0xEE, 0xEF, 0xF0, 0xF1, 0xF3, 0xF4, 0xF5, 0xF7, 0xF8, 0xFF
+	};
+	/* around the 16/32 byte block boundaries */
+	static const unsigned char positions[] = { 0, 1, 2, 13, 14, 15, 16, 17, 29, 30, 31, 32, 33, 45, 46, 47, 48, 61, 62, 63, 64, 65 };
+	unsigned char buf[200];
+	unsigned it, pos, len, n;
+
+	/* all 1-3 byte combinations of the special bytes, ending in various positions of a block */
+	for (it = 0; it < countof(special) * countof(special) * countof(special); it++) {
+		unsigned char c[3];
+
+		c[0] = special[it % countof(special)];
+		c[1] = special[it / countof(special) % countof(special)];
+		c[2] = special[it / countof(special) / countof(special)];
+
+		for (n = 0; n < countof(positions); n++) {
+			pos = positions[n];
+			memset(buf, 'x', pos);
+			memcpy(buf + pos, c, 3);
+			check(impl, ref, buf, pos + 1);
+			check(impl, ref, buf, pos + 3);
+		}
+	}
+
+	/* random data, biased to what domains look like */
+	srand(1);
+	for (it = 0; it < 100000; it++) {
+		len = rand() % sizeof(buf);
+
+		for (pos = 0; pos < len; pos++) {
+			int r = rand() % 10;
+
+			if (r < 5)
+				buf[pos] = "abcXYZ.-"[rand() % 8];
+			else if (r < 8)
+				buf[pos] = special[rand() % countof(special)];
+			else
+				buf[pos] = (unsigned char) rand();
+		}
+
+		check(impl, ref, buf, len);
+	}
+}
+
+static void test_scan(void)
+{
+	const psl_scan_impl_t *impls, *ref;
+	size_t n, it;
+	char buf[64];
+
+	impls = psl_scan_impls(&n);
+	ref = &impls[n - 1];
+
+	test_scalar(ref);
+
+	for (it = 0; it < n - 1; it++) {
+		if (!impls[it].supported()) {
+			printf("%s: not supported by CPU, skipped\n", impls[it].name);
+			continue;
+		}
+
+		printf("%s: testing against %s\n", impls[it].name, ref->name);
+		test_variant(&impls[it], ref);
+	}
+
+	/* the dispatched functions */
+	strcpy(buf, "WWW.Example.COM.\303\234BER.ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+	psl_scan_tolower_ascii(buf, strlen(buf));
+	if (!strcmp(buf, "www.example.com.\303\234ber.abcdefghijklmnopqrstuvwxyz")) {
+		ok++;
+	} else {
+		failed++;
+		printf("psl_scan_tolower_ascii() = %s\n", buf);
+	}
+
+	psl_scan_is_ascii(buf, strlen(buf)) == 0 ? ok++ : failed++;
+	psl_scan_is_ascii(buf, 15) == 1 ? ok++ : failed++;
+}
+
+int main(int argc, const char * const *argv)
+{
+	/* if VALGRIND testing is enabled, we have to call ourselves with valgrind checking */
+	if (argc == 1) {
+		const char *valgrind = getenv("TESTS_VALGRIND");
+
+		if (valgrind && *valgrind) {
+			return run_valgrind(valgrind, argv[0]);
+		}
+	}
+
+	test_scan();
+
+	if (failed) {
+		printf("Summary: %d out of %d tests failed\n", failed, ok + failed);
+		return 1;
+	}
+
+	printf("Summary: All %d tests passed\n", ok + failed);
+	return 0;
+}